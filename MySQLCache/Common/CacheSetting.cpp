@@ -16,6 +16,12 @@ const std::string WRITE_BUFFER_DEFAULT_MEMORY = "write-buffer-default-memory";
 const std::string MEMORY_ROOT_PATH = "memory-root-path";
 const std::string SERVER_ADDR = "server-addr";
 const std::string SQL_SERVER_ADDR = "sql-server-addr";
+const std::string STATEMENT_CACHE_SIZE = "statement-cache-size";
+const std::string CONNECTION_POOL_SIZE = "connection-pool-size";
+const std::string CONNECTION_IDLE_TIME = "connection-idle-time";
+const std::string CONNECTION_CHECK_TIME = "connection-check-time";
+const std::string GROUP_COMMIT_WINDOW = "group-commit-window";
+const std::string LIMIT_WINDOW_SLACK = "limit-window-slack";
 
 using namespace std;
 
@@ -18,6 +18,12 @@ extern const std::string WRITE_BUFFER_DEFAULT_MEMORY;
 extern const std::string MEMORY_ROOT_PATH;
 extern const std::string SERVER_ADDR;
 extern const std::string SQL_SERVER_ADDR;
+extern const std::string STATEMENT_CACHE_SIZE;
+extern const std::string CONNECTION_POOL_SIZE;
+extern const std::string CONNECTION_IDLE_TIME;
+extern const std::string CONNECTION_CHECK_TIME;
+extern const std::string GROUP_COMMIT_WINDOW;
+extern const std::string LIMIT_WINDOW_SLACK;
 
 class CacheSetting
 {
@@ -13,14 +13,10 @@ struct Range
 #define FOR_EACH(i, els) for (auto i = els.begin(); i != els.end(); ++i)
 
 #define COMPARE_RESULT(v1, v2, order) if (v2 > v1) { \
-if (order == OrderType::otAsc) { \
-	return true; \
-} \
+	return order == OrderType::otAsc; \
 } \
 else if (v2 < v1) { \
-	if (order == OrderType::otDesc) { \
-		return true; \
-	} \
+	return order == OrderType::otDesc; \
 }
 
 int getCPUCount();
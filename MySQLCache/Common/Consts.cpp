@@ -3,4 +3,6 @@
 const std::string UPDATE_EXPR_SUFFIX = "__updateExpr__";
 const std::string COUNT_COLUMN_NAME = "__count__group__";
 const std::string HAVING_AGGREGATE_SUFFIX = "__having__aggregate__";
-const std::string SUFFIX_SEPARATOR = "__";
\ No newline at end of file
+const std::string SUFFIX_SEPARATOR = "__";
+const std::string AGGREGATE_COUNT_SUFFIX = "__aggregate__count__";
+const std::string AGGREGATE_SUM_SUFFIX = "__aggregate__sum__";
\ No newline at end of file
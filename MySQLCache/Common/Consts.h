@@ -5,3 +5,5 @@ extern const std::string UPDATE_EXPR_SUFFIX;
 extern const std::string COUNT_COLUMN_NAME;
 extern const std::string HAVING_AGGREGATE_SUFFIX;
 extern const std::string SUFFIX_SEPARATOR;
+extern const std::string AGGREGATE_COUNT_SUFFIX;
+extern const std::string AGGREGATE_SUM_SUFFIX;
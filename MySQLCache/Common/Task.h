@@ -9,6 +9,7 @@
 #include "ByteArray.h"
 #include "Common.h"
 #include "WriteBuffer.h"
+#include <event2/util.h>
 
 enum class TaskType
 {
@@ -21,7 +22,8 @@ enum class TaskType
     ttUpdateCache = 6,
     ttPushBlock = 7,
     ttReset = 8,
-    ttFreeUpdateCacheTask = 9
+    ttFreeUpdateCacheTask = 9,
+    ttGroupWrite = 10
 };
 
 enum class UpdateOperation
@@ -50,6 +52,9 @@ struct SelectTaskData : public TaskData
 {
     ByteArray sqlBytes;
     WriteBuffer *buffer;
+    // uncacheable select result is written to client socket by chunks, -1 means whole result is replied
+    evutil_socket_t clientSocket = -1;
+    bool streamed = false;
 };
 
 struct WriteTaskData : public TaskData
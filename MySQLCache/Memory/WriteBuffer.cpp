@@ -52,6 +52,14 @@ void WriteBuffer::reset()
 	m_writePos = 0;
 }
 
+void WriteBuffer::truncate(uint32_t length)
+{
+	if (length < m_byteLength) {
+		m_byteLength = length;
+	}
+	m_writePos = m_byteLength;
+}
+
 void WriteBuffer::writeBoolean(bool value)
 {
 	prepare(1);
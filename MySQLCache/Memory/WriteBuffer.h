@@ -21,6 +21,8 @@ public:
 	int32_t writePos() const;
 	void seek(int32_t pos);
 	void reset();
+	// drop bytes from length
+	void truncate(uint32_t length);
 
 	void writeBoolean(bool value);
 	void writeByte(int8_t value);
@@ -6,6 +6,7 @@
 #include "SQLContext.h"
 #include "SQLTable.h"
 #include "MemoryTest.h"
+#include "TableTest.h"
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -182,7 +183,11 @@ int main(int argc, char *argv[])
 	}
 	CacheSetting setting(exePath() + "/Cache.ini");
 	m_server->startUp(&setting, readMode);
-	/*m_server->test();
+	/*TableTest::testLimitWindow();
+	TableTest::testJoinTables();
+	TableTest::testDistinctAggregate(SQLContext::instance());
+	TableTest::testPKBuckets(SQLContext::instance());
+	m_server->test();
 	m_server->shutDown();
 	return 0;*/
 #ifdef _WIN32
@@ -1,28 +1,108 @@
 #include "MySQLConnector.h"
 #include "SQLTable.h"
 #include "SQLConnectorException.h"
+#include "SQLConnectorFactory.h"
 #include <iostream>
 #include <sstream>
 #include <string>
 
 using namespace std;
 
+// client error codes: server has gone away, lost connection to server during query
+const int CR_SERVER_GONE_ERROR = 2006;
+const int CR_SERVER_LOST = 2013;
+
+MySQLResultReader::MySQLResultReader(sql::ResultSet *res) :
+	m_res(res)
+{
+	auto metaData = res->getMetaData();
+	int count = metaData->getColumnCount();
+	for (int i = 0; i < count; ++i) {
+		m_columns[metaData->getColumnLabel(i + 1)] = i;
+	}
+}
+
+int MySQLResultReader::columnIndex(const std::string &columnName) const
+{
+	auto i = m_columns.find(columnName);
+	if (i != m_columns.end()) {
+		return i->second;
+	}
+
+	return -1;
+}
+
+bool MySQLResultReader::isNull(int column)
+{
+	return m_res->isNull(column + 1);
+}
+
+bool MySQLResultReader::getBoolean(int column)
+{
+	return m_res->getBoolean(column + 1);
+}
+
+int32_t MySQLResultReader::getInt(int column)
+{
+	return m_res->getInt(column + 1);
+}
+
+int64_t MySQLResultReader::getInt64(int column)
+{
+	return m_res->getInt64(column + 1);
+}
+
+double MySQLResultReader::getDouble(int column)
+{
+	return (double)m_res->getDouble(column + 1);
+}
+
+std::string MySQLResultReader::getString(int column)
+{
+	return m_res->getString(column + 1);
+}
+
+ByteArray MySQLResultReader::getBlob(int column)
+{
+	std::unique_ptr<std::istream> is(m_res->getBlob(column + 1));
+	is->seekg(0, is->end);
+	int len = is->tellg();
+	is->seekg(0, is->beg);
+	ByteArray blobValue = ByteArray::from(len);
+	is->read((char*)(blobValue->data()), len);
+	return blobValue;
+}
+
 MySQLConnector::MySQLConnector() :
-	m_con(nullptr)
+	m_con(nullptr),
+	m_inTransaction(false),
+	m_autoIncrementStep(1),
+	m_stmtCacheSize(SQLConnectorFactory::statementCacheSize())
 {
 }
 
 MySQLConnector::~MySQLConnector()
 {
+	disconnect();
 }
 
 bool MySQLConnector::connect(const std::string &url, const std::string &user, const std::string &pwd,
 	const std::string &schema)
 {
+	m_url = url;
+	m_user = user;
+	m_pwd = pwd;
+	m_schema = schema;
+
 	sql::mysql::MySQL_Driver *driver = sql::mysql::get_driver_instance();
 	m_con = driver->connect(url, user, pwd);
 	if (m_con) {
 		m_con->setSchema(schema);
+		std::unique_ptr<sql::Statement> stmt(m_con->createStatement());
+		std::unique_ptr<sql::ResultSet> res(stmt->executeQuery("SELECT @@auto_increment_increment"));
+		if (res->next()) {
+			m_autoIncrementStep = res->getInt64(1);
+		}
 		return true;
 	}	
 
@@ -31,12 +111,37 @@ bool MySQLConnector::connect(const std::string &url, const std::string &user, co
 
 void MySQLConnector::disconnect()
 {
+	clearStatements();
 	if (m_con) {
 		delete m_con;
 		m_con = nullptr;
 	}
 }
 
+bool MySQLConnector::isValid()
+{
+	try {
+		return m_con && !m_con->isClosed() && m_con->isValid();
+	}
+	catch (sql::SQLException &) {
+		return false;
+	}
+}
+
+bool MySQLConnector::reconnect()
+{
+	m_inTransaction = false;
+	disconnect();
+	try {
+		return connect(m_url, m_user, m_pwd, m_schema);
+	}
+	catch (sql::SQLException &e) {
+		cerr << "Reconnect Error: " << e.what() << endl;
+	}
+
+	return false;
+}
+
 void MySQLConnector::buildAllTableSchemas(std::vector<SQLNormalTableSchema*>& tableSchemas)
 {
 	try {
@@ -69,238 +174,292 @@ void MySQLConnector::buildAllTableSchemas(std::vector<SQLNormalTableSchema*>& ta
 	}
 }
 
-std::vector<SQLRecord *> MySQLConnector::select(const std::string &sqlStr, 
-	MyVariants &params, std::vector<int8_t>& types, SQLTable *resultTable, bool directColumnName)
+uint32_t MySQLConnector::select(const std::string &sqlStr, MyVariants &params, 
+	std::vector<int8_t>& types, SQLTable *resultTable, bool directColumnName, 
+	const ReadRecordEvent &onRecord)
 {
-	vector<SQLRecord *> newRecords;
+	uint32_t count = 0;
 	try {
-		std::unique_ptr<sql::PreparedStatement> stmt(m_con->prepareStatement(sqlStr));
-		for (int i = 0; i < params.count(); ++i) {
-			setParam(stmt.get(), i + 1, params.variant(i), types[i]);
+		std::unique_ptr <sql::ResultSet> res;
+		try {
+			sql::PreparedStatement *stmt = prepare(sqlStr);
+			for (int i = 0; i < params.count(); ++i) {
+				setParam(stmt, i + 1, params.variant(i), types[i]);
+			}
+			res.reset(stmt->executeQuery());
 		}
-		std::unique_ptr <sql::ResultSet> res(stmt->executeQuery());
-		unordered_map<std::string, MyVariant> values;
-		while (res->next()) {
-			readSqlResult(res.get(), values);
-			SQLRecord *newRec = resultTable->newRecord();
-			newRec->read(values, directColumnName);
-			SQLRecord *realNewRec = resultTable->append(newRec);
-			if (realNewRec != newRec) {
-				delete newRec;
+		catch (sql::SQLException &e) {
+			// select is safe to execute again on new connection
+			if (!tryReconnect(e)) {
+				throw;
 			}
 
-			newRecords.push_back(realNewRec);
+			sql::PreparedStatement *stmt = prepare(sqlStr);
+			for (int i = 0; i < params.count(); ++i) {
+				setParam(stmt, i + 1, params.variant(i), types[i]);
+			}
+			res.reset(stmt->executeQuery());
+		}
+
+		// column of every field is resolved once, rows are read by column index
+		MySQLResultReader reader(res.get());
+		SQLResultBinding binding;
+		resultTable->bindColumns(reader, binding, directColumnName);
+		while (res->next()) {
+			SQLRecord *rec = resultTable->readRecord(reader, binding);
+			++count;
+			if (onRecord) {
+				onRecord(rec);
+			}
 		}
 	}
 	catch (sql::SQLException &e) {
+		// a failed read, e.g. deadlock of locking read, mustn't look like an empty result
 		cerr << "Select Error: " << sqlStr << ":" << e.what() << endl;
+		throw SQLConnectorException(e.what());
 	}
 
-	return newRecords;
+	return count;
 }
 
-void MySQLConnector::select(const std::string &sqlStr, WriteBuffer *buffer, 
-	MyVariants &params, std::vector<int8_t>& types)
+bool MySQLConnector::select(const std::string &sqlStr, WriteBuffer *buffer, 
+	MyVariants &params, std::vector<int8_t>& types, const FlushBufferEvent &flush)
 {
+	bool streamed = false;
+	uint32_t recordPos = 0;
+	// streamed rows are fetched from server while they are sent, others are counted first
+	sql::ResultSet::enum_type resultType = flush ? sql::ResultSet::TYPE_FORWARD_ONLY :
+		sql::ResultSet::TYPE_SCROLL_INSENSITIVE;
 	try {
-		std::unique_ptr<sql::PreparedStatement> stmt(m_con->prepareStatement(sqlStr));
-		for (int i = 0; i < params.count(); ++i) {
-			setParam(stmt.get(), i + 1, params.variant(i), types[i]);
+		std::unique_ptr <sql::ResultSet> res;
+		try {
+			sql::PreparedStatement *stmt = prepare(sqlStr);
+			stmt->setResultSetType(resultType);
+			for (int i = 0; i < params.count(); ++i) {
+				setParam(stmt, i + 1, params.variant(i), types[i]);
+			}
+			res.reset(stmt->executeQuery());
+		}
+		catch (sql::SQLException &e) {
+			if (!tryReconnect(e)) {
+				throw;
+			}
+
+			sql::PreparedStatement *stmt = prepare(sqlStr);
+			stmt->setResultSetType(resultType);
+			for (int i = 0; i < params.count(); ++i) {
+				setParam(stmt, i + 1, params.variant(i), types[i]);
+			}
+			res.reset(stmt->executeQuery());
 		}
-		std::unique_ptr <sql::ResultSet> res(stmt->executeQuery());
-		auto metaData = res->getMetaData();
-		std::vector<std::string> columnNames;
+
 		std::vector<DataType> dataTypes;
-		writeResultSchema(metaData, buffer, columnNames, dataTypes);
-		unordered_map<std::string, MyVariant> values;
+		writeResultSchema(res->getMetaData(), buffer, dataTypes);
+		// streamed records are ended by a mark, so that failure after a flush can still be told
+		streamed = (bool)flush;
+		buffer->writeInt(streamed ? STREAM_RECORD_COUNT : (int32_t)res->rowsCount());
+		recordPos = buffer->writePos();
+		MySQLResultReader reader(res.get());
 		while (res->next()) {
-			readSqlResult(res.get(), values);
-			writeRecord(values, buffer, columnNames, dataTypes);
+			if (streamed) {
+				buffer->writeBoolean(true);
+			}
+			writeRecord(reader, buffer, dataTypes);
+			if (streamed) {
+				flush(buffer);
+			}
+			recordPos = buffer->writePos();
 		}
 	}
 	catch (sql::SQLException &e) {
 		cerr << "Select Error: " << sqlStr << ":" << e.what() << endl;
+		if (streamed) {
+			// record failed in the middle isn't sent
+			buffer->truncate(recordPos);
+			buffer->writeBoolean(false);
+		}
+		return false;
 	}
+
+	if (streamed) {
+		buffer->writeBoolean(false);
+	}
+	return true;
 }
 
 int MySQLConnector::update(const std::string &sqlStr, MyVariants &params, 
 	std::vector<int8_t>& types)
 {
 	try {
-		std::unique_ptr<sql::PreparedStatement> stmt(m_con->prepareStatement(sqlStr));
+		sql::PreparedStatement *stmt = prepare(sqlStr);
 		for (int i = 0; i < params.count(); ++i) {
-			setParam(stmt.get(), i + 1, params.variant(i), types[i]);
+			setParam(stmt, i + 1, params.variant(i), types[i]);
 		}
 		int updateCount = stmt->executeUpdate();		
 		return updateCount;
 	}
 	catch (sql::SQLException &e) {
 		cerr << "Update Error: " << sqlStr << ":" << e.what() << endl;
+		// write is not executed again, it maybe has been done before connection lost
+		tryReconnect(e);
 		throw SQLConnectorException(e.what());
 	}
 }
 
 int64_t MySQLConnector::insert(const std::string &sqlStr, MyVariants &params, 
-	std::vector<int8_t>& types)
+	std::vector<int8_t>& types, bool generatedKey)
 {
 	int64_t newID = -1;
 	try {
-		std::unique_ptr<sql::PreparedStatement> stmt(m_con->prepareStatement(sqlStr));
+		sql::PreparedStatement *stmt = prepare(sqlStr);
 		for (int i = 0; i < params.count(); ++i) {
-			setParam(stmt.get(), i + 1, params.variant(i), types[i]);
+			setParam(stmt, i + 1, params.variant(i), types[i]);
 		}
 
 		stmt->executeUpdate();
-
-		std::unique_ptr<sql::Statement> stmt2(m_con->createStatement());
-		sql::ResultSet *res = stmt2->executeQuery("SELECT LAST_INSERT_ID() AS ID");
-		if (res->next()) {
-			newID = res->getInt64("ID");
+		if (generatedKey) {
+			// id of the first inserted record, the connector api doesn't expose it from OK packet
+			std::unique_ptr<sql::ResultSet> res(prepare("SELECT LAST_INSERT_ID()")->executeQuery());
+			if (res->next()) {
+				newID = res->getInt64(1);
+			}
 		}
 	}
 	catch (sql::SQLException &e) {
 		cerr << "Insert Error: " << sqlStr << ":" << e.what() << endl;
+		tryReconnect(e);
 		throw SQLConnectorException(e.what());
 	}
 	return newID;
 }
 
+int64_t MySQLConnector::autoIncrementStep() const
+{
+	return m_autoIncrementStep;
+}
+
 void MySQLConnector::startTransaction()
 {
-	m_con->setAutoCommit(false);
+	try {
+		m_con->setAutoCommit(false);
+		m_inTransaction = true;
+	}
+	catch (sql::SQLException &e) {
+		cerr << "Start Transaction Error: " << e.what() << endl;
+		tryReconnect(e);
+		throw SQLConnectorException(e.what());
+	}
 }
 
 void MySQLConnector::commit()
 {
-	m_con->commit();
-	m_con->setAutoCommit(true);
+	try {
+		m_con->commit();
+		m_con->setAutoCommit(true);
+		m_inTransaction = false;
+	}
+	catch (sql::SQLException &e) {
+		cerr << "Commit Error: " << e.what() << endl;
+		// session state is unknown, a new connection is used
+		reconnect();
+		throw SQLConnectorException(e.what());
+	}
 }
 
 void MySQLConnector::rollBack()
 {
-	m_con->rollback();
-	m_con->setAutoCommit(true);
+	try {
+		m_con->rollback();
+		m_con->setAutoCommit(true);
+		m_inTransaction = false;
+	}
+	catch (sql::SQLException &e) {
+		cerr << "Rollback Error: " << e.what() << endl;
+		reconnect();
+	}
 }
 
-void MySQLConnector::readSqlResult(sql::ResultSet* res, std::unordered_map<std::string, MyVariant>& values)
+bool MySQLConnector::inTransaction() const
 {
-	auto metaData = res->getMetaData();
-	int count = metaData->getColumnCount();
-	for (int i = 0; i < count; ++i) {
-		string name = metaData->getColumnLabel(i + 1);
-		if (res->isNull(name)) {
-			values[name] = nullptr;
-			continue;
-		}
-
-		DataType type = sqlTypeToDataType(metaData->getColumnType(i + 1));
-		switch (type)
-		{
-			case DataType::dtBoolean:
-			{
-				values[name] = res->getBoolean(name);
-				break;
-			}
-			case DataType::dtSmallInt:
-			case DataType::dtInt:
-			{
-				values[name] = res->getInt(name);
-				break;
-			}
-			case DataType::dtBigInt:
-			{
-				values[name] = res->getInt64(name);
-				break;
-			}
-			case DataType::dtFloat:
-			case DataType::dtDouble:
-			{
-				values[name] = (double)res->getDouble(name);
-				break;
-			}
-			case DataType::dtString:
-			{
-				values[name] = string(res->getString(name));
-				break;
-			}
-			case DataType::dtBlob:
-			{
-				std::unique_ptr<std::istream> is(res->getBlob(name));
-				is->seekg(0, is->end);
-				int len = is->tellg();
-				is->seekg(0, is->beg);
-				ByteArray blobValue = ByteArray::from(len);
-				is->read((char*)(blobValue->data()), len);
-				values[name] = blobValue;
-				break;
-			}
-			default:
-				break;
-			}
-	}
+	return m_inTransaction;
 }
 
 void MySQLConnector::writeResultSchema(sql::ResultSetMetaData *metaData, WriteBuffer *buffer,
-	std::vector<std::string> &columnNames, std::vector<DataType> &dataTypes)
+	std::vector<DataType> &dataTypes)
 {
 	buffer->writeByte((int8_t)TableKind::tkNormal);
-	buffer->writeString(metaData->getTableName(1));
 	int colCount = metaData->getColumnCount();
+	buffer->writeString(colCount > 0 ? metaData->getTableName(1) : "");
 	buffer->writeShort(colCount);
 	for (int i = 0; i < colCount; ++i) {
-		columnNames.push_back(metaData->getColumnName(i + 1));
-		buffer->writeString(columnNames[i]);
+		buffer->writeString(metaData->getColumnLabel(i + 1));
 		dataTypes.push_back(sqlTypeToDataType(metaData->getColumnType(i + 1)));
 		buffer->writeByte((int8_t)dataTypes[i]);
 		buffer->writeBoolean(true);
 		buffer->writeBoolean(false);
 		buffer->writeString("");
 	}
-
-	buffer->writeShort(0);
-	buffer->writeInt(0);
 }
 
-void MySQLConnector::writeRecord(std::unordered_map<std::string, MyVariant> &sqlResult, WriteBuffer* buffer,
-	const std::vector<std::string> &columnNames, const std::vector<DataType> &dataTypes)
+void MySQLConnector::writeRecord(MySQLResultReader &reader, WriteBuffer* buffer,
+	const std::vector<DataType> &dataTypes)
 {
-	for (int i = 0; i < dataTypes.size(); ++i) {
+	int count = (int)dataTypes.size();
+	if (count == 0) {
+		return;
+	}
+
+	// null bits first, value of null field is still written as default
+	std::vector<uint8_t> nullBits((count - 1) / 8 + 1, 0);
+	std::vector<bool> nulls(count);
+	for (int i = 0; i < count; ++i) {
+		nulls[i] = reader.isNull(i);
+		if (nulls[i]) {
+			nullBits[i / 8] |= (1 << (i % 8));
+		}
+	}
+	for (auto bits : nullBits) {
+		buffer->writeUByte(bits);
+	}
+
+	for (int i = 0; i < count; ++i) {
+		bool isNull = nulls[i];
 		switch (dataTypes[i])
 		{
 		case DataType::dtBoolean:
 		{
-			buffer->writeBoolean(sqlResult[columnNames[i]].toBool());
+			buffer->writeBoolean(isNull ? false : reader.getBoolean(i));
 			break;
 		}
 		case DataType::dtSmallInt:
 		{
-			buffer->writeShort(sqlResult[columnNames[i]].toInt());
+			buffer->writeShort(isNull ? 0 : reader.getInt(i));
 			break;
 		}
 		case DataType::dtInt:
 		{
-			buffer->writeInt(sqlResult[columnNames[i]].toInt());
+			buffer->writeInt(isNull ? 0 : reader.getInt(i));
 			break;
 		}
 		case DataType::dtBigInt:
 		{
-			buffer->writeLong(sqlResult[columnNames[i]].toInt64());
+			buffer->writeLong(isNull ? 0 : reader.getInt64(i));
 			break;
 		}
 		case DataType::dtFloat:
 		case DataType::dtDouble:
 		{
-			buffer->writeDouble(sqlResult[columnNames[i]].toDouble());
+			buffer->writeDouble(isNull ? 0 : reader.getDouble(i));
 			break;
 		}
 		case DataType::dtString:
 		{
-			buffer->writeString(sqlResult[columnNames[i]].toString());
+			buffer->writeString(isNull ? string() : reader.getString(i));
 			break;
 		}
 		case DataType::dtBlob:
 		{
-			buffer->writeBlock(sqlResult[columnNames[i]].toBlob());
+			buffer->writeBlock(isNull ? ByteArray::from(0) : reader.getBlob(i));
 			break;
 		}
 		default:
@@ -416,3 +575,47 @@ void MySQLConnector::setParam(sql::PreparedStatement *stmt, int index, const MyV
 			break;
 	}
 }
+
+sql::PreparedStatement *MySQLConnector::prepare(const std::string &sqlStr)
+{
+	auto i = m_stmtHash.find(sqlStr);
+	if (i != m_stmtHash.end()) {
+		// move to front, the last one is the least recently used
+		m_stmts.splice(m_stmts.begin(), m_stmts, i->second);
+		return i->second->second;
+	}
+
+	sql::PreparedStatement *stmt = m_con->prepareStatement(sqlStr);
+	m_stmts.emplace_front(sqlStr, stmt);
+	m_stmtHash[sqlStr] = m_stmts.begin();
+	// the current statement is kept even if cache size is 0
+	while (m_stmts.size() > m_stmtCacheSize && m_stmts.size() > 1) {
+		auto &last = m_stmts.back();
+		m_stmtHash.erase(last.first);
+		delete last.second;
+		m_stmts.pop_back();
+	}
+
+	return stmt;
+}
+
+void MySQLConnector::clearStatements()
+{
+	FOR_EACH(i, m_stmts) {
+		delete i->second;
+	}
+
+	m_stmts.clear();
+	m_stmtHash.clear();
+}
+
+bool MySQLConnector::tryReconnect(const sql::SQLException &e)
+{
+	// a lost transaction can't be continued on new connection
+	if (m_inTransaction || 
+		(e.getErrorCode() != CR_SERVER_GONE_ERROR && e.getErrorCode() != CR_SERVER_LOST)) {
+		return false;
+	}
+
+	return reconnect();
+}
@@ -1,47 +1,92 @@
 #pragma once
 #include "SQLConnector.h"
+#include "SQLResultReader.h"
 #include "DataType.h"
 #include "Common.h"
 #include <memory>
+#include <list>
 #include <mysql/jdbc.h>
 
+class MySQLResultReader : public SQLResultReader
+{
+public:
+	MySQLResultReader(sql::ResultSet *res);
+
+	int columnIndex(const std::string &columnName) const override;
+
+	bool isNull(int column) override;
+	bool getBoolean(int column) override;
+	int32_t getInt(int column) override;
+	int64_t getInt64(int column) override;
+	double getDouble(int column) override;
+	std::string getString(int column) override;
+	ByteArray getBlob(int column) override;
+
+private:
+	sql::ResultSet *m_res;
+	std::unordered_map<std::string, int> m_columns;
+};
+
 class MySQLConnector : public SQLConnector
 {
+public:
+	typedef std::list<std::pair<std::string, sql::PreparedStatement *>> StatementList;
+	typedef std::unordered_map<std::string, StatementList::iterator> StatementHash;
+
 public:
 	MySQLConnector();
-	~MySQLConnector();
+	~MySQLConnector() override;
 
 	bool connect(const std::string &url, const std::string &user, const std::string &pwd,
 		const std::string &schema) override;
 	void disconnect() override;
+	bool isValid() override;
+	bool reconnect() override;
 	void buildAllTableSchemas(std::vector<SQLNormalTableSchema*>& tableSchemas) override;
 	// directColumnName=true indicate column name in sql statement is same as field name in resultTable
-	std::vector<SQLRecord *> select(const std::string &sqlStr, MyVariants &params,
+	uint32_t select(const std::string &sqlStr, MyVariants &params,
 		std::vector<int8_t>& types, SQLTable *resultTable,
-		bool directColumnName = false) override;
-	void select(const std::string &sqlStr, WriteBuffer* buffer, MyVariants &params, 
-		std::vector<int8_t>& types) override;
+		bool directColumnName = false, const ReadRecordEvent &onRecord = nullptr) override;
+	bool select(const std::string &sqlStr, WriteBuffer* buffer, MyVariants &params, 
+		std::vector<int8_t>& types, const FlushBufferEvent &flush = nullptr) override;
 
 	int update(const std::string &sqlStr, MyVariants &params, 
 		std::vector<int8_t>& types) override;
 	int64_t insert(const std::string &sqlStr, MyVariants& params,
-		std::vector<int8_t> &types) override;
+		std::vector<int8_t> &types, bool generatedKey = true) override;
+	int64_t autoIncrementStep() const override;
 
 	void startTransaction() override;
 	void commit() override;
 	void rollBack() override;
+	bool inTransaction() const override;
 
 private:
-	void readSqlResult(sql::ResultSet *res, std::unordered_map<std::string, MyVariant>& values);
 	void writeResultSchema(sql::ResultSetMetaData *metaData, WriteBuffer* buffer,
-		std::vector<std::string> &columnNames, std::vector<DataType> &dataTypes);
-	void writeRecord(std::unordered_map<std::string, MyVariant>& sqlResult, WriteBuffer* buffer,
-		const std::vector<std::string> &columnNames, const std::vector<DataType> &dataTypes);
+		std::vector<DataType> &dataTypes);
+	void writeRecord(MySQLResultReader &reader, WriteBuffer* buffer,
+		const std::vector<DataType> &dataTypes);
 	DataType sqlTypeToDataType(int type);
 	DataType sqlTypeToDataType(const std::string &typeStr);
 	int dataTypeToSqlType(ParamDataType value);
 	void setParam(sql::PreparedStatement *stmt, int index, const MyVariant& param, uint8_t type);
 
+	// statement is cached by sql text, the least recently used one is closed when cache is full
+	sql::PreparedStatement *prepare(const std::string &sqlStr);
+	void clearStatements();
+	// reconnect if connection is lost, all cached statements are prepared again later
+	bool tryReconnect(const sql::SQLException &e);
+
 private:
 	sql::Connection *m_con;
+	std::string m_url;
+	std::string m_user;
+	std::string m_pwd;
+	std::string m_schema;
+	bool m_inTransaction;
+	int64_t m_autoIncrementStep;
+
+	StatementList m_stmts;
+	StatementHash m_stmtHash;
+	uint32_t m_stmtCacheSize;
 };
@@ -5,31 +5,52 @@
 #include <vector>
 #include <string>
 #include <unordered_map>
+#include <functional>
 
 class SQLTable;
 class SQLRecord;
 class SQLNormalTableSchema;
 
+// called after every record of direct select is written, receiver may send and reset buffer.
+// with it, record count is STREAM_RECORD_COUNT, every record follows a true and the last one a false
+typedef std::function<void(WriteBuffer *)> FlushBufferEvent;
+// called with every record read into result table, record is only valid in the call
+typedef std::function<void(SQLRecord *)> ReadRecordEvent;
+
+const int32_t STREAM_RECORD_COUNT = -1;
+
 class SQLConnector
 {
 public:
+	// connectors are freed through this class by pool
+	virtual ~SQLConnector() {}
+
 	virtual bool connect(const std::string &url, const std::string &user, const std::string &pwd,
 		const std::string &schema) = 0;
 	virtual void disconnect() = 0;
+	// connection is still alive
+	virtual bool isValid() = 0;
+	virtual bool reconnect() = 0;
 	virtual void buildAllTableSchemas(std::vector<SQLNormalTableSchema*>& tableSchemas) = 0;
-	// directColumnName indicate : sql'column name is same as resultTable
-	virtual std::vector<SQLRecord *> select(const std::string &sqlStr, 
+	// directColumnName indicate : sql'column name is same as resultTable, return count of rows read,
+	// throw SQLConnectorException if sql fails
+	virtual uint32_t select(const std::string &sqlStr, 
 		MyVariants &params, std::vector<int8_t>& types, SQLTable *resultTable,
-		bool directColumnName = false) = 0;
-	virtual void select(const std::string &sqlStr, WriteBuffer *buffer, 
-		MyVariants &params, std::vector<int8_t>& types) = 0;
+		bool directColumnName = false, const ReadRecordEvent &onRecord = nullptr) = 0;
+	// return false if sql fails, records written before are kept
+	virtual bool select(const std::string &sqlStr, WriteBuffer *buffer, 
+		MyVariants &params, std::vector<int8_t>& types, const FlushBufferEvent &flush = nullptr) = 0;
 
 	virtual int update(const std::string &sqlStr, MyVariants &params, 
 		std::vector<int8_t>& types) = 0;
+	// return first generated id of inserted records if generatedKey is true, otherwise -1
 	virtual int64_t insert(const std::string &sqlStr, MyVariants &params, 
-		std::vector<int8_t>& types) = 0;
+		std::vector<int8_t>& types, bool generatedKey = true) = 0;
+	// generated ids of one multi-row insert are consecutive by this step
+	virtual int64_t autoIncrementStep() const = 0;
 
 	virtual void startTransaction() = 0;
 	virtual void commit() = 0;
 	virtual void rollBack() = 0;
+	virtual bool inTransaction() const = 0;
 };
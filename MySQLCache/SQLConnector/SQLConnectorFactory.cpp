@@ -1,6 +1,11 @@
 #include "SQLConnectorFactory.h"
 #include "MySQLConnector.h"
 
+uint32_t g_statementCacheSize = 256;
+uint32_t g_connectionPoolSize = 0;
+uint32_t g_connectionIdleTime = 60;
+uint32_t g_connectionCheckTime = 30;
+
 SQLConnector *SQLConnectorFactory::createConnector(const std::string &type)
 {
 	if (type == "mysql") {
@@ -9,3 +14,46 @@ SQLConnector *SQLConnectorFactory::createConnector(const std::string &type)
 
 	return nullptr;
 }
+
+uint32_t SQLConnectorFactory::statementCacheSize()
+{
+	return g_statementCacheSize;
+}
+
+uint32_t SQLConnectorFactory::connectionPoolSize()
+{
+	return g_connectionPoolSize;
+}
+
+uint32_t SQLConnectorFactory::connectionIdleTime()
+{
+	return g_connectionIdleTime;
+}
+
+uint32_t SQLConnectorFactory::connectionCheckTime()
+{
+	return g_connectionCheckTime;
+}
+
+void initSQLConnectors(CacheSetting *setting)
+{
+	MyVariant value = setting->read(STATEMENT_CACHE_SIZE);
+	if (!value.isNull()) {
+		g_statementCacheSize = value.toUInt();
+	}
+
+	value = setting->read(CONNECTION_POOL_SIZE);
+	if (!value.isNull()) {
+		g_connectionPoolSize = value.toUInt();
+	}
+
+	value = setting->read(CONNECTION_IDLE_TIME);
+	if (!value.isNull()) {
+		g_connectionIdleTime = value.toUInt();
+	}
+
+	value = setting->read(CONNECTION_CHECK_TIME);
+	if (!value.isNull()) {
+		g_connectionCheckTime = value.toUInt();
+	}
+}
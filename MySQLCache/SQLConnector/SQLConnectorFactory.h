@@ -1,9 +1,19 @@
 #pragma once
 #include "SQLConnector.h"
+#include "CacheSetting.h"
 #include <string>
 
+void initSQLConnectors(CacheSetting *setting);
+
 class SQLConnectorFactory
 {
 public:
 	static SQLConnector *createConnector(const std::string &type);
+
+	static uint32_t statementCacheSize();
+	// 0 means same as worker thread count
+	static uint32_t connectionPoolSize();
+	// seconds
+	static uint32_t connectionIdleTime();
+	static uint32_t connectionCheckTime();
 };
@@ -0,0 +1,173 @@
+#include "SQLConnectorPool.h"
+#include "SQLConnectorFactory.h"
+#include "SQLConnectorException.h"
+#include "Common.h"
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+const uint32_t MAX_CONNECT_RETRY_COUNT = 3; // failed connects of one borrow before it gives up
+const int32_t CONNECT_RETRY_INTERVAL = 100; // millisecond, grows with every failed connect
+
+SQLConnectorPool::SQLConnectorPool(const std::string &sqlType, uint32_t maxSize) :
+	m_sqlType(sqlType),
+	m_maxSize(maxSize > 0 ? maxSize : 1),
+	m_count(0)
+{
+}
+
+SQLConnectorPool::~SQLConnectorPool()
+{
+	disconnect();
+}
+
+bool SQLConnectorPool::connect(const std::string &url, const std::string &user,
+	const std::string &pwd, const std::string &schema, uint32_t initCount)
+{
+	m_url = url;
+	m_user = user;
+	m_pwd = pwd;
+	m_schema = schema;
+
+	initCount = std::max(1u, std::min(initCount, m_maxSize));
+	for (uint32_t i = 0; i < initCount; ++i) {
+		SQLConnector *connector = createConnector();
+		if (!connector) {
+			return false;
+		}
+
+		lock_guard<mutex> locker(m_lock);
+		++m_count;
+		m_idles.push_back({ connector, chrono::steady_clock::now() });
+	}
+
+	return true;
+}
+
+void SQLConnectorPool::disconnect()
+{
+	lock_guard<mutex> locker(m_lock);
+	// connection and statements are released by destructor of connector
+	FOR_EACH(i, m_idles) {
+		delete i->connector;
+	}
+	m_count -= m_idles.size();
+	m_idles.clear();
+}
+
+SQLConnector *SQLConnectorPool::borrow()
+{
+	uint32_t failCount = 0;
+	while (true) {
+		unique_lock<mutex> lk(m_lock);
+		if (!m_idles.empty()) {
+			IdleConnector idle = m_idles.back();
+			m_idles.pop_back();
+			lk.unlock();
+
+			if (checkConnector(idle.connector, idle.idleTime)) {
+				return idle.connector;
+			}
+
+			// connection is lost and can't be recovered, a new one is tried in next loop
+			delete idle.connector;
+			lk.lock();
+			--m_count;
+			m_cond.notify_one();
+			continue;
+		}
+
+		if (m_count < m_maxSize) {
+			++m_count;
+			lk.unlock();
+			SQLConnector *connector = createConnector();
+			if (connector) {
+				return connector;
+			}
+
+			lk.lock();
+			--m_count;
+			if (m_count == 0 || ++failCount >= MAX_CONNECT_RETRY_COUNT) {
+				throw SQLConnectorException("no sql connection is available");
+			}
+
+			// backend may be down, a given back connector is taken, or connect again after a while
+			m_cond.wait_for(lk, chrono::milliseconds(CONNECT_RETRY_INTERVAL * failCount), [this] {
+				return !m_idles.empty();
+			});
+			continue;
+		}
+
+		m_cond.wait(lk, [this] {
+			return !m_idles.empty() || m_count < m_maxSize;
+		});
+	}
+}
+
+void SQLConnectorPool::giveBack(SQLConnector *connector)
+{
+	vector<SQLConnector *> evicted;
+	{
+		lock_guard<mutex> locker(m_lock);
+		m_idles.push_back({ connector, chrono::steady_clock::now() });
+		trimIdleConnectors(evicted);
+	}
+	m_cond.notify_one();
+
+	// closing connections needn't hold the lock
+	FOR_EACH(i, evicted) {
+		delete *i;
+	}
+}
+
+uint32_t SQLConnectorPool::maxSize() const
+{
+	return m_maxSize;
+}
+
+SQLConnector *SQLConnectorPool::createConnector()
+{
+	SQLConnector *connector = SQLConnectorFactory::createConnector(m_sqlType);
+	if (!connector) {
+		return nullptr;
+	}
+
+	bool connected = false;
+	try {
+		connected = connector->connect(m_url, m_user, m_pwd, m_schema);
+	}
+	catch (std::exception &e) {
+		cerr << "Connect Error: " << e.what() << endl;
+	}
+
+	if (!connected) {
+		delete connector;
+		return nullptr;
+	}
+	return connector;
+}
+
+bool SQLConnectorPool::checkConnector(SQLConnector *connector,
+	std::chrono::steady_clock::time_point idleTime)
+{
+	// connector used recently is regarded as alive
+	auto checkTime = chrono::seconds(SQLConnectorFactory::connectionCheckTime());
+	if (chrono::steady_clock::now() - idleTime < checkTime || connector->isValid()) {
+		return true;
+	}
+
+	return connector->reconnect();
+}
+
+void SQLConnectorPool::trimIdleConnectors(std::vector<SQLConnector *> &evicted)
+{
+	// the last idle connector is kept, so the next task needn't connect again
+	auto now = chrono::steady_clock::now();
+	auto idleTime = chrono::seconds(SQLConnectorFactory::connectionIdleTime());
+	while (m_idles.size() > 1 && now - m_idles.front().idleTime > idleTime) {
+		evicted.push_back(m_idles.front().connector);
+		m_idles.pop_front();
+		--m_count;
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "SQLConnector.h"
+#include <string>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+// backend connections shared by all worker threads, a connector is borrowed for one task
+class SQLConnectorPool
+{
+public:
+	SQLConnectorPool(const std::string &sqlType, uint32_t maxSize);
+	~SQLConnectorPool();
+
+	// initCount connectors are created at once, others are created when needed
+	bool connect(const std::string &url, const std::string &user, const std::string &pwd,
+		const std::string &schema, uint32_t initCount);
+	void disconnect();
+
+	// wait if all connectors are in use, throw SQLConnectorException if none can be created
+	// after a few tries
+	SQLConnector *borrow();
+	void giveBack(SQLConnector *connector);
+
+	uint32_t maxSize() const;
+
+private:
+	struct IdleConnector
+	{
+		SQLConnector *connector;
+		std::chrono::steady_clock::time_point idleTime;
+	};
+
+	SQLConnector *createConnector();
+	bool checkConnector(SQLConnector *connector, std::chrono::steady_clock::time_point idleTime);
+	// connectors idle too long are moved to evicted, caller frees them without lock
+	void trimIdleConnectors(std::vector<SQLConnector *> &evicted);
+
+private:
+	std::string m_sqlType;
+	std::string m_url;
+	std::string m_user;
+	std::string m_pwd;
+	std::string m_schema;
+	uint32_t m_maxSize;
+	// connectors created, including borrowed ones
+	uint32_t m_count;
+	// back is the most recently returned, front ones are trimmed when idle too long
+	std::deque<IdleConnector> m_idles;
+	std::mutex m_lock;
+	std::condition_variable m_cond;
+};
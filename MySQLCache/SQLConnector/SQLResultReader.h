@@ -0,0 +1,43 @@
+#pragma once
+
+#include "ByteArray.h"
+#include "DataType.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// current row of sql result, column index starts from 0
+class SQLResultReader
+{
+public:
+	virtual ~SQLResultReader() {}
+
+	// -1 if column doesn't exist in result
+	virtual int columnIndex(const std::string &columnName) const = 0;
+
+	virtual bool isNull(int column) = 0;
+	virtual bool getBoolean(int column) = 0;
+	virtual int32_t getInt(int column) = 0;
+	virtual int64_t getInt64(int column) = 0;
+	virtual double getDouble(int column) = 0;
+	virtual std::string getString(int column) = 0;
+	virtual ByteArray getBlob(int column) = 0;
+};
+
+// one field of result table, read from column(-1 means null value)
+struct FieldBinding
+{
+	int column;
+	int fieldIndex;
+	uint32_t offset;
+	DataType dataType;
+};
+
+// resolved once per result set, then every row is read by column index
+struct SQLResultBinding
+{
+	std::vector<FieldBinding> fields;
+	int pkColumn = -1;
+	// join table: left and right table binding
+	std::vector<SQLResultBinding> children;
+};
@@ -12,6 +12,14 @@ const std::string ALL_COLUMN_WORD = "*";
 
 const char *INVALID_SQL_SYNTAX = "Can't cache SQL syntax";
 const char *UNSUPPORTED_JOIN_TYPE = "Not Support Join Type";
+const char *UNSUPPORTED_AGGREGATE = "Can't cache aggregate function";
+
+// aggregates are maintained by every record applied to group, so DISTINCT ones can't be.
+// COUNT(*) and COUNT(DISTINCT a, b) have no single field argument either
+static bool isCacheableAggregate(MySqlParser::AggregateWindowedFunctionContext *f)
+{
+	return f && f->functionArg() && !(f->aggregator && f->aggregator->getType() == MySqlParser::DISTINCT);
+}
 
 MyVariant getFieldValue(const std::string &valueStr, DataType dataType) 
 {
@@ -63,12 +71,22 @@ MyVariant getFieldValue(const std::string &valueStr, DataType dataType)
 }
 
 MySQLSelectExprListener::MySQLSelectExprListener(SQLContext *context, const std::string &sql) :
-	MySQLExprListener(context)
+	MySQLExprListener(context),
+	m_filter(nullptr),
+	m_sql(sql),
+	m_limitCount(-1),
+	m_limitOffset(0),
+	m_limitStart(0),
+	m_limitEnd(0),
+	m_havingParamId(-1),
+	m_havingStart(0),
+	m_havingEnd(0)
 {
 }
 
 MySQLSelectExprListener::~MySQLSelectExprListener()
 {
+	delete m_filter;
 }
 
 void MySQLSelectExprListener::enterAtomTableItem(MySqlParser::AtomTableItemContext *ctx)
@@ -116,12 +134,8 @@ void MySQLSelectExprListener::enterFromClause(MySqlParser::FromClauseContext *ct
 
 void MySQLSelectExprListener::enterLogicalExpression(MySqlParser::LogicalExpressionContext *ctx)
 {
-	if (m_parseState == SQLParseState::spsFromClause && !m_where) {
-		std::string ttt = ctx->getText();
-		m_where = std::shared_ptr<Condition>(parseLogicalExpressionContext(ctx));
-		if (!m_where) {
-			throw SQLParseException("WHERE clause is not cacheable");
-		}
+	if (m_parseState == SQLParseState::spsFromClause && isFilterExpression(ctx)) {
+		addFilter(parseLogicalExpressionContext(ctx));
 	}
 	else if (m_parseState == SQLParseState::spsHaving && !m_having) {
 		m_having = std::shared_ptr<Condition>(parseLogicalExpressionContext(ctx));
@@ -133,11 +147,8 @@ void MySQLSelectExprListener::enterLogicalExpression(MySqlParser::LogicalExpress
 
 void MySQLSelectExprListener::enterPredicateExpression(MySqlParser::PredicateExpressionContext *ctx)
 {
-	if (m_parseState == SQLParseState::spsFromClause && !m_where) {
-		m_where = std::shared_ptr<Condition>(parsePredicateExpressionContext(ctx));
-		if (!m_where) {
-			throw SQLParseException("WHERE clause is not cacheable");
-		}
+	if (m_parseState == SQLParseState::spsFromClause && isFilterExpression(ctx)) {
+		addFilter(parsePredicateExpressionContext(ctx));
 	}
 	else if (m_parseState == SQLParseState::spsHaving && !m_having) {
 		m_having = std::shared_ptr<Condition>(parsePredicateExpressionContext(ctx));
@@ -215,12 +226,28 @@ void MySQLSelectExprListener::enterGroupByItem(MySqlParser::GroupByItemContext *
 void MySQLSelectExprListener::enterHavingClause(MySqlParser::HavingClauseContext *ctx)
 {
 	m_parseState = SQLParseState::spsHaving;
+	m_havingParamId = m_paramId;
+	m_havingStart = sqlPosition(ctx->getStart()->getStartIndex());
+	m_havingEnd = sqlPosition(ctx->getStop()->getStopIndex()) + 1;
+}
+
+void MySQLSelectExprListener::enterLimitClause(MySqlParser::LimitClauseContext *ctx)
+{
+	m_limitCount = parseLimitClauseAtom(ctx->limit);
+	if (ctx->offset) {
+		m_limitOffset = parseLimitClauseAtom(ctx->offset);
+	}
+
+	m_limitStart = sqlPosition(ctx->getStart()->getStartIndex());
+	m_limitEnd = sqlPosition(ctx->getStop()->getStopIndex()) + 1;
 }
 
 void MySQLSelectExprListener::enterSqlStatement(MySqlParser::SqlStatementContext *)
 {
 	m_paramId = 0;
 	m_where = nullptr;
+	delete m_filter;
+	m_filter = nullptr;
 	m_having = nullptr;
 	m_parseState = SQLParseState::spsInit;
 	m_joinType = SQLJoinType::sjtNull;
@@ -230,11 +257,41 @@ void MySQLSelectExprListener::exitSqlStatement(MySqlParser::SqlStatementContext
 {
 	parseSelectColumns();
 	parseAggregateColumns();
+	if (m_filter) {
+		m_where = std::shared_ptr<Condition>(m_filter);
+		m_filter = nullptr;
+	}
+
 	if (m_tableSchemas.size() > 1) {
 		m_joinType = SQLJoinType::sjtInner;
 	}
 }
 
+bool MySQLSelectExprListener::isFilterExpression(antlr4::ParserRuleContext *ctx)
+{
+	// expression of WHERE or ON of join, others are parts of them
+	return dynamic_cast<MySqlParser::FromClauseContext *>(ctx->parent) != nullptr ||
+		dynamic_cast<MySqlParser::InnerJoinContext *>(ctx->parent) != nullptr;
+}
+
+void MySQLSelectExprListener::addFilter(Condition *condition)
+{
+	if (!condition) {
+		throw SQLParseException("WHERE clause is not cacheable");
+	}
+
+	if (!m_filter) {
+		m_filter = condition;
+		return;
+	}
+
+	// ON of joins and WHERE all filter joined records
+	BinaryCondition *result = new BinaryCondition("AND");
+	result->setLeft(m_filter);
+	result->setRight(condition);
+	m_filter = result;
+}
+
 void MySQLSelectExprListener::visitErrorNode(antlr4::tree::ErrorNode *e)
 {
 	throw SQLParseException(e->getText().c_str());
@@ -403,6 +460,10 @@ Condition *MySQLSelectExprListener::buildBinaryCompareCondition(
 	const std::string &op)
 {
 	auto f = left->aggregateWindowedFunction();
+	if (!isCacheableAggregate(f)) {
+		std::cerr << UNSUPPORTED_AGGREGATE << " : " << left->getText() << std::endl;
+		return nullptr;
+	}
 	AggregateFunction leftFunc = functionOf(f->children[0]->getText());
 	std::string leftFieldName = f->functionArg()->getText();
 	FieldSchema *leftField = findField(leftFieldName);
@@ -414,6 +475,10 @@ Condition *MySQLSelectExprListener::buildBinaryCompareCondition(
 	if (isAggregateColumn(right)) {
 		f = static_cast<MySqlParser::AggregateFunctionCallContext *>(
 			right->children[0]->children[0])->aggregateWindowedFunction();
+		if (!isCacheableAggregate(f)) {
+			std::cerr << UNSUPPORTED_AGGREGATE << " : " << right->getText() << std::endl;
+			return nullptr;
+		}
 		AggregateFunction rightFunc = functionOf(f->children[0]->getText());
 		std::string rightFieldName = f->functionArg()->getText();
 		FieldSchema *rightField = findField(rightFieldName);
@@ -542,6 +607,9 @@ void MySQLSelectExprListener::parseSelectFunctionContext(MySqlParser::SelectFunc
 	auto funcCtx = ctx->getRuleContext<MySqlParser::AggregateFunctionCallContext>(0);
 	if (funcCtx) {
 		auto f = funcCtx->aggregateWindowedFunction();
+		if (!isCacheableAggregate(f)) {
+			throw SQLParseException(UNSUPPORTED_AGGREGATE);
+		}
 		std::string funcName = f->children[0]->getText();
 		std::string columnName = f->functionArg()->getText();
 		m_aggregateInfoStrs.push_back(std::make_tuple(funcName, columnName, 
@@ -576,6 +644,33 @@ FieldSchema *MySQLSelectExprListener::findField(const std::string &name)
 	return nullptr;
 }
 
+int32_t MySQLSelectExprListener::parseLimitClauseAtom(MySqlParser::LimitClauseAtomContext *ctx)
+{
+	// window of cached table is fixed, so LIMIT must be a number instead of param
+	if (!ctx || !ctx->decimalLiteral()) {
+		throw SQLParseException("LIMIT is not cacheable");
+	}
+
+	return atoi(ctx->getText().c_str());
+}
+
+size_t MySQLSelectExprListener::sqlPosition(size_t inputPosition) const
+{
+	size_t inputPos = 0;
+	size_t pos = 0;
+	while (pos < m_sql.size() && inputPos < inputPosition) {
+		// ? is quoted as '?' in antlr input
+		inputPos += m_sql[pos] == '?' ? 3 : 1;
+		++pos;
+		// antlr input is indexed by code points, skip the rest bytes of utf-8 character
+		while (pos < m_sql.size() && (static_cast<uint8_t>(m_sql[pos]) & 0xC0) == 0x80) {
+			++pos;
+		}
+	}
+
+	return pos;
+}
+
 void MySQLSelectExprListener::dfs_condition(Condition *cond, const ConditionIteration &iteration)
 {
 	if (cond->kind() == ConditionKind::ckBinary) {
@@ -677,6 +772,36 @@ const AggregateFieldInfo &MySQLSelectExprListener::aggregateField(int index) con
 	return m_aggregateFieldInfo.at(index);
 }
 
+int32_t MySQLSelectExprListener::limitCount() const
+{
+	return m_limitCount;
+}
+
+int32_t MySQLSelectExprListener::limitOffset() const
+{
+	return m_limitOffset;
+}
+
+std::string MySQLSelectExprListener::sqlWithLimit(int32_t count) const
+{
+	return StrUtils::join(m_sql.substr(0, m_limitStart), "LIMIT ", std::to_string(count),
+		m_sql.substr(m_limitEnd));
+}
+
+int32_t MySQLSelectExprListener::havingParamId() const
+{
+	return m_havingParamId;
+}
+
+std::string MySQLSelectExprListener::sqlWithoutHaving() const
+{
+	if (m_havingParamId < 0) {
+		return m_sql;
+	}
+
+	return StrUtils::join(m_sql.substr(0, m_havingStart), m_sql.substr(m_havingEnd));
+}
+
 MySQLUpdateExprListener::MySQLUpdateExprListener(SQLContext *context) :
 	MySQLExprListener(context),
 	m_tableSchema(nullptr)
@@ -54,6 +54,16 @@ public:
 	int aggregateFieldCount();
 	const AggregateFieldInfo &aggregateField(int index) const;
 
+	// count < 0 if sql has no LIMIT
+	int32_t limitCount() const;
+	int32_t limitOffset() const;
+	// sql with its LIMIT clause replaced by "LIMIT count"
+	std::string sqlWithLimit(int32_t count) const;
+
+	// id of first param in HAVING clause, < 0 if sql has no HAVING
+	int32_t havingParamId() const;
+	std::string sqlWithoutHaving() const;
+
 	template <typename IterationFunc>
 	void forEachCondition(std::shared_ptr<Condition> conditionObj, const IterationFunc &iteration);
 	void forEachCondition(std::shared_ptr<Condition> conditionObj, const ConditionIteration &iteration);
@@ -87,6 +97,8 @@ public:
 
 	void enterHavingClause(MySqlParser::HavingClauseContext * /*ctx*/) override;
 
+	void enterLimitClause(MySqlParser::LimitClauseContext * /*ctx*/) override;
+
 	void enterSqlStatement(MySqlParser::SqlStatementContext * /*ctx*/) override;
 	void exitSqlStatement(MySqlParser::SqlStatementContext * /*ctx*/) override;
 
@@ -120,8 +132,16 @@ private:
 
 	FieldSchema *findField(const std::string &name);
 
+	int32_t parseLimitClauseAtom(MySqlParser::LimitClauseAtomContext *ctx);
+	// byte position in sql of code point position in antlr input, whose ? are quoted
+	size_t sqlPosition(size_t inputPosition) const;
+
 	void dfs_condition(Condition *cond, const ConditionIteration &iteration);
 
+	bool isFilterExpression(antlr4::ParserRuleContext *ctx);
+	// AND condition of WHERE or ON to filter
+	void addFilter(Condition *condition);
+
 private:
 	std::vector<FieldSchema *> m_selectFields;
 	std::vector<OrderFieldInfo> m_orderByFields;
@@ -132,7 +152,18 @@ private:
 	std::vector<std::tuple<std::string, std::string, std::string> > m_aggregateInfoStrs;
 
 	std::shared_ptr<Condition> m_where;
+	// conditions of WHERE and ON while parsing, it's m_where at last
+	Condition *m_filter;
 	std::shared_ptr<Condition> m_having;
+	std::string m_sql;
+	int32_t m_limitCount;
+	int32_t m_limitOffset;
+	// LIMIT clause in m_sql, [m_limitStart, m_limitEnd)
+	size_t m_limitStart;
+	size_t m_limitEnd;
+	int32_t m_havingParamId;
+	size_t m_havingStart;
+	size_t m_havingEnd;
 	int32_t m_paramId;
 	SQLParseState m_parseState;
 	SQLJoinType m_joinType;
@@ -0,0 +1,105 @@
+#include "PKDictionary.h"
+#include "Common.h"
+
+using namespace std;
+
+int g_dictionarySize = getCPUCount();
+PKDictionary *g_dictionaries = new PKDictionary[g_dictionarySize];
+
+class DictionaryGarbager
+{
+public:
+	~DictionaryGarbager() {
+		delete[] g_dictionaries;
+	}
+};
+
+DictionaryGarbager g_dictionaryGarbage;
+
+PKDictionary::PKDictionary()
+{
+}
+
+PKDictionary *PKDictionary::instance(int index)
+{
+	return &g_dictionaries[index];
+}
+
+void PKDictionary::pack(std::string &key, DataType dataType, const MyVariant &value)
+{
+	if (value.isNull()) {
+		key.push_back(0);
+		return;
+	}
+
+	key.push_back(1);
+	if (dataType == DataType::dtSmallInt || dataType == DataType::dtInt || dataType == DataType::dtBigInt) {
+		int64_t v = value.toInt64();
+		key.append(reinterpret_cast<const char *>(&v), sizeof(v));
+	}
+	else {
+		string v = value.toString();
+		uint32_t length = v.length();
+		key.append(reinterpret_cast<const char *>(&length), sizeof(length));
+		key.append(v);
+	}
+}
+
+int64_t PKDictionary::find(const std::string &tableName, const std::string &key) const
+{
+	auto ids = m_ids.find(tableName);
+	if (ids == m_ids.end()) {
+		return -1;
+	}
+
+	auto i = ids->second.find(key);
+	return i != ids->second.end() ? i->second : -1;
+}
+
+int64_t PKDictionary::acquire(const std::string &tableName, const std::string &key)
+{
+	KeyIds &ids = m_ids[tableName];
+	auto i = ids.find(key);
+	if (i != ids.end()) {
+		++m_slots[i->second].refs;
+		return i->second;
+	}
+
+	int64_t id = m_slots.size();
+	if (!m_freeIds.empty()) {
+		id = m_freeIds.back();
+		m_freeIds.pop_back();
+	}
+	else {
+		m_slots.emplace_back();
+	}
+
+	// element of unordered_map isn't moved by rehash, slot keeps pointer to its key
+	i = ids.emplace(key, id).first;
+	m_slots[id] = Slot{ &ids, &i->first, 1 };
+	return id;
+}
+
+void PKDictionary::release(int64_t id)
+{
+	if (id < 0 || id >= (int64_t)m_slots.size() || !m_slots[id].key) {
+		return;
+	}
+
+	Slot &slot = m_slots[id];
+	if (--slot.refs > 0) {
+		return;
+	}
+
+	slot.keys->erase(slot.keys->find(*slot.key));
+	slot.keys = nullptr;
+	slot.key = nullptr;
+	m_freeIds.push_back(id);
+}
+
+void PKDictionary::reset()
+{
+	m_ids.clear();
+	m_slots.clear();
+	m_freeIds.clear();
+}
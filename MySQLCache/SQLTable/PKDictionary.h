@@ -0,0 +1,46 @@
+#pragma once
+#include "DataType.h"
+#include "MyVariant.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// packed values of non-integer or composite pk -> surrogate integer pk, so records are still kept
+// by int64 pk. every worker thread has its own dictionary, surrogates of one thread mean nothing
+// to others. ids are counted by tables having the pk and reused once no table has it
+class PKDictionary
+{
+public:
+	PKDictionary();
+
+	static PKDictionary *instance(int index = 0);
+
+	// append value of pk field to packed key, integers are fixed-width, others are length prefixed
+	static void pack(std::string &key, DataType dataType, const MyVariant &value);
+
+	// surrogate pk of packed key in table, -1 if no table has the key
+	int64_t find(const std::string &tableName, const std::string &key) const;
+	// reference key by a table, a new id is assigned for unknown key
+	int64_t acquire(const std::string &tableName, const std::string &key);
+	// drop a reference of id, key is forgotten and id is reused with the last one
+	void release(int64_t id);
+
+	void reset();
+
+private:
+	typedef std::unordered_map<std::string, int64_t> KeyIds;
+
+	struct Slot
+	{
+		// keys of table having the id, key is null if id is free
+		KeyIds *keys;
+		const std::string *key;
+		uint32_t refs;
+	};
+
+	std::unordered_map<std::string, KeyIds> m_ids;
+	// indexed by id
+	std::vector<Slot> m_slots;
+	std::vector<int64_t> m_freeIds;
+};
@@ -0,0 +1,182 @@
+#include "PKHashMap.h"
+
+// capacity of arrays allocated by the second record, grows from here
+const uint32_t MIN_CAPACITY = 4;
+
+const uint32_t PKHashMap::NULL_DATA_ID;
+
+PKHashMap::PKHashMap() :
+	m_size(0),
+	m_onePK(0),
+	m_oneDataId(NULL_DATA_ID)
+{
+}
+
+uint32_t PKHashMap::find(int64_t pk) const
+{
+	if (m_size == 0) {
+		return NULL_DATA_ID;
+	}
+
+	if (m_dataIds.empty()) {
+		return m_onePK == pk ? m_oneDataId : NULL_DATA_ID;
+	}
+
+	uint32_t mask = m_dataIds.size() - 1;
+	for (uint32_t i = slotOf(pk); ; i = (i + 1) & mask) {
+		if (m_dataIds[i] == NULL_DATA_ID) {
+			return NULL_DATA_ID;
+		}
+
+		if (m_pks[i] == pk) {
+			return m_dataIds[i];
+		}
+	}
+}
+
+bool PKHashMap::insert(int64_t pk, uint32_t dataId)
+{
+	if (m_dataIds.empty()) {
+		if (m_size == 0) {
+			m_onePK = pk;
+			m_oneDataId = dataId;
+			m_size = 1;
+			return true;
+		}
+
+		if (m_onePK == pk) {
+			return false;
+		}
+	}
+
+	// load factor is kept under 3/4
+	if ((m_size + 1) * 4 > m_dataIds.size() * 3) {
+		rehash(m_dataIds.empty() ? MIN_CAPACITY : m_dataIds.size() * 2);
+	}
+
+	uint32_t mask = m_dataIds.size() - 1;
+	uint32_t i = slotOf(pk);
+	while (m_dataIds[i] != NULL_DATA_ID) {
+		if (m_pks[i] == pk) {
+			return false;
+		}
+		i = (i + 1) & mask;
+	}
+
+	m_pks[i] = pk;
+	m_dataIds[i] = dataId;
+	++m_size;
+	return true;
+}
+
+uint32_t PKHashMap::remove(int64_t pk)
+{
+	if (m_size == 0) {
+		return NULL_DATA_ID;
+	}
+
+	if (m_dataIds.empty()) {
+		if (m_onePK != pk) {
+			return NULL_DATA_ID;
+		}
+
+		m_size = 0;
+		return m_oneDataId;
+	}
+
+	uint32_t mask = m_dataIds.size() - 1;
+	uint32_t i = slotOf(pk);
+	while (m_dataIds[i] != NULL_DATA_ID && m_pks[i] != pk) {
+		i = (i + 1) & mask;
+	}
+
+	if (m_dataIds[i] == NULL_DATA_ID) {
+		return NULL_DATA_ID;
+	}
+
+	uint32_t dataId = m_dataIds[i];
+	m_dataIds[i] = NULL_DATA_ID;
+	--m_size;
+
+	// shift following slots of the probe chain back, so no tombstone is needed
+	uint32_t hole = i;
+	for (uint32_t j = (i + 1) & mask; m_dataIds[j] != NULL_DATA_ID; j = (j + 1) & mask) {
+		uint32_t home = slotOf(m_pks[j]);
+		// slot j can move to hole only if its home isn't in (hole, j]
+		if (((j - home) & mask) >= ((j - hole) & mask)) {
+			m_pks[hole] = m_pks[j];
+			m_dataIds[hole] = m_dataIds[j];
+			m_dataIds[j] = NULL_DATA_ID;
+			hole = j;
+		}
+	}
+
+	return dataId;
+}
+
+uint32_t PKHashMap::size() const
+{
+	return m_size;
+}
+
+void PKHashMap::clear()
+{
+	m_pks.clear();
+	m_pks.shrink_to_fit();
+	m_dataIds.clear();
+	m_dataIds.shrink_to_fit();
+	m_size = 0;
+}
+
+void PKHashMap::reserve(uint32_t count)
+{
+	if (count <= 1 && m_dataIds.empty()) {
+		return;
+	}
+
+	uint32_t capacity = m_dataIds.empty() ? MIN_CAPACITY : m_dataIds.size();
+	while (count * 4 > capacity * 3) {
+		capacity *= 2;
+	}
+
+	if (capacity > m_dataIds.size()) {
+		rehash(capacity);
+	}
+}
+
+uint32_t PKHashMap::slotOf(int64_t pk) const
+{
+	// pks are usually sequential, mix bits so they don't form long probe chains
+	uint64_t h = (uint64_t)pk;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return (uint32_t)h & (m_dataIds.size() - 1);
+}
+
+void PKHashMap::rehash(uint32_t capacity)
+{
+	std::vector<int64_t> pks(capacity);
+	std::vector<uint32_t> dataIds(capacity, NULL_DATA_ID);
+	pks.swap(m_pks);
+	dataIds.swap(m_dataIds);
+
+	uint32_t mask = capacity - 1;
+	if (dataIds.empty() && m_size == 1) {
+		pks.push_back(m_onePK);
+		dataIds.push_back(m_oneDataId);
+	}
+
+	for (uint32_t i = 0; i < dataIds.size(); ++i) {
+		if (dataIds[i] == NULL_DATA_ID) {
+			continue;
+		}
+
+		uint32_t j = slotOf(pks[i]);
+		while (m_dataIds[j] != NULL_DATA_ID) {
+			j = (j + 1) & mask;
+		}
+		m_pks[j] = pks[i];
+		m_dataIds[j] = dataIds[i];
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// primary key -> data id of record, open addressing with linear probing.
+// pk and data id are kept in 2 arrays, every slot is 12 bytes.
+// most cache tables hold no or one record, the first one is kept inline until the second is inserted
+class PKHashMap
+{
+public:
+	static const uint32_t NULL_DATA_ID = 0xFFFFFFFF;
+
+	PKHashMap();
+
+	// NULL_DATA_ID if pk doesn't exist
+	uint32_t find(int64_t pk) const;
+	// return false and keep the old one if pk exists
+	bool insert(int64_t pk, uint32_t dataId);
+	// return data id of removed pk, NULL_DATA_ID if pk doesn't exist
+	uint32_t remove(int64_t pk);
+
+	uint32_t size() const;
+	void clear();
+	// make room for count pks, so no rehash happens while inserting them
+	void reserve(uint32_t count);
+
+	// callback(pk, dataId), map mustn't be modified in callback
+	template <typename ForEachCallBack>
+	void forEach(const ForEachCallBack &callBack) const;
+
+private:
+	uint32_t slotOf(int64_t pk) const;
+	void rehash(uint32_t capacity);
+
+private:
+	std::vector<int64_t> m_pks;
+	std::vector<uint32_t> m_dataIds;
+	uint32_t m_size;
+	// the only record while arrays aren't allocated
+	int64_t m_onePK;
+	uint32_t m_oneDataId;
+};
+
+template<typename ForEachCallBack>
+inline void PKHashMap::forEach(const ForEachCallBack &callBack) const
+{
+	if (m_dataIds.empty()) {
+		if (m_size == 1) {
+			callBack(m_onePK, m_oneDataId);
+		}
+		return;
+	}
+
+	for (uint32_t i = 0; i < m_dataIds.size(); ++i) {
+		if (m_dataIds[i] != NULL_DATA_ID) {
+			callBack(m_pks[i], m_dataIds[i]);
+		}
+	}
+}
@@ -1,4 +1,5 @@
 #include "SQLContext.h"
+#include "CacheSetting.h"
 #include "SQLTableSchema.h"
 #include "SQLTable.h"
 #include "antlr4-runtime.h"
@@ -13,12 +14,21 @@
 #include "StrUtils.h"
 #include "SQLTableContainer.h"
 #include "MemoryManager.h"
+#include "SQLRowStore.h"
+#include "PKDictionary.h"
 #include "SQLConnectorException.h"
 #include "SQLParseException.h"
 #include <chrono>
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/socket.h>
+#include <cerrno>
+#endif
 #include <event2/buffer.h>
 #include <event2/bufferevent.h>
 #include <unordered_set>
+#include <algorithm>
 #include <atomic>
 
 using namespace antlr4;
@@ -37,8 +47,53 @@ SQLContext *g_context = nullptr;
 const int8_t MOST_BUSY_GAP = 10;
 const uint32_t EXT_INFO_LEN = 9;
 const int32_t MAX_READ_TASK_TIME = 2;  //minute
+const uint32_t DIRECT_QUERY_CHUNK_SIZE = 64 * 1024; // bytes sent to client once for uncacheable select
+const int32_t PK_LIST_ALIGN_SIZE = 1024; // pk IN list of modify statement is at most this long
+// lengths pk IN list is padded to, few statements are prepared and at most half of a list is padding
+const int32_t PK_LIST_BUCKETS[] = { 1, 2, 3, 4, 6, 8, 12, 16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024 };
+const int32_t MAX_STATEMENT_PARAM_COUNT = 65535; // placeholders of a prepared statement
+const size_t MAX_DML_TEMPLATE_COUNT = 4096; // compiled UPDATE/DELETE kept by a write thread
+const uint32_t MAX_GROUP_WRITE_COUNT = 64; // writes committed together by group commit
+const size_t MAX_JOIN_PROBE_COUNT = 1000; // pks in IN list of one query reading joined records from db
+
+uint32_t g_groupCommitWindow = 0; // microsecond, 0 means group commit is disabled
+int32_t g_limitWindowSlack = 16; // records cached behind LIMIT window
 const int32_t MAX_WRITE_TASK_TIME = 4;  //minute
 
+// connector borrowed by the task running in this thread
+thread_local SQLConnector *t_connector = nullptr;
+
+#ifdef MSG_NOSIGNAL
+const int SOCKET_SEND_FLAGS = MSG_NOSIGNAL;
+#else
+const int SOCKET_SEND_FLAGS = 0;
+#endif
+
+// write all of data to non-blocking socket, wait while its send buffer is full
+static bool writeSocket(evutil_socket_t fd, const uint8_t *data, uint32_t len)
+{
+	while (len > 0) {
+		int n = send(fd, (const char *)data, len, SOCKET_SEND_FLAGS);
+		if (n > 0) {
+			data += n;
+			len -= n;
+			continue;
+		}
+
+		int err = EVUTIL_SOCKET_ERROR();
+#ifdef _WIN32
+		if (err != WSAEWOULDBLOCK) {
+#else
+		if (err != EAGAIN && err != EWOULDBLOCK && err != EINTR) {
+#endif
+			return false;
+		}
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+
+	return true;
+}
+
 
 void threadFunc(SQLContext *context, int thIndex, int threadId)
 {
@@ -50,10 +105,13 @@ void threadFunc(SQLContext *context, int thIndex, int threadId)
 
 SQLContext::SQLContext(bool readMode, int threadCount, const std::string &serverAddr,
 	const std::string &sqlType, bool enableMonitor) :
-	m_readMode(readMode),
 	m_threadCnt(threadCount),
-	m_sqlType(sqlType),
+	m_dmlTemplates(nullptr),
+	m_connectorPool(nullptr),
+	m_groupScheduled(false),
+	m_readMode(readMode),
 	m_enableMonitor(enableMonitor),
+	m_sqlType(sqlType),
 	m_sendBuff(nullptr),
 	m_buffer(nullptr),
 	m_bufferLen(0),
@@ -85,16 +143,37 @@ SQLContext::~SQLContext()
 
 		delete[] m_cacheTableSchemas;
 	}
+	else {
+		for (int i = 0; i < m_threadCnt; ++i) {
+			FOR_EACH(j, m_dmlTemplates[i].lru) {
+				delete j->second->updateSchema;
+				delete j->second;
+			}
+		}
 
-	FOR_EACH(i, m_connectors) {
-		delete *i;
+		delete[] m_dmlTemplates;
 	}
 
+	delete m_connectorPool;
+
 	FOR_EACH(i, m_tableSchemas) {
 		delete i->second;
 	}
 }
 
+void initSQLContext(CacheSetting *setting)
+{
+	MyVariant value = setting->read(GROUP_COMMIT_WINDOW);
+	if (!value.isNull()) {
+		g_groupCommitWindow = value.toUInt();
+	}
+
+	value = setting->read(LIMIT_WINDOW_SLACK);
+	if (!value.isNull()) {
+		g_limitWindowSlack = value.toInt();
+	}
+}
+
 SQLContext *SQLContext::instance()
 {
 	return g_context;
@@ -132,15 +211,24 @@ void SQLContext::initialize(const std::string& serverAddr)
 		for (int i = 0; i < m_threadCnt; ++i) {
 			SQLGraph *graph = new SQLGraph(i);
 			m_graphs.push_back(graph);
+			// keep tables and indexes of schemas in step with tables dropped by container
+			SQLTableContainer::instance(i)->setRemoveEvent([this, i](SQLTableSchema *schema, uint32_t tableId) {
+				SQLSchemaVertex *schemaVtx = static_cast<SQLSchemaVertex *>(
+					m_graphs[i]->findVertex(reinterpret_cast<intptr_t>(schema)));
+				if (schemaVtx) {
+					schemaVtx->removeTable(tableId);
+				}
+			});
 		}
 
 		m_cacheTableSchemas = new TableSchemaHash[m_threadCnt];
 	}
-	
-	for (int i = 0; i < m_threadCnt; ++i) {
-		SQLConnector *connector = SQLConnectorFactory::createConnector(m_sqlType);
-		m_connectors.push_back(connector);
+	else {
+		m_dmlTemplates = new DMLTemplateCache[m_threadCnt];
 	}
+	
+	uint32_t poolSize = SQLConnectorFactory::connectionPoolSize();
+	m_connectorPool = new SQLConnectorPool(m_sqlType, poolSize > 0 ? poolSize : m_threadCnt);
 	connect(serverAddr);
 
 	for (int i = 0; i < m_threadCnt; ++i) {
@@ -155,8 +243,26 @@ void SQLContext::initialize(const std::string& serverAddr)
 
 void SQLContext::free()
 {
-	for (int i = 0; i < m_threadCnt; ++i) {
-		m_connectors[i]->disconnect();
+	m_connectorPool->disconnect();
+}
+
+SQLConnector *SQLContext::connector()
+{
+	if (!t_connector) {
+		t_connector = m_connectorPool->borrow();
+	}
+	return t_connector;
+}
+
+void SQLContext::releaseConnector()
+{
+	if (t_connector) {
+		// transaction broken off by error isn't left to next task
+		if (t_connector->inTransaction()) {
+			t_connector->rollBack();
+		}
+		m_connectorPool->giveBack(t_connector);
+		t_connector = nullptr;
 	}
 }
 
@@ -172,7 +278,7 @@ void SQLContext::test()
 	MySqlParser parser(&tokens);
 	MySQLSelectExprListener listener(this, sqlStr);
 	tree::ParseTreeWalker::DEFAULT.walk(&listener, parser.sqlStatements());
-	//m_connectors[0]->select("SELECT * FROM student");
+	//connector()->select("SELECT * FROM student");
 }
 
 SQLNormalTableSchema *SQLContext::findTable(const std::string &name)
@@ -220,6 +326,9 @@ SQLTable *SQLContext::selectCacheTable(const std::string &sql, MyVariants &param
 	if (schemaInfo) {
 		schemaVtx = static_cast<SQLSchemaVertex *>(
 			m_graphs[thIndex]->findVertex(reinterpret_cast<intptr_t>(schemaInfo->schema)));
+		if (schemaInfo->schema->isPointLookup()) {
+			return selectPointTable(schemaVtx, sql, params, paramTypes, thIndex);
+		}
 		cacheTable = schemaVtx->findTable(params, thIndex);
 	}
 
@@ -230,7 +339,6 @@ SQLTable *SQLContext::selectCacheTable(const std::string &sql, MyVariants &param
 		return cacheTable;
 	}
 
-	string addSql;
 	if (!schemaInfo) {
 		schemaInfo = createCacheTableSchema(sql, thIndex);
 	}
@@ -244,36 +352,130 @@ SQLTable *SQLContext::selectCacheTable(const std::string &sql, MyVariants &param
 			m_graphs[thIndex]->findVertex(reinterpret_cast<intptr_t>(schemaInfo->schema)));
 	}
 
+	if (schemaInfo->schema->isPointLookup()) {
+		return selectPointTable(schemaVtx, sql, params, paramTypes, thIndex);
+	}
+	SQLTable *supersetTable = schemaVtx->findSupersetTable(params, thIndex);
 	uint32_t tableID = 0;
 	cacheTable = addCacheTable(schemaInfo->schema, thIndex, tableID);
 	cacheTable->params() = params;
+	if (supersetTable) {
+		fillCacheTable(cacheTable, supersetTable, schemaVtx);
+		if (m_enableMonitor) {
+			CacheMonitor::instance()->writeHit(sql, thIndex);
+		}
+	}
+	else {
+		try {
+			loadCacheTable(cacheTable, paramTypes);
+		}
+		catch (SQLConnectorException &) {
+			// a table failed to load is never found, neither as superset of others
+			SQLTableContainer::instance(thIndex)->removeTable(tableID);
+			throw;
+		}
+	}
+	// registered only when it's complete
 	schemaVtx->addTable(cacheTable, tableID, thIndex);
-
-	string realSql = sql;
-	if (!schemaInfo->addSql.empty()) {
-		// 7 == length of 'SELECT '
-		realSql = StrUtils::join(realSql.substr(0, 7), schemaInfo->addSql, realSql.substr(7));
-	} 
-	
-	m_connectors[thIndex]->select(realSql, params, paramTypes, cacheTable);
 	return cacheTable;
 }
 
-void SQLContext::directQuery(const std::string &sql, MyVariants &params,
-	std::vector<int8_t>& paramTypes, int thIndex, WriteBuffer *buffer)
+SQLTable *SQLContext::selectPointTable(SQLSchemaVertex *schemaVtx, const std::string &sql, 
+	MyVariants &params, std::vector<int8_t> &paramTypes, int thIndex)
+{
+	// rows of all looked up keys are kept by one table, its params pick the returned row
+	SQLNormalTable *table = static_cast<SQLNormalTable *>(schemaVtx->findTable(MyVariants(), thIndex));
+	if (!table) {
+		uint32_t tableID = 0;
+		table = static_cast<SQLNormalTable *>(addCacheTable(schemaVtx->schema(), thIndex, tableID));
+		schemaVtx->addTable(table, tableID, thIndex);
+	}
+
+	table->params() = params;
+	int64_t key = params.variant(0).toInt64();
+	if (table->existPK(key) || schemaVtx->isMissingKey(key)) {
+		if (m_enableMonitor) {
+			CacheMonitor::instance()->writeHit(sql, thIndex);
+		}
+		return table;
+	}
+
+	loadCacheTable(table, paramTypes);
+	if (table->existPK(key)) {
+		schemaVtx->addPointKey(table, key);
+	}
+	else {
+		schemaVtx->addMissingKey(key);
+	}
+	return table;
+}
+
+void SQLContext::loadCacheTable(SQLTable *table, std::vector<int8_t> &paramTypes)
+{
+	SQLTableSchema *schema = table->schema();
+	int paramCount = schema->loadParamCount();
+	if (paramCount >= 0 && paramCount < table->params().count()) {
+		// params of HAVING aren't bound to load sql
+		MyVariants params;
+		for (int i = 0; i < paramCount; ++i) {
+			params.add(table->params().variant(i));
+		}
+		vector<int8_t> types(paramTypes.begin(), paramTypes.begin() + paramCount);
+		connector()->select(schema->loadSql(), params, types, table);
+	}
+	else {
+		connector()->select(schema->loadSql(), table->params(), paramTypes, table);
+	}
+	if (schema->limitCount() >= 0) {
+		// db may have more records if window is filled up
+		SQLNormalTable *normalTable = static_cast<SQLNormalTable *>(table);
+		normalTable->setTruncated(normalTable->recordCount() >= schema->windowCapacity());
+	}
+}
+
+void SQLContext::fillCacheTable(SQLTable *table, SQLTable *supersetTable, SQLSchemaVertex *schemaVtx)
 {
-	m_connectors[thIndex]->select(sql, buffer, params, paramTypes);
+	SQLNormalTable *normalTable = static_cast<SQLNormalTable *>(table);
+	SQLPredicate *predicate = schemaVtx->predicate();
+	const MyVariants &params = table->params();
+	// shared rows are referenced, others are copied
+	bool shared = table->schema()->rowStore() != nullptr;
+	supersetTable->forEach([&](SQLRecord *rec) {
+		if (predicate->match(rec, params)) {
+			if (shared) {
+				normalTable->append(rec);
+			}
+			else {
+				normalTable->insert(rec);
+			}
+		}
+	});
+}
+
+void SQLContext::refillCacheTable(SQLTable *table)
+{
+	vector<int8_t> paramTypes;
+	for (int i = 0; i < table->params().count(); ++i) {
+		paramTypes.push_back(variantTypeToParamType(table->params().variant(i)));
+	}
+
+	table->clear();
+	loadCacheTable(table, paramTypes);
+}
+
+bool SQLContext::directQuery(const std::string &sql, MyVariants &params,
+	std::vector<int8_t>& paramTypes, WriteBuffer *buffer, const FlushBufferEvent &flush)
+{
+	return connector()->select(sql, buffer, params, paramTypes, flush);
 }
 
 SQLContext::SQLTableSchemaInfo *SQLContext::createCacheTableSchema(const std::string &sql, 
 	int thIndex)
 {	
-	string addSql;
-	SQLTableSchema *tableSchema = doCreateCacheTableSchema(sql, addSql, thIndex);
+	SQLTableSchema *tableSchema = doCreateCacheTableSchema(sql, thIndex);
 	if (tableSchema) {
 		SQLTableSchemaInfo *info = new SQLTableSchemaInfo();
 		info->schema = tableSchema;
-		info->addSql = addSql;
 		m_cacheTableSchemas[thIndex][sql] = info;
 		return info;
 	}
@@ -390,8 +592,7 @@ bool SQLContext::isChinese(unsigned char c)
 	return c > 127;
 }
 
-SQLTableSchema *SQLContext::doCreateCacheTableSchema(const std::string &sqlStr,
-	std::string &addSql, int thIndex)
+SQLTableSchema *SQLContext::doCreateCacheTableSchema(const std::string &sqlStr, int thIndex)
 {
 	ANTLRInputStream input(formatAntlrSql(sqlStr));
 	MySqlLexer lexer(&input);
@@ -406,27 +607,60 @@ SQLTableSchema *SQLContext::doCreateCacheTableSchema(const std::string &sqlStr,
 		std::cerr << e.what() << std::endl;
 		return nullptr;
 	}
-	
+
+	bool limited = listener.limitCount() >= 0;
+	// LIMIT window is kept only for ordered records of single table
+	if (limited && (listener.groupByFieldCount() > 0 || listener.joinType() != SQLJoinType::sjtNull ||
+		listener.orderByFieldCount() == 0)) {
+		std::cerr << "LIMIT is only cacheable with ORDER BY of single table" << std::endl;
+		return nullptr;
+	}
+
+	std::string addSql;
+	SQLTableSchema *result = nullptr;
 	if (listener.groupByFieldCount() > 0) {
-		return createGroupByTableSchema(sqlStr, &listener, thIndex);
+		result = createGroupByTableSchema(sqlStr, addSql, &listener, thIndex);
 	}
 	else if (listener.joinType() == SQLJoinType::sjtNull) {
-		return createNormalTableSchema(sqlStr, addSql, &listener, thIndex);
+		result = createNormalTableSchema(sqlStr, addSql, &listener, thIndex);
 	}
 	else {
-		return createJoinTableSchema(sqlStr, addSql, &listener, thIndex);
+		result = createJoinTableSchema(sqlStr, addSql, &listener, thIndex);
+	}
+
+	std::string loadSql = sqlStr;
+	if (limited) {
+		// records are read from the first one, so the window can be moved by inserts and deletes
+		result->setLimit(listener.limitOffset(), listener.limitCount(), g_limitWindowSlack);
+		loadSql = listener.sqlWithLimit(result->windowCapacity());
+	}
+	else if (listener.havingParamId() >= 0) {
+		// all groups are read, so groups can be moved in and out of HAVING by updates
+		loadSql = listener.sqlWithoutHaving();
+		result->setLoadParamCount(listener.havingParamId());
+	}
+
+	if (!addSql.empty()) {
+		// 7 == length of 'SELECT '
+		loadSql = StrUtils::join(loadSql.substr(0, 7), addSql, loadSql.substr(7));
 	}
+	result->setLoadSql(loadSql);
+	return result;
 }
 
-SQLTableSchema *SQLContext::createGroupByTableSchema(const std::string &sqlStr, 
+SQLTableSchema *SQLContext::createGroupByTableSchema(const std::string &sqlStr, std::string &addSql,
 	MySQLSelectExprListener *listener, int thIndex)
 {
 	SQLNormalTableSchema *result = new SQLNormalTableSchema();
 	result->setName(listener->tableName(0));
 	result->setGroupBy(true);
+	GroupByInfo *groupByInfo = new GroupByInfo();
+	result->setGroupByInfo(groupByInfo);
 	SQLSchemaVertex *schemaVtx = static_cast<SQLSchemaVertex *>(m_graphs[thIndex]->addVertex(result));
+	// records of db table are applied to groups of tables matching WHERE
+	schemaVtx->setCondition(listener->condition());
 
-	bool existPK = false;
+	std::unordered_map<FieldSchema *, std::string> selectNames;
 	for (int i = 0; i < listener->selectFieldCount(); ++i) {
 		FieldSchema *field = listener->selectField(i);
 		std::string columnName = listener->getSqlColumnName(field);
@@ -435,17 +669,57 @@ SQLTableSchema *SQLContext::createGroupByTableSchema(const std::string &sqlStr,
 		if (resultField) {
 			resultField->setQuery(true);
 			addFieldVtx(m_graphs[thIndex], field, schemaVtx);
+			selectNames[field] = fieldName;
 		}
 	}
 
+	// accumulators of SUM and AVG are read from db as hidden columns with the aggregate
+	auto addAggregate = [&](FieldSchema *field, AggregateFunction func, const std::string &name,
+		bool isQuery) {
+		if (result->findField(name)) {
+			return;
+		}
+
+		// sum of integers is kept exactly as bigint, other sums and AVG as double
+		DataType dt = field->dataType();
+		DataType sumType = (dt == DataType::dtBoolean || dt == DataType::dtSmallInt ||
+			dt == DataType::dtInt || dt == DataType::dtBigInt) ? DataType::dtBigInt : DataType::dtDouble;
+		if (func == AggregateFunction::gfCount) {
+			dt = DataType::dtInt;
+		}
+		else if (func == AggregateFunction::gfSum) {
+			dt = sumType;
+		}
+		else if (func == AggregateFunction::gfAvg) {
+			dt = DataType::dtDouble;
+		}
+
+		auto resultField = result->addField(name, dt);
+		resultField->setQuery(isQuery);
+		if (!isQuery) {
+			StrUtils::append(addSql, functionStr(func), "(", field->name(), ") ", name, ",");
+		}
+		if (func == AggregateFunction::gfSum || func == AggregateFunction::gfAvg) {
+			result->addField(name + AGGREGATE_COUNT_SUFFIX, DataType::dtBigInt);
+			StrUtils::append(addSql, "COUNT(", field->name(), ") ", name, AGGREGATE_COUNT_SUFFIX, ",");
+		}
+		if (func == AggregateFunction::gfAvg) {
+			result->addField(name + AGGREGATE_SUM_SUFFIX, sumType);
+			StrUtils::append(addSql, "SUM(", field->name(), ") ", name, AGGREGATE_SUM_SUFFIX, ",");
+		}
+
+		AggregateFieldInfo info;
+		info.field = field;
+		info.aggregateFunc = func;
+		info.name = name;
+		info.isQuery = isQuery;
+		groupByInfo->aggregateFields.push_back(info);
+		addFieldVtx(m_graphs[thIndex], field, schemaVtx, isQuery);
+	};
+
 	for (int i = 0; i < listener->aggregateFieldCount(); ++i) {
 		auto info = listener->aggregateField(i);
-		auto resultField = result->addField(info.name,
-			info.aggregateFunc == AggregateFunction::gfCount ? DataType::dtInt : info.field->dataType());
-		if (resultField) {
-			resultField->setQuery(true);
-			addFieldVtx(m_graphs[thIndex], info.field, schemaVtx);
-		}
+		addAggregate(info.field, info.aggregateFunc, info.name, true);
 	}
 
 	auto conditionIterFunc = [&](SimpleCondition *conditionObj) {
@@ -461,33 +735,61 @@ SQLTableSchema *SQLContext::createGroupByTableSchema(const std::string &sqlStr,
 			addFieldVtx(m_graphs[thIndex], field, schemaVtx, false, true);
 		}
 		else if (conditionObj->kind() == ConditionKind::ckAggregateConst) {
+			// HAVING is matched by cache with aggregates kept in hidden fields
 			AggregateConstCondition *cond = static_cast<AggregateConstCondition *>(conditionObj);
-			FieldSchema *field = cond->leftField();
-			addFieldVtx(m_graphs[thIndex], field, schemaVtx, false);
+			addAggregate(cond->leftField(), cond->leftFunction(), cond->aggregateName(), false);
 		}
 		else if (conditionObj->kind() == ConditionKind::ckAggregateField) {
 			AggregateFieldCondition *cond = static_cast<AggregateFieldCondition *>(conditionObj);
-			FieldSchema *field = cond->leftField();
-			addFieldVtx(m_graphs[thIndex], field, schemaVtx, false);
-
-			field = static_cast<AggregateFieldCondition *>(conditionObj)->rightField();
-			addFieldVtx(m_graphs[thIndex], field, schemaVtx, false);
+			addAggregate(cond->leftField(), cond->leftFunction(), cond->aggregateName(true), false);
+			if (cond->rightFunction() != AggregateFunction::gfUnknown) {
+				addAggregate(cond->rightField(), cond->rightFunction(), cond->aggregateName(false), false);
+			}
+			else {
+				addFieldVtx(m_graphs[thIndex], cond->rightField(), schemaVtx, false);
+			}
 		}
 	};
 
 	listener->forEachCondition(listener->condition(), conditionIterFunc);
 	listener->forEachCondition(listener->having(), conditionIterFunc);
+	groupByInfo->having = listener->having();
 
-	for (int i = 0; i < listener->orderByFieldCount(); ++i) {
-		OrderFieldInfo fieldInfo = listener->orderByField(i);
-		addFieldVtx(m_graphs[thIndex], fieldInfo.field, schemaVtx, false, false, true);
-	}
-
+	// a group is found by values of GROUP BY fields, unselected ones are read as hidden columns
 	for (int i = 0; i < listener->groupByFieldCount(); ++i) {
 		FieldSchema *field = listener->groupByField(i);
+		GroupFieldInfo groupField;
+		groupField.field = field;
+		auto n = selectNames.find(field);
+		if (n != selectNames.end()) {
+			groupField.name = n->second;
+		}
+		else {
+			groupField.name = field->name();
+			result->addField(field->name(), field->dataType());
+			StrUtils::append(addSql, field->name(), ",");
+		}
+		groupByInfo->groupFields.push_back(groupField);
 		addFieldVtx(m_graphs[thIndex], field, schemaVtx, false);
 	}
 
+	// count of records in group, group is removed when it is 0
+	result->addField(COUNT_COLUMN_NAME, DataType::dtBigInt);
+	StrUtils::append(addSql, "COUNT(*) ", COUNT_COLUMN_NAME, ",");
+
+	for (int i = 0; i < listener->orderByFieldCount(); ++i) {
+		OrderFieldInfo fieldInfo = listener->orderByField(i);
+		addFieldVtx(m_graphs[thIndex], fieldInfo.field, schemaVtx, false, false, true);
+		// groups are sorted by cache, as groups may be created after db result is read
+		FOR_EACH(j, groupByInfo->groupFields) {
+			if (j->field == fieldInfo.field) {
+				fieldInfo.field = result->findField(j->name);
+				result->addOrderField(fieldInfo);
+				break;
+			}
+		}
+	}
+
 	result->compile();
 	return result;
 }
@@ -497,6 +799,15 @@ SQLTableSchema *SQLContext::createNormalTableSchema(const std::string &sqlStr, s
 {
 	SQLNormalTableSchema *result = new SQLNormalTableSchema();
 	result->setName(listener->tableName(0));
+	Condition *where = listener->condition().get();
+	if (where && where->kind() == ConditionKind::ckConst && where->op() == "=" &&
+		listener->orderByFieldCount() == 0) {
+		ConstCondition *pkCondition = static_cast<ConstCondition *>(where);
+		result->setPointLookup(listener->tableSchema(0)->isIntegerPK() &&
+			pkCondition->leftField()->isPrimaryKey() &&
+			pkCondition->startParamID() == 0 && pkCondition->endParamID() == 0);
+	}
+
 	SQLSchemaVertex *schemaVtx = static_cast<SQLSchemaVertex *>(m_graphs[thIndex]->addVertex(result));
 	schemaVtx->setCondition(listener->condition());
 
@@ -551,13 +862,22 @@ SQLTableSchema *SQLContext::createNormalTableSchema(const std::string &sqlStr, s
 		}
 	}
 
-	if (result->primaryKey() == nullptr) {
-		FieldSchema *fd = listener->tableSchema(0)->primaryKey();
+	// all fields of composite pk are needed to identify records
+	SQLNormalTableSchema *dbSchema = listener->tableSchema(0);
+	for (int i = 0; i < dbSchema->primaryKeyCount(); ++i) {
+		FieldSchema *fd = dbSchema->primaryKey(i);
+		size_t fieldCount = result->fieldCount();
 		result->addField(*fd);
-		StrUtils::append(addSql, fd->name(), ",");
+		if (result->fieldCount() > fieldCount) {
+			StrUtils::append(addSql, fd->name(), ",");
+		}
 	}
 
 	result->compile();
+	// ordered index keeps values of order fields, they would be stale if row is updated by other tables
+	if (result->orderFieldCount() == 0 && !result->isPointLookup()) {
+		result->setRowStore(new SQLRowStore(result, thIndex));
+	}
 	return result;
 }
 
@@ -565,8 +885,9 @@ SQLTableSchema *SQLContext::createJoinTableSchema(const std::string &sqlStr, std
 	MySQLSelectExprListener *listener, int thIndex)
 {
 	SQLJoinTableSchema *result = new SQLJoinTableSchema();
-	result->left()->setName(listener->tableSchema(0)->name());
-	result->right()->setName(listener->tableSchema(1)->name());
+	for (int i = 0; i < listener->tableCount(); ++i) {
+		result->addTable(listener->tableSchema(i)->name());
+	}
 
 	SQLSchemaVertex *schemaVtx = static_cast<SQLSchemaVertex *>(m_graphs[thIndex]->addVertex(result));
 	schemaVtx->setCondition(listener->condition());
@@ -584,6 +905,8 @@ SQLTableSchema *SQLContext::createJoinTableSchema(const std::string &sqlStr, std
 		}
 	}
 
+	// joined records can be found in cache only by equal conditions between tables
+	bool probeable = !listener->condition() || listener->condition()->isConjunction();
 	auto conditionIterFunc = [&](SimpleCondition *conditionObj) {
 		if (conditionObj->kind() == ConditionKind::ckConst) {
 			FieldSchema *field = static_cast<ConstCondition *>(conditionObj)->leftField();
@@ -591,17 +914,34 @@ SQLTableSchema *SQLContext::createJoinTableSchema(const std::string &sqlStr, std
 			addFieldVtx(m_graphs[thIndex], field, schemaVtx, false, true);
 		}
 		else if (conditionObj->kind() == ConditionKind::ckField) {
-			FieldSchema *field = static_cast<FieldCondition *>(conditionObj)->leftField();
-			result->table(field->tableName())->addField(*field);
-			addFieldVtx(m_graphs[thIndex], field, schemaVtx, false, true);
+			FieldSchema *leftField = static_cast<FieldCondition *>(conditionObj)->leftField();
+			result->table(leftField->tableName())->addField(*leftField);
+			addFieldVtx(m_graphs[thIndex], leftField, schemaVtx, false, true);
 
-			field = static_cast<FieldCondition *>(conditionObj)->rightField();
-			result->table(field->tableName())->addField(*field);
-			addFieldVtx(m_graphs[thIndex], field, schemaVtx, false, true);
+			FieldSchema *rightField = static_cast<FieldCondition *>(conditionObj)->rightField();
+			result->table(rightField->tableName())->addField(*rightField);
+			addFieldVtx(m_graphs[thIndex], rightField, schemaVtx, false, true);
+
+			if (leftField->tableName() == rightField->tableName()) {
+				return;
+			}
+
+			if (conditionObj->op() == "=") {
+				JoinEdge edge;
+				edge.left = result->tableIndex(leftField->tableName());
+				edge.right = result->tableIndex(rightField->tableName());
+				edge.leftField = leftField;
+				edge.rightField = rightField;
+				result->addEdge(edge);
+			}
+			else {
+				probeable = false;
+			}
 		}
 	};
 
 	listener->forEachCondition(schemaVtx->condition(), conditionIterFunc);
+	result->setProbeable(probeable);
 
 	for (int i = 0; i < listener->orderByFieldCount(); ++i) {
 		OrderFieldInfo fieldInfo = listener->orderByField(i);
@@ -613,47 +953,38 @@ SQLTableSchema *SQLContext::createJoinTableSchema(const std::string &sqlStr, std
 		}
 	}
 
-	std::string currentTableName = listener->tableName(0);
-	for (int i = 0; i < result->left()->fieldCount(); ++i) {
-		FieldSchema *fd = result->left()->field(i);
-		if (!fd->isQuery()) {
-			std::string columnName = std::string(result->left()->name())
-				.append(COLUMN_NAME_SEPRATOR).append(fd->name());
-			StrUtils::append(addSql, currentTableName, ".", fd->name(), " ", columnName, ",");
-			result->left()->addColumnMap(fd->name(), columnName);
+	for (int i = 0; i < result->tableCount(); ++i) {
+		SQLNormalTableSchema *table = result->table(i);
+		std::string currentTableName = listener->tableName(i);
+		for (size_t j = 0; j < table->fieldCount(); ++j) {
+			FieldSchema *fd = table->field(j);
+			if (!fd->isQuery()) {
+				std::string columnName = std::string(table->name())
+					.append(COLUMN_NAME_SEPRATOR).append(fd->name());
+				StrUtils::append(addSql, currentTableName, ".", fd->name(), " ", columnName, ",");
+				table->addColumnMap(fd->name(), columnName);
+			}
 		}
-	}
-
-	if (result->left()->primaryKey() == nullptr) {
-		FieldSchema *fd = listener->tableSchema(0)->primaryKey();
-		result->left()->addField(*fd);
-		std::string columnName = std::string(result->left()->name())
-			.append(COLUMN_NAME_SEPRATOR).append(fd->name());
-		StrUtils::append(addSql, currentTableName, ".", fd->name(), " ", columnName, ",");
-		result->left()->addColumnMap(fd->name(), columnName);
-	}
 
-	currentTableName = listener->tableName(1);
-	for (int i = 0; i < result->right()->fieldCount(); ++i) {
-		FieldSchema *fd = result->right()->field(i);
-		if (!fd->isQuery()) {
-			std::string columnName = std::string(result->right()->name())
-				.append(COLUMN_NAME_SEPRATOR).append(fd->name());
-			StrUtils::append(addSql, currentTableName, ".", fd->name(), " ", columnName, ",");
-			result->right()->addColumnMap(fd->name(), columnName);
+		SQLNormalTableSchema *dbSchema = listener->tableSchema(i);
+		for (int j = 0; j < dbSchema->primaryKeyCount(); ++j) {
+			FieldSchema *fd = dbSchema->primaryKey(j);
+			size_t fieldCount = table->fieldCount();
+			table->addField(*fd);
+			if (table->fieldCount() > fieldCount) {
+				std::string columnName = std::string(table->name())
+					.append(COLUMN_NAME_SEPRATOR).append(fd->name());
+				StrUtils::append(addSql, currentTableName, ".", fd->name(), " ", columnName, ",");
+				table->addColumnMap(fd->name(), columnName);
+			}
 		}
 	}
 
-	if (result->right()->primaryKey() == nullptr) {
-		FieldSchema *fd = listener->tableSchema(1)->primaryKey();
-		result->right()->addField(*fd);
-		std::string columnName = std::string(result->right()->name())
-			.append(COLUMN_NAME_SEPRATOR).append(fd->name());
-		StrUtils::append(addSql, currentTableName, ".", fd->name(), " ", columnName, ",");
-		result->right()->addColumnMap(fd->name(), columnName);
-	}
-
 	result->compile();
+	// component records are only ordered by join table, so their rows are shared
+	for (int i = 0; i < result->tableCount(); ++i) {
+		result->table(i)->setRowStore(new SQLRowStore(result->table(i), thIndex));
+	}
 	return result;
 }
 
@@ -679,8 +1010,31 @@ void SQLContext::doSelect(SelectTaskData *task, int thIndex)
 	if (table) {
 		table->save(task->buffer);
 	}
-	else {
-		directQuery(sql, params, paramTypes, thIndex, task->buffer);
+	else if (task->clientSocket != -1) {
+		// result isn't cached, send it by chunks instead of holding all of it in buffer.
+		// event loop of client waits for this task, so chunks are written to socket here
+		bool lost = false;
+		bool ok = directQuery(sql, params, paramTypes, task->buffer, [task, &lost](WriteBuffer *buffer) {
+			if (buffer->byteLength() < DIRECT_QUERY_CHUNK_SIZE) {
+				return;
+			}
+			// rest of result is dropped if client is gone
+			lost = lost || !writeSocket(task->clientSocket, buffer->dataPtr(), buffer->byteLength());
+			buffer->reset();
+			task->streamed = true;
+		});
+		if (ok || task->streamed) {
+			// records are ended with errorCode, as the first one may have been sent
+			task->buffer->writeUByte(ok ? SQLCacheErrorCode::scecNone : SQLCacheErrorCode::scecSqlFail);
+		}
+		else {
+			task->errorCode = SQLCacheErrorCode::scecSqlFail;
+			task->buffer->truncate(1);
+		}
+	}
+	else if (!directQuery(sql, params, paramTypes, task->buffer)) {
+		task->errorCode = SQLCacheErrorCode::scecSqlFail;
+		task->buffer->truncate(1);
 	}
 }
 void SQLContext::doWrite(Task *task, int thIndex)
@@ -688,11 +1042,15 @@ void SQLContext::doWrite(Task *task, int thIndex)
 	auto data = reinterpret_cast<WriteTaskData *>(task->data);
 	if (m_readMode) {
 		uint32_t offset = data->buffer->writePos();
+		// writes of all task threads share one connection, length goes first
+		data->buffer->writeUInt(0);
 		data->buffer->writeUByte(thIndex);
 		data->buffer->writeULong(reinterpret_cast<uint64_t>(data));
 		data->buffer->writeBytes(data->sqlBytes);
-		InputStream in(data->sqlBytes);
-		string dd = in.readText();
+		uint32_t end = data->buffer->writePos();
+		data->buffer->seek(offset);
+		data->buffer->writeUInt(end - offset - 4);
+		data->buffer->seek(end);
 		if (!send(data->buffer, offset)) {
 			data->errorCode = SQLCacheErrorCode::scecWriteServerError;
 			setTaskFinish(data, thIndex);
@@ -700,24 +1058,170 @@ void SQLContext::doWrite(Task *task, int thIndex)
 		return;
 	}
 
-	switch (task->type) {
-	case TaskType::ttInsert:
-		doInsert(data, thIndex);
-		break;
-	case TaskType::ttDelete:
-		doRemove(data, thIndex);
-		break;
-	case TaskType::ttUpdate:
-		doUpdate(data, thIndex);
-		break;
-	case TaskType::ttTransaction:
-		doTransaction(data, thIndex);
-		break;
-	default:
-		break;
-	}
+	executeWrite(task->type, data, thIndex);
+	releaseConnector();
 	setTaskFinish(data, thIndex);
 }
+
+void SQLContext::executeWrite(TaskType type, WriteTaskData *data, int thIndex)
+{
+	try {
+		switch (type) {
+		case TaskType::ttInsert:
+			doInsert(data, thIndex);
+			break;
+		case TaskType::ttDelete:
+			doRemove(data, thIndex);
+			break;
+		case TaskType::ttUpdate:
+			doUpdate(data, thIndex);
+			break;
+		case TaskType::ttTransaction:
+			doTransaction(data, thIndex);
+			break;
+		default:
+			break;
+		}
+	}
+	catch (SQLConnectorException &e) {
+		// no connection can be borrowed from pool, or transaction can't be started/committed
+		std::cerr << "Write Error: " << e.what() << std::endl;
+		data->errorCode = SQLCacheErrorCode::scecSqlFail;
+	}
+}
+// single thread execute, writes of read node are executed in arrival order, by groups
+void SQLContext::doGroupWrite(int thIndex)
+{
+	if (g_groupCommitWindow > 0) {
+		bool full = false;
+		{
+			lock_guard<mutex> locker(m_groupLock);
+			full = m_pendingWrites.size() >= MAX_GROUP_WRITE_COUNT;
+		}
+		if (!full) {
+			// writes come in window are committed with this group
+			this_thread::sleep_for(chrono::microseconds(g_groupCommitWindow));
+		}
+	}
+
+	// transaction commits by itself, it's executed alone
+	vector<Task> group;
+	{
+		lock_guard<mutex> locker(m_groupLock);
+		size_t maxCount = g_groupCommitWindow > 0 ? MAX_GROUP_WRITE_COUNT : 1;
+		while (!m_pendingWrites.empty() && group.size() < maxCount) {
+			Task task = m_pendingWrites.front();
+			if (task.type == TaskType::ttTransaction && !group.empty()) {
+				break;
+			}
+
+			group.push_back(task);
+			m_pendingWrites.pop_front();
+			if (task.type == TaskType::ttTransaction) {
+				break;
+			}
+		}
+	}
+
+	WriteBuffer reply(&MemoryManager::instantce(thIndex));
+	reply.initialize();
+	executeGroupWrite(group, reply, thIndex);
+	releaseConnector();
+	// replies of group are sent at once
+	if (!send(&reply, 0)) {
+		std::cerr << "Group Write Error: read node is disconnected" << std::endl;
+	}
+
+	FOR_EACH(i, group) {
+		delete reinterpret_cast<WriteTaskData *>(i->data);
+	}
+
+	lock_guard<mutex> locker(m_groupLock);
+	m_groupScheduled = !m_pendingWrites.empty();
+	if (m_groupScheduled) {
+		m_taskQueues[m_threadCnt - 1]->addNewTask(TaskType::ttGroupWrite, nullptr);
+	}
+}
+
+void SQLContext::executeGroupWrite(std::vector<Task> &group, WriteBuffer &reply, int thIndex)
+{
+	// reply of write is length(4byte)|errorCode(1byte)|updateCount(4byte)|extInfo|updateData,
+	// header is written again when write is executed
+	auto executeOne = [&](Task &task) {
+		auto data = reinterpret_cast<WriteTaskData *>(task.data);
+		data->errorCode = SQLCacheErrorCode::scecNone;
+		data->updateCount = 0;
+		data->buffer = &reply;
+		uint32_t start = reply.writePos();
+		reply.writeUInt(0);
+		reply.writeUByte(data->errorCode);
+		reply.writeInt(data->updateCount);
+		reply.writeBytes(data->extInfo);
+		executeWrite(task.type, data, thIndex);
+
+		uint32_t end = reply.writePos();
+		reply.seek(start);
+		reply.writeUInt(end - start - 4);
+		reply.writeUByte(data->errorCode);
+		reply.writeInt(data->updateCount);
+		reply.seek(end);
+		return data->errorCode == SQLCacheErrorCode::scecNone;
+	};
+
+	if (group.size() == 1) {
+		executeOne(group[0]);
+		return;
+	}
+
+	bool split = false;
+	bool committing = false;
+	try {
+		connector()->startTransaction();
+		FOR_EACH(i, group) {
+			if (!executeOne(*i)) {
+				split = true;
+				break;
+			}
+		}
+
+		if (!split) {
+			committing = true;
+			connector()->commit();
+			return;
+		}
+	}
+	catch (SQLConnectorException &e) {
+		std::cerr << "Group Write Error: " << e.what() << std::endl;
+		split = true;
+	}
+
+	if (t_connector && t_connector->inTransaction()) {
+		try {
+			t_connector->rollBack();
+		}
+		catch (SQLConnectorException &e) {
+			std::cerr << "Group Write Error: " << e.what() << std::endl;
+		}
+	}
+
+	reply.truncate(0);
+	if (committing) {
+		// commit result is unknown, no write is executed again
+		FOR_EACH(i, group) {
+			auto data = reinterpret_cast<WriteTaskData *>(i->data);
+			reply.writeUInt(5 + data->extInfo->byteLength());
+			reply.writeUByte(SQLCacheErrorCode::scecSqlFail);
+			reply.writeInt(0);
+			reply.writeBytes(data->extInfo);
+		}
+		return;
+	}
+
+	// one failed write mustn't fail others, so every write is executed by itself
+	FOR_EACH(i, group) {
+		executeOne(*i);
+	}
+}
 // single thread execute
 void SQLContext::doInsert(WriteTaskData *task, int thIndex)
 {
@@ -745,49 +1249,41 @@ void SQLContext::doInsert(WriteTaskData *task, int thIndex)
 	MyVariants params;
 	vector<int8_t> paramTypes;
 	readParams(in, params, paramTypes);
-	try {
-		newID = m_connectors[thIndex]->insert(sql, params, paramTypes);
+	// generated id isn't needed if pk is given by insert values
+	bool generatedKey = task->errorCode == SQLCacheErrorCode::scecNone;
+	for (int j = 0; generatedKey && j < listener.insertFieldCount(); ++j) {
+		generatedKey = !listener.insertField(j)->isPrimaryKey();
 	}
-	catch (SQLConnectorException &) {
-		std::cerr << sql << " execute error" << std::endl;
-		task->errorCode = SQLCacheErrorCode::scecSqlFail;
+	// only single integer pk is generated, records without whole composite pk can't be synchronized
+	if (task->errorCode == SQLCacheErrorCode::scecNone && listener.tableSchema() &&
+		!listener.tableSchema()->isIntegerPK()) {
+		int pkFieldCount = 0;
+		for (int j = 0; j < listener.insertFieldCount(); ++j) {
+			pkFieldCount += listener.insertField(j)->isPrimaryKey() ? 1 : 0;
+		}
+
+		if (pkFieldCount < listener.tableSchema()->primaryKeyCount()) {
+			task->errorCode = SQLCacheErrorCode::scecInvalidCacheSql;
+		}
+		generatedKey = false;
+	}
+
+	try {
+		newID = connector()->insert(sql, params, paramTypes, generatedKey);
+	}
+	catch (SQLConnectorException &) {
+		std::cerr << sql << " execute error" << std::endl;
+		task->errorCode = SQLCacheErrorCode::scecSqlFail;
 		return;
 	}
 	
 	task->updateCount = listener.recordCount();
 	if (task->errorCode == SQLCacheErrorCode::scecInvalidCacheSql) {
 		// can't reconize insert values in new recordsso all caches with the table refresh
-		flushAllTableCache(&listener, task, thIndex);
+		flushAllTableCache(listener.tableSchema(), task, thIndex);
 	}
 	else {
-		SQLNormalTable resultTable(listener.tableSchema());
-		resultTable.setThreadIndex(thIndex);
-		int paramIndex = 0;
-		for (int i = 0; i < listener.recordCount(); ++i) {
-			SQLRecord *insertRec = resultTable.newRecord();
-			for (int j = 0; j < listener.tableSchema()->fieldCount(); ++j) {
-				FieldSchema* fd = listener.tableSchema()->field(j);
-				if (fd->isPrimaryKey()) {
-					continue;
-				}
-
-				insertRec->setValue(fd->name(), nullptr);
-			}
-			insertRec->setValue(resultTable.primaryKey()->name(), newID++);
-			resultTable.append(insertRec);
-			for (int j = 0; j < listener.insertFieldCount(); ++j) {
-				const std::string& fieldName = listener.insertField(j)->name();
-				const MyVariant &value = listener.insertValue(i * listener.insertFieldCount() + j);
-				if (value == "?") {
-					insertRec->setValue(fieldName, params.variant(paramIndex++));
-				}
-				else {
-					insertRec->setValue(fieldName, value);
-				}
-			}
-		}
-
-		writeUpdateTable(resultTable, UpdateOperation::umInsert, task->buffer);
+		writeInsertTable(listener, params, newID, task->buffer);
 	}	
 }
 // single thread execute
@@ -795,21 +1291,13 @@ void SQLContext::doRemove(WriteTaskData *task, int thIndex)
 {
 	InputStream in(task->sqlBytes);
 	std::string sql = in.readText();
-	ANTLRInputStream input(formatAntlrSql(sql));
-	MySqlLexer lexer(&input);
-	CommonTokenStream tokens(&lexer);
-	MySqlParser parser(&tokens);
-	auto sqlStat = parser.sqlStatements();
-	if (parser.getNumberOfSyntaxErrors() > 0) {
+	SQLDMLTemplate *dml = findDMLTemplate(sql, TaskType::ttDelete, thIndex);
+	if (!dml) {
 		task->errorCode = SQLCacheErrorCode::scecInvalidSql;
 		return;
 	}
 
-	MySQLDeleteExprListener listener(this);
-	try {
-		tree::ParseTreeWalker::DEFAULT.walk(&listener, sqlStat);
-	}
-	catch (...) {
+	if (!dml->cacheable) {
 		task->errorCode = SQLCacheErrorCode::scecInvalidCacheSql;
 		return;
 	}
@@ -817,64 +1305,13 @@ void SQLContext::doRemove(WriteTaskData *task, int thIndex)
 	MyVariants params;
 	vector<int8_t> paramTypes;
 	readParams(in, params, paramTypes);
-	if (task->errorCode == SQLCacheErrorCode::scecInvalidCacheSql) {
-		try {	
-			task->updateCount = m_connectors[thIndex]->update(sql, params, paramTypes);
-		}
-		catch (SQLConnectorException &) {
-			task->updateCount = 0;
-			task->errorCode = SQLCacheErrorCode::scecSqlFail;
-			return;
-		}
-
-		flushAllTableCache(&listener, task, thIndex);
-		return;
-	}
 	// one delete statement transform to one select statement and one delete statement
-	std::string selectSQL = "SELECT * FROM ";
-	selectSQL.append(listener.tableSchema()->name());
-	
-	std::string::size_type wherePos = StrUtils::toUpper(sql).find(" WHERE ");
-	if (wherePos != std::string::npos) {
-		selectSQL.append(sql.substr(wherePos));
-	}
-
-	SQLNormalTable resultTable(listener.tableSchema());
+	SQLNormalTable resultTable(dml->tableSchema);
 	resultTable.setThreadIndex(thIndex);
-	m_connectors[thIndex]->select(selectSQL, params, paramTypes, &resultTable);
-	if (resultTable.recordCount() == 0) {
-		return;
-	}
-
-	std::string newDeleteSQL = sql;
-	if (wherePos != std::string::npos) {
-		newDeleteSQL = sql.substr(0, wherePos + 7);
-		FieldSchema* pkField = static_cast<SQLNormalTableSchema*>(resultTable.schema())->primaryKey();
-		newDeleteSQL.append(pkField->name());
-		int nRecCount = resultTable.recordCount();
-		if (nRecCount == 1) {
-			resultTable.forEach([&](SQLRecord *rec) {
-				newDeleteSQL.append(" = ").append(rec->strValue(pkField->name()));
-				});
-		}
-		else {
-			newDeleteSQL.append(" IN (");
-			resultTable.forEach([&](SQLRecord *rec) {
-				newDeleteSQL.append(rec->strValue(pkField->name()));
-				if (--nRecCount > 0) {
-					newDeleteSQL.append(",");
-				}
-				});
-			newDeleteSQL.append(")");
-		}
-	}
-
-	try {
-		MyVariants emptyParams;
-		vector<int8_t> emptyParamTypes;
-		task->updateCount = m_connectors[thIndex]->update(newDeleteSQL, emptyParams, emptyParamTypes);
-	}
-	catch (SQLConnectorException &) {
+	// DELETE without WHERE has no param
+	task->updateCount = captureAndModify(dml, resultTable, sql, params, paramTypes, 
+		MyVariants(), vector<int8_t>());
+	if (task->updateCount < 0) {
 		task->updateCount = 0;
 		task->errorCode = SQLCacheErrorCode::scecSqlFail;
 	}
@@ -888,30 +1325,19 @@ void SQLContext::doUpdate(WriteTaskData *task, int thIndex)
 {
 	InputStream in(task->sqlBytes);
 	std::string sql = in.readText();
-	ANTLRInputStream input(formatAntlrSql(sql));
-	MySqlLexer lexer(&input);
-	CommonTokenStream tokens(&lexer);
-	MySqlParser parser(&tokens);
-	MySQLUpdateExprListener listener(this);
-	auto sqlStat = parser.sqlStatements();
-	if (parser.getNumberOfSyntaxErrors() > 0) {
+	SQLDMLTemplate *dml = findDMLTemplate(sql, TaskType::ttUpdate, thIndex);
+	if (!dml) {
 		task->errorCode = SQLCacheErrorCode::scecInvalidSql;
 		return;
 	}
-
-	try {
-		tree::ParseTreeWalker::DEFAULT.walk(&listener, sqlStat);
-	}
-	catch (...) {
-		task->errorCode = SQLCacheErrorCode::scecInvalidCacheSql;
-	}
 	
 	MyVariants params;
 	vector<int8_t> paramTypes;
 	readParams(in, params, paramTypes);
-	if (task->errorCode == SQLCacheErrorCode::scecInvalidCacheSql) {
+	if (!dml->cacheable) {
+		task->errorCode = SQLCacheErrorCode::scecInvalidCacheSql;
 		try {	
-			task->updateCount = m_connectors[thIndex]->update(sql, params, paramTypes);
+			task->updateCount = connector()->update(sql, params, paramTypes);
 		}
 		catch (SQLConnectorException &) {
 			task->updateCount = 0;
@@ -919,70 +1345,24 @@ void SQLContext::doUpdate(WriteTaskData *task, int thIndex)
 			return;
 		}
 		
-		flushAllTableCache(&listener, task, thIndex);
+		flushAllTableCache(dml->tableSchema, task, thIndex);
 		return;
 	}
 
-	// һupdateת1selectupdate
-	std::string selectSQL = "SELECT *, ";
-	SQLExtendTableSchema *updateTableSchema = new SQLExtendTableSchema(listener.tableSchema());
-	for (int i = 0; i < listener.updateFieldCount(); ++i) {
-		FieldSchema *updateField = listener.updateField(i);
-		std::string newUpdateFieldName = std::string(updateField->name()).append(UPDATE_EXPR_SUFFIX);
-		StrUtils::append(selectSQL, "? AS ", newUpdateFieldName);
-		if (i < listener.updateFieldCount() - 1) {
-			selectSQL.append(", ");
-		}
-
-		updateTableSchema->addField(newUpdateFieldName, updateField->dataType());
-	}
-	updateTableSchema->compile();
-
-	StrUtils::append(selectSQL, " FROM ", listener.tableSchema()->name());
-
-	std::string::size_type wherePos = StrUtils::toUpper(sql).find(" WHERE ");
-	if (wherePos != std::string::npos) {
-		StrUtils::append(selectSQL, sql.substr(wherePos));
-	}
-
-	SQLNormalTable resultTable(updateTableSchema);
+	SQLNormalTable resultTable(dml->updateSchema);
+	resultTable.setOwnSchema(false);
 	resultTable.setThreadIndex(thIndex);
-	m_connectors[thIndex]->select(selectSQL, params, paramTypes, &resultTable);
-	if (resultTable.recordCount() == 0) {
-		return;
+	// SET params first, then pk params of selected records
+	MyVariants updateParams;
+	vector<int8_t> updateParamTypes;
+	for (int i = 0; i < dml->updateFieldCount; ++i) {
+		updateParams.add(params.variant(i));
+		updateParamTypes.push_back(paramTypes[i]);
 	}
 
-	FieldSchema *pkField = static_cast<SQLNormalTableSchema *>(resultTable.schema())->primaryKey();
-	std::string newUpdateSQL = sql;
-	if (wherePos != std::string::npos) {
-		newUpdateSQL = sql.substr(0, wherePos + 7);
-		newUpdateSQL.append(pkField->name());
-		int nRecCount = resultTable.recordCount();
-		if (nRecCount == 1) {
-			resultTable.forEach([&](SQLRecord *rec) {
-				StrUtils::append(newUpdateSQL, " = " , rec->strValue(pkField->name()), ";");
-			});
-		}
-		else {
-			newUpdateSQL.append(" IN (");
-			resultTable.forEach([&](SQLRecord *rec) {
-				newUpdateSQL.append(rec->strValue(pkField->name()));
-				if (--nRecCount > 0) {
-					newUpdateSQL.append(",");
-				}
-			});
-			newUpdateSQL.append(");");
-		}
-	}
-	
-	try {
-		for (int i = 0; i < params.count() - listener.updateFieldCount(); ++i) {
-			params.remove(params.count() - 1);
-		}
-		paramTypes.erase(paramTypes.begin() + listener.updateFieldCount(), paramTypes.end());
-		task->updateCount = m_connectors[thIndex]->update(newUpdateSQL, params, paramTypes);
-	}
-	catch (SQLConnectorException &) {
+	task->updateCount = captureAndModify(dml, resultTable, sql, params, paramTypes, 
+		updateParams, updateParamTypes);
+	if (task->updateCount < 0) {
 		task->updateCount = 0;
 		task->errorCode = SQLCacheErrorCode::scecSqlFail;
 	}
@@ -1004,11 +1384,11 @@ void SQLContext::doTransaction(WriteTaskData *task, int thIndex)
 		std::string commandStr = in.readText();
 		CommandType type = parseCommandType(commandStr);
 		if (type == CommandType::ctStartTransaction) {
-			m_connectors[thIndex]->startTransaction();
+			connector()->startTransaction();
 			continue;
 		}
 		else if (type == CommandType::ctCommit) {
-			m_connectors[thIndex]->commit();
+			connector()->commit();
 			break;
 		}
 
@@ -1028,7 +1408,7 @@ void SQLContext::doTransaction(WriteTaskData *task, int thIndex)
 		}
 
 		if (curTask.errorCode != SQLCacheErrorCode::scecNone) {
-			m_connectors[thIndex]->rollBack();
+			connector()->rollBack();
 			task->updateCount = 0;
 			task->errorCode = curTask.errorCode;
 			return;
@@ -1069,12 +1449,14 @@ void SQLContext::doReset(int thIndex)
 {
 	delete m_graphs[thIndex];
 	m_graphs[thIndex] = new SQLGraph(thIndex);
+	// tables release their rows to row stores of schemas, so they are freed first
+	SQLTableContainer::instance(thIndex)->reset();
+	PKDictionary::instance(thIndex)->reset();
 	for (auto j = m_cacheTableSchemas[thIndex].begin(); j != m_cacheTableSchemas[thIndex].end(); ++j) {
 		delete j->second->schema;
 		delete j->second;
 	}
 	m_cacheTableSchemas[thIndex].clear();
-	SQLTableContainer::instance(thIndex)->reset();
 	
 	MemoryManager::instantce(thIndex).arrayMemory().reset();
 	MemoryManager::instantce(thIndex).varMemory().reset();
@@ -1104,13 +1486,289 @@ int SQLContext::strHash(const std::string &sqlStr)
 	return result & (m_threadCnt - 1);
 }
 
-void SQLContext::flushAllTableCache(MySQLExprListener *listener, WriteTaskData *task, int thIndex)
+void SQLContext::flushAllTableCache(SQLNormalTableSchema *tableSchema, WriteTaskData *task, int thIndex)
 {
-	SQLNormalTable resultTable(listener->tableSchema());
+	SQLNormalTable resultTable(tableSchema);
 	resultTable.setThreadIndex(thIndex);
 	writeUpdateTable(resultTable, UpdateOperation::umAll, task->buffer);
 }
 
+SQLContext::SQLDMLTemplate *SQLContext::findDMLTemplate(const std::string &sql, TaskType type, 
+	int thIndex)
+{
+	std::string key = normalizeSql(sql);
+	DMLTemplateCache &cache = m_dmlTemplates[thIndex];
+	auto i = cache.templates.find(key);
+	if (i != cache.templates.end()) {
+		cache.lru.splice(cache.lru.begin(), cache.lru, i->second);
+		return i->second->second;
+	}
+
+	SQLDMLTemplate *dml = compileDMLTemplate(sql, type);
+	if (!dml) {
+		return dml;
+	}
+
+	// templates are only used by the task finding them, the dropped one isn't in use
+	if (cache.templates.size() >= MAX_DML_TEMPLATE_COUNT) {
+		auto &last = cache.lru.back();
+		delete last.second->updateSchema;
+		delete last.second;
+		cache.templates.erase(last.first);
+		cache.lru.pop_back();
+	}
+
+	cache.lru.emplace_front(key, dml);
+	cache.templates[key] = cache.lru.begin();
+	return dml;
+}
+
+SQLContext::SQLDMLTemplate *SQLContext::compileDMLTemplate(const std::string &sql, TaskType type)
+{
+	ANTLRInputStream input(formatAntlrSql(sql));
+	MySqlLexer lexer(&input);
+	CommonTokenStream tokens(&lexer);
+	MySqlParser parser(&tokens);
+	auto sqlStat = parser.sqlStatements();
+	if (parser.getNumberOfSyntaxErrors() > 0) {
+		return nullptr;
+	}
+
+	MySQLUpdateExprListener updateListener(this);
+	MySQLDeleteExprListener deleteListener(this);
+	MySQLExprListener *listener = &deleteListener;
+	if (type == TaskType::ttUpdate) {
+		listener = &updateListener;
+	}
+
+	SQLDMLTemplate *dml = new SQLDMLTemplate();
+	try {
+		tree::ParseTreeWalker::DEFAULT.walk(listener, sqlStat);
+	}
+	catch (...) {
+		dml->cacheable = false;
+	}
+
+	dml->tableSchema = listener->tableSchema();
+	if (!dml->cacheable || !dml->tableSchema) {
+		dml->cacheable = false;
+		return dml;
+	}
+
+	// һupdate/deleteת1select1޸ĵ
+	std::string::size_type wherePos = StrUtils::toUpper(sql).find(" WHERE ");
+	if (type == TaskType::ttUpdate) {
+		dml->selectSql = "SELECT *, ";
+		dml->updateFieldCount = updateListener.updateFieldCount();
+		dml->updateSchema = new SQLExtendTableSchema(dml->tableSchema);
+		for (int i = 0; i < updateListener.updateFieldCount(); ++i) {
+			FieldSchema *updateField = updateListener.updateField(i);
+			std::string newUpdateFieldName = std::string(updateField->name()).append(UPDATE_EXPR_SUFFIX);
+			StrUtils::append(dml->selectSql, "? AS ", newUpdateFieldName);
+			if (i < updateListener.updateFieldCount() - 1) {
+				dml->selectSql.append(", ");
+			}
+
+			dml->updateSchema->addField(newUpdateFieldName, updateField->dataType());
+		}
+		dml->updateSchema->compile();
+		StrUtils::append(dml->selectSql, " FROM ", dml->tableSchema->name());
+	}
+	else {
+		StrUtils::append(dml->selectSql, "SELECT * FROM ", dml->tableSchema->name());
+	}
+
+	if (wherePos != std::string::npos) {
+		std::string whereStr = sql.substr(wherePos);
+		std::string::size_type endPos = whereStr.find_last_not_of(" \t\r\n;");
+		dml->selectSql.append(whereStr.substr(0, endPos + 1));
+		StrUtils::append(dml->modifySql, sql.substr(0, wherePos + 7), pkColumns(dml->tableSchema));
+	}
+	// captured records are locked until they are modified
+	dml->lockSelectSql = dml->selectSql + " FOR UPDATE";
+
+	return dml;
+}
+
+int SQLContext::captureAndModify(SQLDMLTemplate *dml, SQLNormalTable &resultTable, 
+	const std::string &sql, MyVariants &params, std::vector<int8_t> &paramTypes,
+	const MyVariants &leadParams, const std::vector<int8_t> &leadTypes)
+{
+	// captured records are locked until they are modified, so they still match WHERE then
+	SQLConnector *sqlConnector = connector();
+	bool ownTransaction = !sqlConnector->inTransaction();
+	int updateCount = 0;
+	try {
+		if (ownTransaction) {
+			sqlConnector->startTransaction();
+		}
+
+		sqlConnector->select(dml->lockSelectSql, params, paramTypes, &resultTable);
+		if (resultTable.recordCount() > 0) {
+			updateCount = modifyByPK(dml, resultTable, sql, leadParams, leadTypes);
+		}
+
+		if (ownTransaction) {
+			sqlConnector->commit();
+		}
+	}
+	catch (SQLConnectorException &) {
+		// records captured aren't sent, caches are unchanged
+		resultTable.clear();
+		if (ownTransaction && sqlConnector->inTransaction()) {
+			sqlConnector->rollBack();
+		}
+		return -1;
+	}
+
+	return updateCount;
+}
+
+int SQLContext::modifyByPK(SQLDMLTemplate *dml, SQLNormalTable &resultTable, const std::string &sql,
+	const MyVariants &leadParams, const std::vector<int8_t> &leadTypes)
+{
+	SQLConnector *sqlConnector = connector();
+	if (dml->modifySql.empty()) {
+		MyVariants params = leadParams;
+		vector<int8_t> paramTypes = leadTypes;
+		return sqlConnector->update(sql, params, paramTypes);
+	}
+
+	MyVariants pks;
+	vector<int8_t> pkTypes;
+	resultTable.forEach([&](SQLRecord *rec) {
+		addPKParams(dml->tableSchema, rec, pks, pkTypes);
+	});
+
+	// pks are bound as a plain IN list instead of one JSON param read by JSON_TABLE, which needs MySQL 8.
+	// captured records are needed to update caches anyway, so the SELECT isn't saved.
+	// chunks are in the transaction of capture, so records are modified all or none
+	int recCount = resultTable.recordCount();
+	int chunkSize = std::min<int>(PK_LIST_ALIGN_SIZE,
+		(MAX_STATEMENT_PARAM_COUNT - leadParams.count()) / std::max(1, dml->tableSchema->primaryKeyCount()));
+	int updateCount = 0;
+	for (int start = 0; start < recCount; start += chunkSize) {
+		MyVariants params = leadParams;
+		vector<int8_t> paramTypes = leadTypes;
+		std::string modifySql = bindPKModifySql(dml, pks, pkTypes, start,
+			std::min(chunkSize, recCount - start), chunkSize, params, paramTypes);
+		updateCount += sqlConnector->update(modifySql, params, paramTypes);
+	}
+	return updateCount;
+}
+
+std::string SQLContext::bindPKModifySql(SQLDMLTemplate *dml, const MyVariants &pks, 
+	const std::vector<int8_t> &pkTypes, int start, int count, int maxCount, MyVariants &params, 
+	std::vector<int8_t> &paramTypes)
+{
+	std::string modifySql = dml->modifySql;
+	int nRecCount = count;
+	// IN list length is rounded up to a bucket, the last pk is repeated, so few statements are prepared
+	int nParamCount = *std::lower_bound(std::begin(PK_LIST_BUCKETS), std::end(PK_LIST_BUCKETS) - 1, nRecCount);
+	nParamCount = std::max(nRecCount, std::min(nParamCount, maxCount));
+
+	SQLNormalTableSchema *tableSchema = dml->tableSchema;
+	std::string placeholder = pkPlaceholder(tableSchema);
+	modifySql.append(nParamCount == 1 ? " = " : " IN (");
+	modifySql.append(placeholder);
+	for (int i = 1; i < nParamCount; ++i) {
+		StrUtils::append(modifySql, ",", placeholder);
+	}
+	if (nParamCount > 1) {
+		modifySql.append(")");
+	}
+
+	int pkCount = tableSchema->primaryKeyCount();
+	for (int i = start * pkCount; i < (start + count) * pkCount; ++i) {
+		params.add(pks.variant(i));
+		paramTypes.push_back(pkTypes[i]);
+	}
+	for (int i = nRecCount; i < nParamCount; ++i) {
+		for (int j = 0; j < pkCount; ++j) {
+			MyVariant pk = params.variant(params.count() - pkCount);
+			paramTypes.push_back(variantTypeToParamType(pk));
+			params.add(pk);
+		}
+	}
+	return modifySql;
+}
+
+std::string SQLContext::pkColumns(SQLNormalTableSchema *tableSchema, const std::string &tableName)
+{
+	std::string result;
+	for (int i = 0; i < tableSchema->primaryKeyCount(); ++i) {
+		if (!tableName.empty()) {
+			StrUtils::append(result, tableName, ".");
+		}
+		StrUtils::append(result, tableSchema->primaryKey(i)->name(), ",");
+	}
+	if (!result.empty()) {
+		result.pop_back();
+	}
+	return tableSchema->primaryKeyCount() > 1 ? StrUtils::join("(", result, ")") : result;
+}
+
+std::string SQLContext::pkPlaceholder(SQLNormalTableSchema *tableSchema)
+{
+	if (tableSchema->primaryKeyCount() == 1) {
+		return "?";
+	}
+
+	std::string result = "(?";
+	for (int i = 1; i < tableSchema->primaryKeyCount(); ++i) {
+		result.append(",?");
+	}
+	return result.append(")");
+}
+
+void SQLContext::addPKParams(SQLNormalTableSchema *tableSchema, SQLRecord *rec, MyVariants &params,
+	std::vector<int8_t> &paramTypes)
+{
+	for (int i = 0; i < tableSchema->primaryKeyCount(); ++i) {
+		MyVariant pk = rec->value(tableSchema->primaryKey(i)->name());
+		paramTypes.push_back(variantTypeToParamType(pk));
+		params.add(pk);
+	}
+}
+
+std::string SQLContext::normalizeSql(const std::string &sql)
+{
+	// collapse blanks out of quotes, so one statement written differently shares one template
+	std::string result;
+	result.reserve(sql.size());
+	char quoteChar = 0;
+	bool lastBlank = true;
+	for (size_t i = 0; i < sql.size(); ++i) {
+		char c = sql[i];
+		if (quoteChar) {
+			result.push_back(c);
+			if (c == quoteChar) {
+				quoteChar = 0;
+			}
+			continue;
+		}
+
+		if (c == ' ' || c == '\r' || c == '\n' || c == '\t') {
+			if (!lastBlank) {
+				result.push_back(' ');
+			}
+			lastBlank = true;
+			continue;
+		}
+
+		if (c == '\'' || c == '"' || c == '`') {
+			quoteChar = c;
+		}
+		result.push_back(c);
+		lastBlank = false;
+	}
+
+	if (!result.empty() && result.back() == ' ') {
+		result.pop_back();
+	}
+	return result;
+}
+
 void SQLContext::updateAffectedCacheTable(UpdateCacheTaskData *task, int thIndex)
 {
 	unordered_map<SQLSchemaVertex *, uint8_t> tableSchemas;
@@ -1121,38 +1779,52 @@ void SQLContext::updateAffectedCacheTable(UpdateCacheTaskData *task, int thIndex
 
 	auto updateRecords = reinterpret_cast<SQLTempTable *>(task->updateRecords);
 	SQLExtendRecord *eRec = nullptr;
+	// record with old values of updated fields
+	auto oldRecord = [&]() {
+		if (!eRec) {
+			eRec = new SQLExtendRecord();
+			for (size_t i = 0; i < updateFields->size(); ++i) {
+				const string &fieldName = (*updateFields)[i]->name();
+				eRec->addMapFields(fieldName, fieldName + UPDATE_EXPR_SUFFIX);
+			}
+		}
+		return eRec;
+	};
+
 	for (auto i = tableSchemas.begin(); i != tableSchemas.end(); ++i) {
 		SQLSchemaVertex *schemaVtx = i->first;
-		if (task->updateMode == UpdateOperation::umAll || schemaVtx->schema()->isGroupBy()) {
+		if (task->updateMode == UpdateOperation::umAll) {
 			schemaVtx->clearTable(thIndex);
 			continue;
 		}
 
-		if (task->updateMode == UpdateOperation::umInsert) {
-			insertUpdateRecords(updateRecords, schemaVtx, thIndex);
-		}
-		else if (task->updateMode == UpdateOperation::umDelete) {
-			deleteUpdateRecords(updateRecords, schemaVtx, thIndex);
-		}
-		else {
-			if (RelationUtils::isWhere(i->second)) {
-				if (!eRec) {
-					eRec = new SQLExtendRecord();
-					for (int i = 0; i < updateFields->size(); ++i) {
-						auto field = (*updateFields)[i];
-						const string &fieldName = field->name();
-						eRec->addMapFields(fieldName,
-							fieldName.substr(0, fieldName.length() - UPDATE_EXPR_SUFFIX.length()));
-					}
-				}
-				// remove old value record from table, then fill new value, add record to new Table
-				deleteUpdateRecords(updateRecords, schemaVtx, thIndex, eRec);
+		try {
+			if (schemaVtx->schema()->isGroupBy()) {
+				updateAggregateTables(updateRecords, schemaVtx, task->updateMode,
+					task->updateMode == UpdateOperation::umModify ? oldRecord() : nullptr, thIndex);
+			}
+			else if (task->updateMode == UpdateOperation::umInsert) {
 				insertUpdateRecords(updateRecords, schemaVtx, thIndex);
 			}
+			else if (task->updateMode == UpdateOperation::umDelete) {
+				deleteUpdateRecords(updateRecords, schemaVtx, thIndex);
+			}
 			else {
-				updateUpdateRecords(updateRecords, schemaVtx, updateFields, thIndex);
+				if (RelationUtils::isWhere(i->second)) {
+					// remove old value record from table, then fill new value, add record to new Table
+					deleteUpdateRecords(updateRecords, schemaVtx, thIndex, oldRecord());
+					insertUpdateRecords(updateRecords, schemaVtx, thIndex);
+				}
+				else {
+					updateUpdateRecords(updateRecords, schemaVtx, updateFields, thIndex);
+				}
 			}
 		}
+		catch (SQLConnectorException &e) {
+			// refill or join probe failed, tables of schema may be half updated, drop them to reload
+			std::cerr << "Update Cache Error: " << e.what() << std::endl;
+			schemaVtx->clearTable(thIndex);
+		}
 	}
 
 	if (eRec) {
@@ -1182,91 +1854,216 @@ void SQLContext::findEffectedCacheTable(FieldSchema *updateField, SQLGraph *grap
 	}
 }
 
-void SQLContext::insertJoinTableRecord(SQLJoinTable *joinTable, const std::string &tableName, 
-	std::shared_ptr<Condition> condition, SQLRecord *rec, MyVariants &params,
-	SQLConnector &connector)
+void SQLContext::insertJoinTableRecords(SQLJoinTable *joinTable, const std::string &tableName, 
+	std::shared_ptr<Condition> condition, std::vector<SQLRecord *> &recs, SQLConnector &connector)
 {
-	std::string matchTableName = joinTable->left().name() == tableName ?
-		joinTable->right().name() : joinTable->left().name();
+	int sourceIndex = joinTable->tableIndex(tableName);
+	if (sourceIndex < 0) {
+		return;
+	}
 
-	std::string matchSelectSql = "SELECT ";
-	SQLNormalTable *matchTable = joinTable->getTable(matchTableName);
-	SQLNormalTableSchema *tableSchema = matchTable->normalSchema();
-	for (int i = 0; i < tableSchema->fieldCount(); ++i) {
-		matchSelectSql.append(tableSchema->field(i)->name());
-		if (i < tableSchema->fieldCount() - 1) {
-			matchSelectSql.append(",");
+	MyVariants &params = joinTable->params();
+	SQLNormalTable &sourceTable = joinTable->table(sourceIndex);
+	vector<SQLRecord *> unjoinedRecs;
+	FOR_EACH(i, recs) {
+		if (!joinTable->joinSchema()->isProbeable() ||
+			!probeJoinTableRecord(joinTable, sourceIndex, condition, *i, params)) {
+			unjoinedRecs.push_back(*i);
 		}
-		else {
-			matchSelectSql.append(" FROM ").append(matchTableName);
+	}
+
+	if (unjoinedRecs.empty()) {
+		return;
+	}
+
+	// records not joined in cache are read from db together, by join of all tables limited to their pks
+	std::string selectSql = "SELECT ";
+	std::string fromSql = " FROM ";
+	for (int i = 0; i < joinTable->tableCount(); ++i) {
+		SQLNormalTableSchema *tableSchema = joinTable->table(i).normalSchema();
+		for (size_t j = 0; j < tableSchema->fieldCount(); ++j) {
+			const std::string &fieldName = tableSchema->field(j)->name();
+			StrUtils::append(selectSql, tableSchema->name(), ".", fieldName, " ",
+				tableSchema->getRealColumnName(fieldName), ",");
 		}
+		StrUtils::append(fromSql, tableSchema->name(), ",");
 	}
+	selectSql.pop_back();
+	fromSql.pop_back();
+	StrUtils::append(selectSql, fromSql, " WHERE ");
 
-	MyVariants newParams;
-	vector<int8_t> paramTypes;
+	MyVariants conditionParams;
+	vector<int8_t> conditionParamTypes;
 	if (condition) {
-		matchSelectSql.append(" WHERE ");
 		vector<int16_t> paramIndex;
-		condition->toString(matchSelectSql, rec, paramIndex);
+		selectSql.append("(");
+		condition->toString(selectSql, nullptr, paramIndex);
+		selectSql.append(") AND ");
 		for (int i = 0; i < paramIndex.size(); ++i) {
-			newParams.add(params.variant(paramIndex[i]));
-			paramTypes.push_back(variantTypeToParamType(newParams.variant(i)));
+			conditionParams.add(params.variant(paramIndex[i]));
+			conditionParamTypes.push_back(variantTypeToParamType(conditionParams.variant(i)));
 		}
 	}
-	
-	std::vector<SQLRecord *> matchRecs = connector.select(matchSelectSql, newParams, paramTypes,
-		matchTable, true);
-	if (matchRecs.size() > 0) {
-		SQLRecord *realRec = joinTable->getTable(tableName)->insert(rec);
-		for (int i = 0; i < matchRecs.size(); ++i) {
-			SQLJoinRecord *joinRec = static_cast<SQLJoinRecord *>(joinTable->newRecord());
-			joinRec->add(realRec);
-			joinRec->add(matchRecs[i]);
-			joinTable->append(joinRec);
+	SQLNormalTableSchema *sourceSchema = sourceTable.normalSchema();
+	StrUtils::append(selectSql, pkColumns(sourceSchema, sourceTable.name()), " IN (");
+	std::string placeholder = pkPlaceholder(sourceSchema);
+
+	for (size_t start = 0; start < unjoinedRecs.size(); start += MAX_JOIN_PROBE_COUNT) {
+		size_t end = std::min(unjoinedRecs.size(), start + MAX_JOIN_PROBE_COUNT);
+		std::string probeSql = selectSql;
+		MyVariants probeParams = conditionParams;
+		vector<int8_t> probeParamTypes = conditionParamTypes;
+		for (size_t i = start; i < end; ++i) {
+			StrUtils::append(probeSql, i == start ? "" : ",", placeholder);
+			addPKParams(sourceSchema, unjoinedRecs[i], probeParams, probeParamTypes);
+		}
+		probeSql.append(")");
+		connector.select(probeSql, probeParams, probeParamTypes, joinTable);
+	}
+}
+
+bool SQLContext::probeJoinTableRecord(SQLJoinTable *joinTable, int sourceIndex, 
+	std::shared_ptr<Condition> condition, SQLRecord *rec, MyVariants &params)
+{
+	// walk edges from rec, a table is reached only by the edge on its primary key, 
+	// so the cached record is the only one joined
+	SQLJoinTableSchema *joinSchema = joinTable->joinSchema();
+	int tableCount = joinTable->tableCount();
+	vector<SQLNormalRecord> records(tableCount, SQLNormalRecord(nullptr));
+	vector<bool> reached(tableCount, false);
+	reached[sourceIndex] = true;
+	auto fieldValue = [&](int index, FieldSchema *field) {
+		return index == sourceIndex ? rec->value(field->name()) : records[index].value(field->name());
+	};
+
+	bool matched = true;
+	for (int reachedCount = 1; reachedCount < tableCount; ++reachedCount) {
+		int next = -1;
+		for (int i = 0; i < joinSchema->edgeCount() && next < 0; ++i) {
+			const JoinEdge &edge = joinSchema->edge(i);
+			for (int side = 0; side < 2; ++side) {
+				int from = side == 0 ? edge.left : edge.right;
+				int to = side == 0 ? edge.right : edge.left;
+				FieldSchema *fromField = side == 0 ? edge.leftField : edge.rightField;
+				FieldSchema *toField = side == 0 ? edge.rightField : edge.leftField;
+				// composite pk isn't determined by one edge
+				if (!reached[from] || reached[to] || !toField->isPrimaryKey() ||
+					!joinTable->table(to).normalSchema()->isIntegerPK()) {
+					continue;
+				}
+
+				MyVariant pk = fieldValue(from, fromField);
+				SQLRecord *toRec = pk.isNull() ? nullptr : joinTable->table(to).selectByPK(pk.toInt64());
+				if (!toRec) {
+					// record isn't cached, or is joined with nothing
+					return pk.isNull();
+				}
+
+				records[to] = *static_cast<SQLNormalRecord *>(toRec);
+				matched = matched && (!condition || condition->match(&records[to], params));
+				reached[to] = true;
+				next = to;
+				break;
+			}
+		}
+
+		if (next < 0) {
+			return false;
 		}
 	}
+
+	// edges not walked, e.g. a cycle of tables
+	for (int i = 0; i < joinSchema->edgeCount() && matched; ++i) {
+		const JoinEdge &edge = joinSchema->edge(i);
+		matched = fieldValue(edge.left, edge.leftField) == fieldValue(edge.right, edge.rightField);
+	}
+
+	if (matched) {
+		SQLNormalTable &sourceTable = joinTable->table(sourceIndex);
+		SQLRecord *source = sourceTable.selectByPK(sourceTable.intPK(rec));
+		records[sourceIndex] = *static_cast<SQLNormalRecord *>(source ? source : sourceTable.insert(rec));
+		SQLJoinRecord *joinRec = static_cast<SQLJoinRecord *>(joinTable->newRecord());
+		for (int i = 0; i < tableCount; ++i) {
+			joinRec->setRecord(i, &records[i]);
+		}
+		joinTable->append(joinRec);
+	}
+
+	return true;
 }
 
 void SQLContext::insertUpdateRecords(SQLTempTable *updateRecords, SQLSchemaVertex *schemaVtx, int thIndex)
 {
-	updateRecords->forEach([&](SQLRecord *rec) {
-		vector<SQLTable *> tables = schemaVtx->findTable(rec, thIndex);
-		for (int i = 0; i < tables.size(); ++i) {
-			SQLTable *table = tables[i];
-			if (table->kind() == TableKind::tkNormal) {
-				static_cast<SQLNormalTable *>(table)->insert(rec);
+	// rows of point lookup are cached when they are looked up, inserted keys aren't missing then
+	if (schemaVtx->schema()->isPointLookup()) {
+		updateRecords->forEach([&](SQLRecord *rec) {
+			schemaVtx->removeMissingKey(updateRecords->intPK(rec));
+		});
+		return;
+	}
+
+	// the batch is matched once, then records are applied table by table
+	vector<TableMatch> matches = schemaVtx->findTable(updateRecords->recordCount(),
+		[&](uint32_t i) { return updateRecords->record(i); }, thIndex);
+	SQLTableContainer *container = SQLTableContainer::instance(thIndex);
+	FOR_EACH(m, matches) {
+		SQLTable *table = container->getTable(m->tableId);
+		if (!table) {
+			continue;
+		}
+
+		if (table->kind() == TableKind::tkNormal) {
+			FOR_EACH(r, m->records) {
+				static_cast<SQLNormalTable *>(table)->insert(updateRecords->record(*r));
 			}
-			else {
-				insertJoinTableRecord(static_cast<SQLJoinTable *>(table), 
-					updateRecords->normalSchema()->name(), schemaVtx->condition(), rec, 
-					table->params(), *m_connectors[thIndex]);
+		}
+		else {
+			// records joined with inserted ones are found together
+			vector<SQLRecord *> recs;
+			FOR_EACH(r, m->records) {
+				recs.push_back(updateRecords->record(*r));
 			}
+			insertJoinTableRecords(static_cast<SQLJoinTable *>(table), updateRecords->normalSchema()->name(),
+				schemaVtx->condition(), recs, *connector());
 		}
-	});
+	}
 }
 
 void SQLContext::deleteUpdateRecords(SQLTempTable *updateRecords, SQLSchemaVertex *schemaVtx, 
 	int thIndex, SQLExtendRecord *eRecord)
 {
-	updateRecords->forEach([&](SQLRecord *rec) {
+	auto record = [&](uint32_t i) {
+		SQLRecord *rec = updateRecords->record(i);
 		if (eRecord) {
 			eRecord->setBase(rec);
 			rec = eRecord;
 		}
+		return rec;
+	};
+
+	vector<TableMatch> matches = schemaVtx->findTable(updateRecords->recordCount(), record, thIndex);
+	SQLTableContainer *container = SQLTableContainer::instance(thIndex);
+	std::string tableName = static_cast<SQLNormalTableSchema *>(updateRecords->schema())->name();
+	FOR_EACH(m, matches) {
+		SQLTable *table = container->getTable(m->tableId);
+		if (!table) {
+			continue;
+		}
 
-		vector<SQLTable *> tables = schemaVtx->findTable(rec, thIndex);
-		for (int i = 0; i < tables.size(); ++i) {
-			SQLTable *table = tables[i];
+		FOR_EACH(r, m->records) {
+			SQLRecord *rec = record(*r);
 			if (table->kind() == TableKind::tkNormal) {
-				static_cast<SQLNormalTable *>(table)->remove(rec);
+				SQLNormalTable *normalTable = static_cast<SQLNormalTable *>(table);
+				normalTable->remove(rec);
+				if (normalTable->windowDrained()) {
+					refillCacheTable(normalTable);
+				}
 			}
 			else {
-				std::string tableName =
-					static_cast<SQLNormalTableSchema *>(updateRecords->schema())->name();
 				static_cast<SQLJoinTable *>(table)->remove(tableName, rec);
 			}
 		}
-	});
+	}
 }
 
 void SQLContext::updateUpdateRecords(SQLTempTable *updateRecords, SQLSchemaVertex *schemaVtx, 
@@ -1277,20 +2074,76 @@ void SQLContext::updateUpdateRecords(SQLTempTable *updateRecords, SQLSchemaVerte
 		updateFieldNames.push_back((*updateFields)[i]->name());
 	}
 
-	updateRecords->forEach([&](SQLRecord *rec) {
-		vector<SQLTable *> tables = schemaVtx->findTable(rec, thIndex);
-		for (int i = 0; i < tables.size(); ++i) {
-			SQLTable *table = tables[i];
+	SQLRowStore *rowStore = schemaVtx->schema()->rowStore();
+	if (rowStore) {
+		// WHERE fields aren't updated, so the shared row is in every table having it, update it once
+		updateRecords->forEach([&](SQLRecord *rec) {
+			rowStore->update(rec, updateFieldNames);
+		});
+		return;
+	}
+
+	vector<TableMatch> matches = schemaVtx->findTable(updateRecords->recordCount(),
+		[&](uint32_t i) { return updateRecords->record(i); }, thIndex);
+	SQLTableContainer *container = SQLTableContainer::instance(thIndex);
+	std::string tableName = static_cast<SQLNormalTableSchema *>(updateRecords->schema())->name();
+	FOR_EACH(m, matches) {
+		SQLTable *table = container->getTable(m->tableId);
+		if (!table) {
+			continue;
+		}
+
+		FOR_EACH(r, m->records) {
+			SQLRecord *rec = updateRecords->record(*r);
 			if (table->kind() == TableKind::tkNormal) {
-				static_cast<SQLNormalTable *>(table)->update(rec, updateFieldNames);
+				SQLNormalTable *normalTable = static_cast<SQLNormalTable *>(table);
+				normalTable->update(rec, updateFieldNames);
+				if (normalTable->windowDrained()) {
+					refillCacheTable(normalTable);
+				}
 			}
 			else {
-				std::string tableName =
-					static_cast<SQLNormalTableSchema *>(updateRecords->schema())->name();
 				static_cast<SQLJoinTable *>(table)->update(tableName, rec, updateFieldNames);
 			}
 		}
+	}
+}
+
+void SQLContext::updateAggregateTables(SQLTempTable *updateRecords, SQLSchemaVertex *schemaVtx,
+	UpdateOperation mode, SQLExtendRecord *oldRecord, int thIndex)
+{
+	// tables whose MIN/MAX can't be recomputed from the group are read again
+	unordered_set<SQLTable *> staleTables;
+	updateRecords->forEach([&](SQLRecord *rec) {
+		if (mode != UpdateOperation::umInsert) {
+			SQLRecord *removed = rec;
+			if (oldRecord) {
+				oldRecord->setBase(rec);
+				removed = oldRecord;
+			}
+
+			vector<SQLTable *> tables = schemaVtx->findTable(removed, thIndex);
+			for (size_t i = 0; i < tables.size(); ++i) {
+				if (staleTables.count(tables[i]) == 0 &&
+					!static_cast<SQLAggregateTable *>(tables[i])->remove(removed)) {
+					staleTables.insert(tables[i]);
+				}
+			}
+		}
+
+		if (mode != UpdateOperation::umDelete) {
+			vector<SQLTable *> tables = schemaVtx->findTable(rec, thIndex);
+			for (size_t i = 0; i < tables.size(); ++i) {
+				if (staleTables.count(tables[i]) == 0) {
+					static_cast<SQLAggregateTable *>(tables[i])->insert(rec);
+				}
+			}
+		}
 	});
+
+	FOR_EACH(i, staleTables) {
+		refillCacheTable(*i);
+	}
 }
 
 void SQLContext::exchangeUpdateFields(SQLNormalTable &resultTable)
@@ -1300,10 +2153,16 @@ void SQLContext::exchangeUpdateFields(SQLNormalTable &resultTable)
 	for (int i = 0; i < tableSchema->extendFieldCount(); ++i) {
 		const std::string &fieldName = tableSchema->extendField(i)->name();
 		std::string oldFieldName = fieldName.substr(0, fieldName.length() - UPDATE_EXPR_SUFFIX.length());
+		FieldHandle oldHandle = tableSchema->fieldHandle(oldFieldName);
+		FieldHandle newHandle = tableSchema->fieldHandle(fieldName);
+		if (!oldHandle.field) {
+			continue;
+		}
+
 		resultTable.forEach([&](SQLRecord *rec) {
-			MyVariant oldValue = rec->value(oldFieldName);
-			rec->setValue(oldFieldName, rec->value(fieldName));
-			rec->setValue(fieldName, oldValue);
+			MyVariant oldValue = rec->value(oldHandle);
+			rec->setValue(oldHandle, rec->value(newHandle));
+			rec->setValue(newHandle, oldValue);
 		});
 	}
 }
@@ -1366,6 +2225,96 @@ void SQLContext::writeUpdateTable(SQLNormalTable &updateTable, UpdateOperation m
 	buffer->seek(endPos);
 }
 
+void SQLContext::writeInsertTable(MySQLInsertExprListener &listener, MyVariants &params, 
+	int64_t firstID, WriteBuffer *buffer)
+{
+	// same format as writeUpdateTable, records are encoded from insert values directly
+	SQLNormalTableSchema *tableSchema = listener.tableSchema();
+	buffer->writeUByte((uint8_t)UpdateOperation::umInsert);
+	int32_t startPos = buffer->writePos();
+	buffer->writeUInt(0);
+	buffer->writeString(tableSchema->name());
+	buffer->writeUByte(0);
+	buffer->writeUInt(listener.recordCount());
+
+	// field index -> insert value index, -1 means null(or generated pk)
+	int fieldCount = tableSchema->fieldCount();
+	int insertFieldCount = listener.insertFieldCount();
+	vector<int> valueIndexes(fieldCount, -1);
+	for (int j = 0; j < insertFieldCount; ++j) {
+		valueIndexes[tableSchema->fieldIndex(listener.insertField(j)->name())] = j;
+	}
+
+	int pkIndex = tableSchema->fieldIndex(tableSchema->primaryKey()->name());
+	int64_t step = connector()->autoIncrementStep();
+	int paramIndex = 0;
+	vector<MyVariant> values(fieldCount);
+	ByteArray nullBits = ByteArray::from((fieldCount - 1) / 8 + 1);
+	for (int i = 0; i < listener.recordCount(); ++i) {
+		for (int j = 0; j < fieldCount; ++j) {
+			int valueIndex = valueIndexes[j];
+			if (valueIndex == -1) {
+				values[j] = j == pkIndex ? MyVariant(firstID + i * step) : MyVariant();
+				continue;
+			}
+
+			const MyVariant &value = listener.insertValue(i * insertFieldCount + valueIndex);
+			values[j] = value == "?" ? params.variant(paramIndex++) : value;
+		}
+
+		for (int j = 0; j < fieldCount; ++j) {
+			nullBits->setBit(j / 8, j % 8, values[j].isNull() ? 1 : 0);
+		}
+		buffer->writeBytes(nullBits);
+		for (int j = 0; j < fieldCount; ++j) {
+			writeFieldValue(buffer, tableSchema->field(j)->dataType(), values[j]);
+		}
+	}
+
+	int32_t endPos = buffer->writePos();
+	buffer->seek(startPos);
+	buffer->writeUInt(endPos - startPos - 4);
+	buffer->seek(endPos);
+}
+
+void SQLContext::writeFieldValue(WriteBuffer *buffer, DataType dataType, const MyVariant &value)
+{
+	// same encoding as SQLNormalRecord::writeField, null value is written as default
+	bool isNull = value.isNull();
+	switch (dataType)
+	{
+	case DataType::dtBoolean:
+		buffer->writeByte(!isNull && value.toBool() ? 1 : 0);
+		break;
+	case DataType::dtSmallInt:
+		buffer->writeShort(isNull ? 0 : value.toShort());
+		break;
+	case DataType::dtInt:
+		buffer->writeInt(isNull ? 0 : value.toInt());
+		break;
+	case DataType::dtBigInt:
+		buffer->writeLong(isNull ? 0 : value.toInt64());
+		break;
+	case DataType::dtFloat:
+	case DataType::dtDouble:
+		buffer->writeDouble(isNull ? 0 : value.toDouble());
+		break;
+	case DataType::dtString:
+		buffer->writeString(isNull ? string() : value.toString());
+		break;
+	case DataType::dtBlob:
+		if (isNull) {
+			buffer->writeUInt(0);
+		}
+		else {
+			buffer->writeBlock(value.toBlob());
+		}
+		break;
+	default:
+		break;
+	}
+}
+
 SQLTempTable *SQLContext::readUpdateTable(ByteArray data, int thIndex)
 {
 	InputStream in(data);
@@ -1401,6 +2350,8 @@ SQLTempTable *SQLContext::readUpdateTable(ByteArray data, int thIndex)
 		rec->load(in);
 		tableObj->append(rec);
 	}
+	// table is shared by all task threads then
+	tableObj->bindPK();
 
 	return tableObj;
 }
@@ -1561,7 +2512,8 @@ int SQLContext::balanceChooseForSql(const std::string &sql)
 	return isMostBusy(thIndex) ? thIndex + 1:thIndex; // linear probing, thIndex + 1 must not be the most busy
 }
 
-void SQLContext::select(ByteArray sqlBytes, const std::string &sql, WriteBuffer* buffer)
+void SQLContext::select(ByteArray sqlBytes, const std::string &sql, WriteBuffer* buffer,
+	struct bufferevent *client)
 {
 	SQLInfo info;
 	info.sql = sql;
@@ -1569,6 +2521,10 @@ void SQLContext::select(ByteArray sqlBytes, const std::string &sql, WriteBuffer*
 	SelectTaskData data;
 	data.sqlBytes = sqlBytes;
 	data.buffer = buffer;
+	// chunks go to socket directly, so nothing of former replies may be left in output
+	if (client && evbuffer_get_length(bufferevent_get_output(client)) == 0) {
+		data.clientSocket = bufferevent_getfd(client);
+	}
 	buffer->writeUByte(data.errorCode);
 	
 	{
@@ -1587,14 +2543,16 @@ void SQLContext::select(ByteArray sqlBytes, const std::string &sql, WriteBuffer*
 				});
 		}
 	}
-	buffer->seek(0);
-	buffer->writeUByte(data.errorCode);
+	// errorCode has been sent with the first chunk
+	if (!data.streamed) {
+		buffer->seek(0);
+		buffer->writeUByte(data.errorCode);
+	}
 }
 
 void SQLContext::execUpdate(ByteArray sqlBytes, TaskType type, 
 	ByteArray extInfo, WriteBuffer* buffer)
 {
-	int index = balanceChoose();
 	WriteTaskData data;
 	data.sqlBytes = sqlBytes;
 	if (!m_readMode) {
@@ -1608,24 +2566,23 @@ void SQLContext::execUpdate(ByteArray sqlBytes, TaskType type,
 		buffer->writeBytes(extInfo);
 	}
 
-	{
-		std::unique_lock<std::mutex> lk(*m_waitTaskLocks[index]);
-		m_taskQueues[index]->addNewTask(type, &data);
-		bool timeOut = !m_waitTaskConds[index]->wait_for(lk, std::chrono::minutes(MAX_WRITE_TASK_TIME), [&data] {
-			return data.isFinish;
-			});
-
-		if (timeOut) {
-			// discard the index task thread, and create new thread
-			if (!m_readMode) {
-				addTaskThread(index);
-			}
+	int index = balanceChoose();
+	std::unique_lock<std::mutex> lk(*m_waitTaskLocks[index]);
+	m_taskQueues[index]->addNewTask(type, &data);
+	bool timeOut = !m_waitTaskConds[index]->wait_for(lk, std::chrono::minutes(MAX_WRITE_TASK_TIME), [&data] {
+		return data.isFinish;
+		});
 
-			std::unique_lock<std::mutex> lk2(*m_waitTaskLocks[index]);
-			m_waitTaskConds[index]->wait_for(lk2, std::chrono::minutes(MAX_WRITE_TASK_TIME), [&data] {
-				return data.isFinish;
-				});
+	if (timeOut) {
+		// discard the index task thread, and create new thread
+		if (!m_readMode) {
+			addTaskThread(index);
 		}
+
+		std::unique_lock<std::mutex> lk2(*m_waitTaskLocks[index]);
+		m_waitTaskConds[index]->wait_for(lk2, std::chrono::minutes(MAX_WRITE_TASK_TIME), [&data] {
+			return data.isFinish;
+			});
 	}
 
 	buffer->seek(0);
@@ -1642,46 +2599,77 @@ void SQLContext::execUpdate(ByteArray sqlBytes, TaskType type,
 	}	
 }
 
-void SQLContext::syncWrite(ByteArray data)
+void SQLContext::postUpdate(ByteArray sqlBytes, TaskType type, ByteArray extInfo)
 {
-	// Packet Sticky problem exist
-	if (!m_buffer) {
-		InputStream in(data);
-		uint32_t len = in.readUInt();
-		data = data->slice(4);
-		m_buffer = ByteArray::from(len);
-		m_bufferLen = 0;
-	}
+	// event thread doesn't wait, so writes coming in group commit window are read
+	WriteTaskData *data = new WriteTaskData();
+	data->sqlBytes = sqlBytes;
+	data->extInfo = extInfo;
+	Task task;
+	task.type = type;
+	task.data = reinterpret_cast<intptr_t>(data);
 
-	uint32_t toRead = m_buffer->byteLength() - m_bufferLen;
-	if (data->byteLength() <= toRead) {
-		m_buffer->assign(data, m_bufferLen);
-		m_bufferLen += data->byteLength();
-		data.reset();
+	lock_guard<mutex> locker(m_groupLock);
+	m_pendingWrites.push_back(task);
+	if (!m_groupScheduled) {
+		// groups are executed by one task thread in turn
+		m_groupScheduled = true;
+		m_taskQueues[m_threadCnt - 1]->addNewTask(TaskType::ttGroupWrite, nullptr);
 	}
-	else {
-		m_buffer->assign(data->slice(0, toRead), m_bufferLen);
-		m_bufferLen = m_buffer->byteLength();
-		data = data->slice(toRead);
+}
+
+void SQLContext::readFrames(ByteArray data, const std::function<void(ByteArray)> &onFrame)
+{
+	// Packet Sticky problem exist
+	if (m_lengthBytes) {
+		ByteArray joined = ByteArray::from(m_lengthBytes->byteLength() + data->byteLength());
+		joined->assign(m_lengthBytes, (uint32_t)0);
+		joined->assign(data, m_lengthBytes->byteLength());
+		data = joined;
+		m_lengthBytes.reset();
+	}
+
+	uint32_t pos = 0;
+	while (pos < data->byteLength()) {
+		if (!m_buffer) {
+			if (data->byteLength() - pos < 4) {
+				m_lengthBytes = data->slice(pos);
+				break;
+			}
+
+			m_buffer = ByteArray::from(data->getUint32(pos));
+			m_bufferLen = 0;
+			pos += 4;
+		}
+
+		uint32_t count = std::min(m_buffer->byteLength() - m_bufferLen, data->byteLength() - pos);
+		if (count > 0) {
+			m_buffer->assign(ByteArray::directFrom(data->data() + pos, count), m_bufferLen);
+			m_bufferLen += count;
+			pos += count;
+		}
+
+		if (m_bufferLen == m_buffer->byteLength()) {
+			ByteArray frame = m_buffer;
+			m_buffer.reset();
+			onFrame(frame);
+		}
 	}
+}
 
-	if (m_bufferLen == m_buffer->byteLength()) {
+void SQLContext::syncWrite(ByteArray data)
+{
+	readFrames(data, [this](ByteArray frame) {
 		// errorCode(1byte)|updateCount(4byte)|threadIndex(1byte)|taskDataPtr(8byte)|updateData(all left bytes)
-		auto data = reinterpret_cast<WriteTaskData *>(m_buffer->getUint64(6));
-		data->errorCode = m_buffer->getUint8(0);
-		data->updateCount = m_buffer->getInt32(1);
-		int thIndex = m_buffer->getUint8(5);
+		auto data = reinterpret_cast<WriteTaskData *>(frame->getUint64(6));
+		data->errorCode = frame->getUint8(0);
+		data->updateCount = frame->getInt32(1);
+		int thIndex = frame->getUint8(5);
 		if (data->updateCount > 0) {
-			addUpdateCacheTask(m_buffer->slice(14));
+			addUpdateCacheTask(frame->slice(14));
 		}
-
-		m_buffer.reset();
 		setTaskFinish(data, thIndex);
-	}
-
-	if (data) {
-		syncWrite(data);
-	}
+	});
 }
 
 void SQLContext::addUpdateCacheTask(ByteArray input)
@@ -1739,15 +2727,15 @@ bool SQLContext::connect(const std::string &serverAddr)
 		return false;
 	}
 
-	for (int i = 0; i < m_connectors.size(); ++i) {
-		if (!m_connectors[i]->connect(connectStrs[0], connectStrs[1], connectStrs[2], connectStrs[3])) {
-			std::cerr << "connect sql server fail" << std::endl;
-			return false;
-		}
+	if (!m_connectorPool->connect(connectStrs[0], connectStrs[1], connectStrs[2], connectStrs[3],
+		m_threadCnt)) {
+		std::cerr << "connect sql server fail" << std::endl;
+		return false;
 	}
 
 	vector<SQLNormalTableSchema*> tableSchemas;
-	m_connectors[0]->buildAllTableSchemas(tableSchemas);
+	connector()->buildAllTableSchemas(tableSchemas);
+	releaseConnector();
 	for (int i = 0; i < tableSchemas.size(); ++i) {
 		auto tableSchema = tableSchemas[i];
 		m_tableSchemas[tableSchema->name()] = tableSchema;
@@ -1776,10 +2764,23 @@ void SQLContext::executeTask(Task *task, int thIndex)
 	case TaskType::ttSelect:
 	{
 		auto data = reinterpret_cast<SelectTaskData *>(task->data);
-		doSelect(data, thIndex);
+		try {
+			doSelect(data, thIndex);
+		}
+		catch (SQLConnectorException &e) {
+			std::cerr << "Select Error: " << e.what() << std::endl;
+			data->errorCode = SQLCacheErrorCode::scecSqlFail;
+		}
+		// connector is given back before client is waked up
+		releaseConnector();
 		setTaskFinish(data, thIndex);
 		break;
 	}
+	case TaskType::ttGroupWrite:
+	{
+		doGroupWrite(thIndex);
+		break;
+	}
 	case TaskType::ttUpdateCache:
 	{
 		doUpdateCache(reinterpret_cast<UpdateCacheTaskData *>(task->data), thIndex);
@@ -1802,6 +2803,7 @@ void SQLContext::executeTask(Task *task, int thIndex)
 	default:
 		break;
 	}
+	releaseConnector();
 }
 
 bufferevent *SQLContext::sendBuff() const
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <unordered_map>
+#include <list>
+#include <deque>
+#include <functional>
 #include <string>
 #include <thread>
 #include <memory>
@@ -10,6 +13,7 @@
 #include "MyVariant.h"
 #include "ByteArray.h"
 #include "SQLConnectorFactory.h"
+#include "SQLConnectorPool.h"
 #include "SQLGraph.h"
 #include "Task.h"
 
@@ -21,12 +25,20 @@ class SQLJoinTable;
 class SQLTempTable;
 class TaskQueue;
 class SQLExtendRecord;
+class SQLExtendTableSchema;
 class MySQLSelectExprListener;
+class MySQLInsertExprListener;
+class CacheSetting;
 class MySQLExprListener;
 struct bufferevent;
 
+void initSQLContext(CacheSetting *setting);
+
 class SQLContext
 {
+	// tests check pk lists bound to modify statements
+	friend class TableTest;
+
 public:
 	struct SQLInfo
 	{
@@ -37,11 +49,32 @@ public:
 
 	struct SQLTableSchemaInfo
 	{
-		std::string addSql;
 		SQLTableSchema *schema;
 	};
 
+	// UPDATE/DELETE statement compiled once on write node, reused by the same sql
+	struct SQLDMLTemplate
+	{
+		bool cacheable = true;
+		SQLNormalTableSchema *tableSchema = nullptr;
+		// only for UPDATE, select result table schema with f__updateExpr__ fields
+		SQLExtendTableSchema *updateSchema = nullptr;
+		int updateFieldCount = 0;
+		std::string selectSql;
+		// selectSql with FOR UPDATE, captures records to be modified
+		std::string lockSelectSql;
+		// "UPDATE ... WHERE pk" or "DELETE ... WHERE pk", empty if sql has no WHERE
+		std::string modifySql;
+	};
+
 	typedef std::unordered_map <std::string, SQLTableSchemaInfo * > TableSchemaHash;
+	// templates of a write thread by normalized sql, the least recently used one is dropped when it's full
+	struct DMLTemplateCache
+	{
+		// the most recently used first
+		std::list<std::pair<std::string, SQLDMLTemplate *>> lru;
+		std::unordered_map<std::string, std::list<std::pair<std::string, SQLDMLTemplate *>>::iterator> templates;
+	};
 	typedef std::unordered_map <std::string, SQLNormalTableSchema * > NormalTableSchemaHash;
 	typedef std::unordered_map <std::string, uint32_t > TableHash;
 
@@ -65,14 +98,23 @@ public:
 	SQLTable *addCacheTable(SQLTableSchema *schema, int thIndex, uint32_t &tableID);
 	SQLTable *selectCacheTable(const std::string &sql, MyVariants &params,
 		std::vector<int8_t>& paramTypes, int thIndex);
-	void directQuery(const std::string &sql, MyVariants &params,
-		std::vector<int8_t>& paramTypes, int thIndex, WriteBuffer* buffer);
+	// return false if sql fails
+	bool directQuery(const std::string &sql, MyVariants &params,
+		std::vector<int8_t>& paramTypes, WriteBuffer* buffer,
+		const FlushBufferEvent &flush = nullptr);
 
 	SQLTableSchemaInfo *createCacheTableSchema(const std::string &sql, int thIndex);
 
-	void select(ByteArray sqlBytes, const std::string &sql, WriteBuffer *buffer);
+	// client is given to send uncacheable result by chunks
+	void select(ByteArray sqlBytes, const std::string &sql, WriteBuffer *buffer,
+		struct bufferevent *client = nullptr);
 	void execUpdate(ByteArray sqlBytes, TaskType type, ByteArray extInfo, WriteBuffer *buffer);
+	// on write node, write of read node is queued and replied by group task after it's committed
+	void postUpdate(ByteArray sqlBytes, TaskType type, ByteArray extInfo);
 
+	// data read from the other node is split into payloads of length(4byte)|payload frames,
+	// one read may have several frames or a part of one
+	void readFrames(ByteArray data, const std::function<void(ByteArray)> &onFrame);
 	void syncWrite(ByteArray data);
 	void addUpdateCacheTask(ByteArray input);
 	void reset();
@@ -89,12 +131,14 @@ public:
 
 private:
 	void initialize(const std::string& serverAddr);
+	// connector is borrowed from pool by current task thread at first use
+	SQLConnector *connector();
+	void releaseConnector();
 
-	SQLTableSchema *doCreateCacheTableSchema(const std::string &sqlStr, std::string &addSql, 
-		int thIndex);
+	SQLTableSchema *doCreateCacheTableSchema(const std::string &sqlStr, int thIndex);
 
-	SQLTableSchema *createGroupByTableSchema(const std::string &sqlStr, MySQLSelectExprListener *listener, 
-		int thIndex);
+	SQLTableSchema *createGroupByTableSchema(const std::string &sqlStr, std::string &addSql, 
+		MySQLSelectExprListener *listener, int thIndex);
 	SQLTableSchema *createNormalTableSchema(const std::string &sqlStr, std::string &addSql, 
 		MySQLSelectExprListener *listener, int thIndex);
 	SQLTableSchema *createJoinTableSchema(const std::string &sqlStr, std::string &addSql, 
@@ -103,8 +147,23 @@ private:
 	void addFieldVtx(SQLGraph *graph, FieldSchema *field, SQLVertex *schemaVtx, 
 		bool isQuery = true, bool isWhere = false, bool isOrder = false);
 
+	// equal lookup of pk, row is read from db into the only table of schema if it isn't cached
+	SQLTable *selectPointTable(SQLSchemaVertex *schemaVtx, const std::string &sql, 
+		MyVariants &params, std::vector<int8_t> &paramTypes, int thIndex);
+	// read records of cache table from db by load sql of its schema
+	void loadCacheTable(SQLTable *table, std::vector<int8_t> &paramTypes);
+	// reload LIMIT window whose slack records are drained by deletes
+	void refillCacheTable(SQLTable *table);
+	// take records of table from cached table of the same schema whose WHERE range contains its one
+	void fillCacheTable(SQLTable *table, SQLTable *supersetTable, SQLSchemaVertex *schemaVtx);
+
 	void doSelect(SelectTaskData *task, int thIndex);
 	void doWrite(Task *task, int thIndex);
+	void executeWrite(TaskType type, WriteTaskData *data, int thIndex);
+	// take queued writes in group commit window, and reply them to read node
+	void doGroupWrite(int thIndex);
+	// writes of group are committed together, or executed one by one if one of them fails
+	void executeGroupWrite(std::vector<Task> &group, WriteBuffer &reply, int thIndex);
 	void doInsert(WriteTaskData *task, int thIndex);
 	void doRemove(WriteTaskData *task, int thIndex);
 	void doUpdate(WriteTaskData *task, int thIndex);
@@ -117,16 +176,46 @@ private:
 	void setTaskFinish(TaskData *task, int thIndex);
 
 	int strHash(const std::string &sqlStr);
-	void flushAllTableCache(MySQLExprListener *listener, WriteTaskData *task, int thIndex);
+	void flushAllTableCache(SQLNormalTableSchema *tableSchema, WriteTaskData *task, int thIndex);
+
+	SQLDMLTemplate *findDMLTemplate(const std::string &sql, TaskType type, int thIndex);
+	SQLDMLTemplate *compileDMLTemplate(const std::string &sql, TaskType type);
+	// capture records matching sql into resultTable with locking read and modify them by pk, in one
+	// transaction with the capture. return -1 if it fails, then resultTable is empty
+	int captureAndModify(SQLDMLTemplate *dml, SQLNormalTable &resultTable, 
+		const std::string &sql, MyVariants &params, std::vector<int8_t> &paramTypes,
+		const MyVariants &leadParams, const std::vector<int8_t> &leadTypes);
+	// modify records of resultTable by pk, statements are cut under the param limit of prepared statement,
+	// caller runs them in one transaction. params of every statement begin with leadParams. sql itself
+	// is run if it has no WHERE
+	int modifyByPK(SQLDMLTemplate *dml, SQLNormalTable &resultTable, const std::string &sql,
+		const MyVariants &leadParams, const std::vector<int8_t> &leadTypes);
+	// modify statement of count pks from start of pks, pk params are appended to params.
+	// IN list is padded to maxCount at most
+	std::string bindPKModifySql(SQLDMLTemplate *dml, const MyVariants &pks, const std::vector<int8_t> &pkTypes,
+		int start, int count, int maxCount, MyVariants &params, std::vector<int8_t> &paramTypes);
+	// "pk" or "(pk1,pk2)" of composite pk, fields are qualified by tableName if it isn't empty
+	std::string pkColumns(SQLNormalTableSchema *tableSchema, const std::string &tableName = std::string());
+	// "?" or "(?,?)" of composite pk
+	std::string pkPlaceholder(SQLNormalTableSchema *tableSchema);
+	void addPKParams(SQLNormalTableSchema *tableSchema, SQLRecord *rec, MyVariants &params,
+		std::vector<int8_t> &paramTypes);
+	std::string normalizeSql(const std::string &sql);
 
 	void updateAffectedCacheTable(UpdateCacheTaskData *task, int thIndex);
+	// apply changed records to groups of aggregate tables
+	void updateAggregateTables(SQLTempTable *updateRecords, SQLSchemaVertex *schemaVtx,
+		UpdateOperation mode, SQLExtendRecord *oldRecord, int thIndex);
 
 	void findEffectedCacheTable(FieldSchema *updateField, SQLGraph *graph, 
 		std::unordered_map<SQLSchemaVertex *, uint8_t> &tableSchemas);
 
-	void insertJoinTableRecord(SQLJoinTable *joinTable, const std::string &tableName, 
-		std::shared_ptr<Condition> condition, SQLRecord *rec, MyVariants &params,
-		SQLConnector &connector);
+	// join inserted records of a table with records of other tables
+	void insertJoinTableRecords(SQLJoinTable *joinTable, const std::string &tableName, 
+		std::shared_ptr<Condition> condition, std::vector<SQLRecord *> &recs, SQLConnector &connector);
+	// join rec with cached records of other tables, false if they must be read from db
+	bool probeJoinTableRecord(SQLJoinTable *joinTable, int sourceIndex, 
+		std::shared_ptr<Condition> condition, SQLRecord *rec, MyVariants &params);
 
 	void insertUpdateRecords(SQLTempTable *updateRecords, SQLSchemaVertex *schemaVtx, int thIndex);
 	void deleteUpdateRecords(SQLTempTable *updateRecords, SQLSchemaVertex *schemaVtx, int thIndex,
@@ -140,6 +229,10 @@ private:
 	bool send(WriteBuffer *buffer, uint32_t offset = 0);
 
 	void writeUpdateTable(SQLNormalTable &updateTable, UpdateOperation mode, WriteBuffer* buffer);
+	// inserted records are encoded without building record memory
+	void writeInsertTable(MySQLInsertExprListener &listener, MyVariants &params, int64_t firstID,
+		WriteBuffer *buffer);
+	static void writeFieldValue(WriteBuffer *buffer, DataType dataType, const MyVariant &value);
 	SQLTempTable *readUpdateTable(ByteArray data, int thIndex);
 
 	int balanceChooseForSql(const std::string& sql);
@@ -168,8 +261,13 @@ private:
 
 	NormalTableSchemaHash m_tableSchemas;
 	TableSchemaHash *m_cacheTableSchemas;
+	DMLTemplateCache *m_dmlTemplates;
 
-	std::vector<SQLConnector *> m_connectors;
+	SQLConnectorPool *m_connectorPool;
+	// writes of read node waiting for group task, only one group task is queued at a time
+	std::deque<Task> m_pendingWrites;
+	bool m_groupScheduled;
+	std::mutex m_groupLock;
 
 	bool m_readMode;
 	bool m_enableMonitor;
@@ -181,5 +279,7 @@ private:
 
 	ByteArray m_buffer;
 	uint32_t m_bufferLen;
+	// length of frame split by the last read
+	ByteArray m_lengthBytes;
 	uint8_t m_lockIndex;
 };
@@ -8,6 +8,10 @@
 
 using namespace std;
 
+// rows kept by point lookup table, and missing keys remembered
+const size_t POINT_TABLE_CAPACITY = 1 << 16;
+const size_t MISSING_KEY_CAPACITY = 1 << 16;
+
 const int BIT_Query = 0;
 const int BIT_WHERE = 1;
 const int BIT_ORDER = 2;
@@ -94,7 +98,8 @@ ConstCondition::ConstCondition(FieldSchema *leftField, int32_t startParamId, int
 	SimpleCondition(op),
 	m_leftField(leftField),
 	m_startParamId(startParamId),
-	m_endParamId(endParamId)
+	m_endParamId(endParamId),
+	m_leftAccessor(leftField->name(), leftField->tableName())
 {
 	m_comparator = BinaryCompareOperator::buildOperator(op);
 }
@@ -118,14 +123,14 @@ ConditionKind ConstCondition::kind()
 	return ConditionKind::ckConst;
 }
 
-bool ConstCondition::match(SQLRecord *rec, MyVariants &params)
+bool ConstCondition::match(SQLRecord *rec, const MyVariants &params)
 {
-	if (static_cast<SQLNormalTable *>(rec->table())->name() != m_leftField->tableName()) {
+	if (!m_leftAccessor.inTable(rec)) {
 		return true;
 	}
 
 	if (m_startParamId == m_endParamId) {
-		return m_comparator->compare(rec->value(m_leftField->name()), 
+		return m_comparator->compare(m_leftAccessor.value(rec), 
 			params.variant(m_startParamId));
 	}
 	else {
@@ -134,14 +139,14 @@ bool ConstCondition::match(SQLRecord *rec, MyVariants &params)
 			v.add(params.variant(i));
 		}
 
-		return m_comparator->compare(rec->value(m_leftField->name()), v);
+		return m_comparator->compare(m_leftAccessor.value(rec), v);
 	}
 }
 
 void ConstCondition::toString(std::string &result, SQLRecord *joinTableRec,
 	std::vector<int16_t>& paramIndex)
 {
-	if (static_cast<SQLNormalTable *>(joinTableRec->table())->name() == m_leftField->tableName()) {
+	if (joinTableRec && static_cast<SQLNormalTable *>(joinTableRec->table())->name() == m_leftField->tableName()) {
 		result.append("TRUE");
 		return;
 	}
@@ -150,7 +155,7 @@ void ConstCondition::toString(std::string &result, SQLRecord *joinTableRec,
 		paramIndex.push_back(i);
 	}
 
-	StrUtils::append(result, m_leftField->name(), " ", op(), " ");
+	StrUtils::append(result, m_leftField->tableName(), ".", m_leftField->name(), " ", op(), " ");
 	if (op() == OP_EQUAL) {
 		result.append("?");
 	}
@@ -174,11 +179,18 @@ FieldSchema *ConstCondition::leftField() const
 	return m_leftField;
 }
 
+const MyVariant ConstCondition::leftValue(SQLRecord *rec)
+{
+	return m_leftAccessor.value(rec);
+}
+
 FieldCondition::FieldCondition(FieldSchema *leftField, FieldSchema *rightField,
 	const std::string &op) :
 	SimpleCondition(op),
 	m_leftField(leftField),
-	m_rightField(rightField)
+	m_rightField(rightField),
+	m_leftAccessor(leftField->name()),
+	m_rightAccessor(rightField->name())
 {
 	m_comparator = BinaryCompareOperator::buildOperator(op);
 }
@@ -192,10 +204,10 @@ ConditionKind FieldCondition::kind()
 	return ConditionKind::ckField;
 }
 
-bool FieldCondition::match(SQLRecord *rec, MyVariants &params)
+bool FieldCondition::match(SQLRecord *rec, const MyVariants &/*params*/)
 {
 	if (m_leftField->tableName() == m_rightField->tableName()) {
-		return m_comparator->compare(rec->value(m_leftField->name()), rec->value(m_rightField->name()));
+		return m_comparator->compare(m_leftAccessor.value(rec), m_rightAccessor.value(rec));
 	}
 	else {
 		return true;
@@ -203,23 +215,24 @@ bool FieldCondition::match(SQLRecord *rec, MyVariants &params)
 }
 
 void FieldCondition::toString(std::string &result, SQLRecord *joinTableRec,
-	std::vector<int16_t>& paramIndex)
+	std::vector<int16_t>& /*paramIndex*/)
 {
-	std::string joinTableName = static_cast<SQLNormalTable *>(joinTableRec->table())->normalSchema()->name();
+	std::string joinTableName = joinTableRec ? 
+		static_cast<SQLNormalTable *>(joinTableRec->table())->normalSchema()->name() : std::string();
 	if (m_leftField->tableName() == joinTableName) {
 		result.append(joinTableRec->strValue(m_leftField->name()));
 	}
 	else {
-		result.append(m_leftField->name());
+		StrUtils::append(result, m_leftField->tableName(), ".", m_leftField->name());
 	}
 
-	result.append(" ").append(op());
+	result.append(" ").append(op()).append(" ");
 
 	if (m_rightField->tableName() == joinTableName) {
 		result.append(joinTableRec->strValue(m_rightField->name()));
 	}
 	else {
-		result.append(m_rightField->name());
+		StrUtils::append(result, m_rightField->tableName(), ".", m_rightField->name());
 	}
 }
 
@@ -262,6 +275,11 @@ void Condition::setOp(const std::string &op)
 	m_op = StrUtils::toUpper(op);
 }
 
+bool Condition::isConjunction()
+{
+	return true;
+}
+
 BinaryCondition::BinaryCondition(const std::string &op) :
 	Condition(op),
 	m_left(nullptr),
@@ -307,7 +325,7 @@ void BinaryCondition::setRight(Condition *condition)
 	m_right = condition;
 }
 
-bool BinaryCondition::match(SQLRecord *rec, MyVariants &params)
+bool BinaryCondition::match(SQLRecord *rec, const MyVariants &params)
 {
 	if (op() == OP_AND) {
 		return m_left->match(rec, params) && m_right->match(rec, params);
@@ -329,6 +347,11 @@ void BinaryCondition::toString(std::string &result, SQLRecord *joinTableRec,
 	result.append(")");
 }
 
+bool BinaryCondition::isConjunction()
+{
+	return StrUtils::toUpper(op()) == OP_AND && m_left->isConjunction() && m_right->isConjunction();
+}
+
 SQLVertex::SQLVertex()
 {
 }
@@ -340,8 +363,10 @@ SQLVertex::~SQLVertex()
 SQLSchemaVertex::SQLSchemaVertex(SQLTableSchema *schema) :
 	SQLVertex(),
 	m_schema(schema),
+	m_predicate(nullptr),
 	m_indexCondition(nullptr),
-	m_index(nullptr)
+	m_index(nullptr),
+	m_compositeIndex(nullptr)
 {
 }
 
@@ -350,6 +375,14 @@ SQLSchemaVertex::~SQLSchemaVertex()
 	if (m_index) {
 		delete m_index;
 	}
+
+	if (m_compositeIndex) {
+		delete m_compositeIndex;
+	}
+
+	if (m_predicate) {
+		delete m_predicate;
+	}
 }
 
 VertexType SQLSchemaVertex::type()
@@ -375,29 +408,114 @@ std::shared_ptr<Condition> SQLSchemaVertex::condition() const
 void SQLSchemaVertex::setCondition(std::shared_ptr<Condition> c)
 {
 	m_where = c;
-	if (m_where) {
+	if (m_predicate) {
+		delete m_predicate;
+	}
+	m_predicate = m_where ? new SQLPredicate(m_where.get()) : nullptr;
+	// point lookup has only one table
+	if (m_where && !m_schema->isPointLookup()) {
 		buildIndexCondition();
 	}
 }
 
+SQLPredicate *SQLSchemaVertex::predicate() const
+{
+	return m_predicate;
+}
+
 void SQLSchemaVertex::addTable(SQLTable *table, uint32_t tableId, int thIndex)
 {
+	auto i = m_tables.find(table->params());
+	if (i != m_tables.end()) {
+		// params are cached again, the older table is replaced
+		removeTable(i->second);
+	}
+
 	if (m_indexCondition) {
 		addTableToIndex(table, tableId, thIndex);
 	}
 	
-	m_tables[table->params()] = tableId;
+	i = m_tables.emplace(table->params(), tableId).first;
+	m_tableParams[tableId] = &i->first;
 }
 
 void SQLSchemaVertex::clearTable(int thIndex)
 {
+	// cleared before removing, remove events of tables find nothing
+	std::unordered_map<MyVariants, uint32_t> tables;
+	tables.swap(m_tables);
+	m_tableParams.clear();
+	m_pointKeys.clear();
+	m_pointKeyPos.clear();
+	m_missingKeys.clear();
+	if (m_compositeIndex) {
+		m_compositeIndex->clear();
+	}
+	else if (m_indexCondition) {
+		m_index->clear();
+	}
+
 	SQLTableContainer *container = SQLTableContainer::instance(thIndex);
-	FOR_EACH(i, m_tables) {
+	FOR_EACH(i, tables) {
 		container->removeTable(i->second);
 	}
-	m_tables.clear();
+}
+
+void SQLSchemaVertex::removeTable(uint32_t tableId)
+{
+	auto p = m_tableParams.find(tableId);
+	if (p == m_tableParams.end()) {
+		return;
+	}
+
+	const MyVariants *params = p->second;
 	if (m_indexCondition) {
-		m_index->clear();
+		removeTableFromIndex(*params, tableId);
+	}
+	m_tableParams.erase(p);
+	// params are the key, erased last
+	m_tables.erase(m_tables.find(*params));
+	// the only table of point lookup
+	if (m_schema->isPointLookup()) {
+		m_pointKeys.clear();
+		m_pointKeyPos.clear();
+	}
+}
+
+bool SQLSchemaVertex::isMissingKey(int64_t key) const
+{
+	return m_missingKeys.find(key) != m_missingKeys.end();
+}
+
+void SQLSchemaVertex::addMissingKey(int64_t key)
+{
+	// forgotten all at once, they are read again at worst
+	if (m_missingKeys.size() >= MISSING_KEY_CAPACITY) {
+		m_missingKeys.clear();
+	}
+	m_missingKeys.insert(key);
+}
+
+void SQLSchemaVertex::removeMissingKey(int64_t key)
+{
+	m_missingKeys.erase(key);
+}
+
+void SQLSchemaVertex::addPointKey(SQLNormalTable *table, int64_t key)
+{
+	auto i = m_pointKeyPos.find(key);
+	if (i != m_pointKeyPos.end()) {
+		// row of a deleted key is read again, it's the newest one
+		m_pointKeys.splice(m_pointKeys.end(), m_pointKeys, i->second);
+		return;
+	}
+
+	m_pointKeyPos[key] = m_pointKeys.insert(m_pointKeys.end(), key);
+	// keys of deleted rows are still in queue, evicting them removes nothing
+	while (m_pointKeys.size() > POINT_TABLE_CAPACITY) {
+		table->removeByPK(m_pointKeys.front());
+		m_pointKeyPos.erase(m_pointKeys.front());
+		m_pointKeys.pop_front();
 	}
 }
 
@@ -413,7 +531,7 @@ SQLTable *SQLSchemaVertex::findTable(const MyVariants &key, int thIndex)
 		SQLTable *tbl = SQLTableContainer::instance(thIndex)->getTable(i->second);
 		if (!tbl) {
 			// is free for out of memory
-			m_tables.erase(i);
+			removeTable(i->second);
 		}
 		return tbl;
 	}
@@ -421,36 +539,56 @@ SQLTable *SQLSchemaVertex::findTable(const MyVariants &key, int thIndex)
 	return nullptr;
 }
 
-std::vector<SQLTable *> SQLSchemaVertex::findTable(SQLRecord *rec, int thIndex)
+SQLTable *SQLSchemaVertex::findSupersetTable(const MyVariants &params, int thIndex)
 {
-	vector<SQLTable *> result;
-	if (!m_indexCondition) {
-		FOR_EACH(i, m_tables) {
-			SQLTable *tbl = SQLTableContainer::instance(thIndex)->getTable(i->second);
+	// only WHERE of the single indexed condition is comparable by params,
+	// LIMIT window and groups don't keep every record of their range
+	if (!m_indexCondition || m_where.get() != m_indexCondition || m_schema->kind() != TableKind::tkNormal ||
+		m_schema->isGroupBy() || m_schema->limitCount() >= 0) {
+		return nullptr;
+	}
+
+	// a superset contains the first bound of range, so only tables found by it in index are checked.
+	// a table of the same open range misses it, but that one is found by params before
+	int s = m_indexCondition->startParamID();
+	if (s >= params.count() || params.variant(s).isNull()) {
+		return nullptr;
+	}
+
+	vector<uint32_t> candidates = m_index->find(params.variant(s));
+	FOR_EACH(id, candidates) {
+		auto p = m_tableParams.find(*id);
+		if (p != m_tableParams.end() && containsRange(*p->second, params)) {
+			SQLTable *tbl = SQLTableContainer::instance(thIndex)->getTable(*id);
 			if (tbl) {
-				result.push_back(tbl);
+				return tbl;
 			}
 		}
 	}
 
-	if (!m_where) {
-		return result;
-	}
+	return nullptr;
+}
 
-	if (m_indexCondition) {
+std::vector<SQLTable *> SQLSchemaVertex::findTable(SQLRecord *rec, int thIndex)
+{
+	vector<SQLTable *> result;
+	SQLTableContainer *container = SQLTableContainer::instance(thIndex);
+	// rows of point lookup are synchronized by pk
+	bool matchAll = !m_where || m_schema->isPointLookup();
+	if (!matchAll && m_indexCondition) {
 		vector<uint32_t> srcTables = findTableByIndex(rec);
 		for (int i = 0; i < srcTables.size(); ++i) {
-			SQLTable* srcTable = SQLTableContainer::instance(thIndex)->getTable(srcTables[i]);
-			if (srcTable && m_where->match(rec, srcTable->params())) {
+			SQLTable* srcTable = container->getTable(srcTables[i]);
+			if (srcTable && m_predicate->match(rec, *m_tableParams[srcTables[i]])) {
 				result.push_back(srcTable);
 			}
 		}
 	}
 	else {
-		for (int i = result.size() - 1; i >= 0; --i) {
-			SQLTable* curTable = result[i];
-			if (!m_where->match(rec, curTable->params())) {
-				result.erase(result.begin() + i);
+		FOR_EACH(i, m_tables) {
+			SQLTable *tbl = container->getTable(i->second);
+			if (tbl && (matchAll || m_predicate->match(rec, i->first))) {
+				result.push_back(tbl);
 			}
 		}
 	}
@@ -458,32 +596,120 @@ std::vector<SQLTable *> SQLSchemaVertex::findTable(SQLRecord *rec, int thIndex)
 	return result;
 }
 
-void SQLSchemaVertex::buildIndexCondition()
-{
-	innerBuildIndexCondition(m_where.get());
-	if (m_indexCondition) {
-		if (m_indexCondition->op() == OP_EQUAL) {
-			m_index = SQLTableIndexFactory::createIndex(TableIndexKind::tikEqual);
+std::vector<TableMatch> SQLSchemaVertex::findTable(uint32_t count, const BatchRecordGetter &record, int thIndex)
+{
+	vector<TableMatch> result;
+	bool matchAll = !m_where || m_schema->isPointLookup();
+	// candidate records of each indexed table, tables not indexed check all records
+	vector<uint32_t> tableIds;
+	unordered_map<uint32_t, vector<uint32_t>> candidates;
+	if (!matchAll && m_indexCondition) {
+		for (uint32_t i = 0; i < count; ++i) {
+			vector<uint32_t> ids = findTableByIndex(record(i));
+			FOR_EACH(id, ids) {
+				vector<uint32_t> &recs = candidates[*id];
+				if (recs.empty()) {
+					tableIds.push_back(*id);
+				}
+				recs.push_back(i);
+			}
+		}
+	}
+	else {
+		FOR_EACH(i, m_tables) {
+			tableIds.push_back(i->second);
+		}
+	}
+
+	PredicateBatch batch;
+	if (!matchAll && !tableIds.empty()) {
+		batch = m_predicate->decode(count, record);
+	}
+
+	// tables not indexed select all records
+	vector<uint32_t> allRows;
+	if (matchAll || !m_indexCondition) {
+		for (uint32_t i = 0; i < count; ++i) {
+			allRows.push_back(i);
 		}
-		else if (m_indexCondition->op() == OP_GREATER) {
-			m_index = SQLTableIndexFactory::createIndex(TableIndexKind::tikGreater);
+	}
+
+	SQLTableContainer *container = SQLTableContainer::instance(thIndex);
+	FOR_EACH(id, tableIds) {
+		if (!container->getTable(*id)) {
+			continue;
 		}
-		else if (m_indexCondition->op() == OP_GREATER_EQUAL) {
-			m_index = SQLTableIndexFactory::createIndex(TableIndexKind::tikGreaterEqual);
+
+		TableMatch match;
+		match.tableId = *id;
+		const vector<uint32_t> &rows = allRows.empty() ? candidates[*id] : allRows;
+		if (matchAll) {
+			match.records = rows;
 		}
-		else if (m_indexCondition->op() == OP_LESS) {
-			m_index = SQLTableIndexFactory::createIndex(TableIndexKind::tikLess);
+		else {
+			m_predicate->match(batch, *m_tableParams[*id], rows, match.records);
 		}
-		else if (m_indexCondition->op() == OP_LESS_EQUAL) {
-			m_index = SQLTableIndexFactory::createIndex(TableIndexKind::tikLessEqual);
+
+		if (!match.records.empty()) {
+			result.push_back(std::move(match));
 		}
-		else if (m_indexCondition->op() == OP_BETWEEN) {
-			m_index = SQLTableIndexFactory::createIndex(TableIndexKind::tikBetween);
+	}
+
+	return result;
+}
+
+void SQLSchemaVertex::buildIndexCondition()
+{
+	ConstCondition *range = nullptr;
+	vector<ConstCondition *> equals;
+	innerBuildIndexCondition(m_where.get(), equals, range);
+	// equal conditions are the key of composite index, range or the first equal one is indexed under the key
+	if (range) {
+		m_indexCondition = range;
+	}
+	else if (!equals.empty()) {
+		m_indexCondition = equals.front();
+		equals.erase(equals.begin());
+	}
+
+	if (!m_indexCondition) {
+		return;
+	}
+
+	// key and indexed value are read from the same record
+	FOR_EACH(i, equals) {
+		if ((*i)->leftField()->tableName() == m_indexCondition->leftField()->tableName()) {
+			m_keyConditions.push_back(*i);
 		}
 	}
+
+	TableIndexKind kind = TableIndexKind::tikEqual;
+	if (m_indexCondition->op() == OP_GREATER) {
+		kind = TableIndexKind::tikGreater;
+	}
+	else if (m_indexCondition->op() == OP_GREATER_EQUAL) {
+		kind = TableIndexKind::tikGreaterEqual;
+	}
+	else if (m_indexCondition->op() == OP_LESS) {
+		kind = TableIndexKind::tikLess;
+	}
+	else if (m_indexCondition->op() == OP_LESS_EQUAL) {
+		kind = TableIndexKind::tikLessEqual;
+	}
+	else if (m_indexCondition->op() == OP_BETWEEN) {
+		kind = TableIndexKind::tikBetween;
+	}
+
+	if (m_keyConditions.empty()) {
+		m_index = SQLTableIndexFactory::createIndex(kind);
+	}
+	else {
+		m_compositeIndex = new SQLTableCompositeIndex(kind);
+	}
 }
 
-void SQLSchemaVertex::innerBuildIndexCondition(Condition *cond)
+void SQLSchemaVertex::innerBuildIndexCondition(Condition *cond, std::vector<ConstCondition *> &equals, 
+	ConstCondition *&range)
 {
 	if (cond->kind() == ConditionKind::ckBinary) {
 		BinaryCondition *bCond = static_cast<BinaryCondition *>(cond);
@@ -491,8 +717,8 @@ void SQLSchemaVertex::innerBuildIndexCondition(Condition *cond)
 			return;
 		}
 
-		innerBuildIndexCondition(bCond->left());
-		innerBuildIndexCondition(bCond->right());
+		innerBuildIndexCondition(bCond->left(), equals, range);
+		innerBuildIndexCondition(bCond->right(), equals, range);
 	}
 	else if (cond->kind() == ConditionKind::ckConst) {
 		ConstCondition *condition = static_cast<ConstCondition *>(cond);
@@ -500,40 +726,118 @@ void SQLSchemaVertex::innerBuildIndexCondition(Condition *cond)
 		if (dt == DataType::dtInt || dt == DataType::dtSmallInt || dt == DataType::dtBigInt
 			|| dt == DataType::dtString) {
 			if (cond->op() == OP_EQUAL) {
-				if (!m_indexCondition || m_indexCondition->op() != OP_EQUAL) {
-					m_indexCondition = condition;
-				}
+				equals.push_back(condition);
 			}
 			else if (cond->op() == OP_LESS || cond->op() == OP_LESS_EQUAL 
 				|| cond->op() == OP_GREATER || cond->op() == OP_GREATER_EQUAL) {
-				if (!m_indexCondition || m_indexCondition->op() == OP_BETWEEN) {
-					m_indexCondition = condition;
+				if (!range || range->op() == OP_BETWEEN) {
+					range = condition;
 				}
 			}
 			else if (cond->op() == OP_BETWEEN) {
-				if (!m_indexCondition) {
-					m_indexCondition = condition;
+				if (!range) {
+					range = condition;
 				}
 			}
 		}
 	}
 }
 
+bool SQLSchemaVertex::containsRange(const MyVariants &tableParams, const MyVariants &params) const
+{
+	int s = m_indexCondition->startParamID();
+	int e = m_indexCondition->endParamID();
+	if (tableParams.count() != params.count() || e >= params.count()) {
+		return false;
+	}
+
+	const std::string &op = m_indexCondition->op();
+	if (op == OP_GREATER || op == OP_GREATER_EQUAL) {
+		return tableParams.variant(s) <= params.variant(s);
+	}
+	else if (op == OP_LESS || op == OP_LESS_EQUAL) {
+		return params.variant(s) <= tableParams.variant(s);
+	}
+	else if (op == OP_BETWEEN) {
+		return tableParams.variant(s) <= params.variant(s) && params.variant(e) <= tableParams.variant(e);
+	}
+
+	// every value of IN list is in the list of table
+	for (int i = s; i <= e; ++i) {
+		bool found = false;
+		for (int j = s; j <= e && !found; ++j) {
+			found = tableParams.variant(j) == params.variant(i);
+		}
+
+		if (!found) {
+			return false;
+		}
+	}
+	return true;
+}
+
 std::vector<uint32_t> SQLSchemaVertex::findTableByIndex(SQLRecord *rec)
 {
-	return m_index->find(rec->value(m_indexCondition->leftField()->name()));
+	if (m_compositeIndex) {
+		MyVariants key;
+		FOR_EACH(i, m_keyConditions) {
+			key.add((*i)->leftValue(rec));
+		}
+		return m_compositeIndex->find(key, m_indexCondition->leftValue(rec));
+	}
+
+	return m_index->find(m_indexCondition->leftValue(rec));
 }
 
 void SQLSchemaVertex::addTableToIndex(SQLTable *table, uint32_t tableId, int thIndex)
 {
+	SQLTableIndex *index = m_index;
+	if (m_compositeIndex) {
+		MyVariants key;
+		FOR_EACH(i, m_keyConditions) {
+			key.add(table->params().variant((*i)->startParamID()));
+		}
+		index = m_compositeIndex->subIndex(key);
+	}
+
 	int s = m_indexCondition->startParamID();
 	int e = m_indexCondition->endParamID();
 	if (m_indexCondition->op() == OP_BETWEEN) {
-		m_index->add(table->params().variant(s), table->params().variant(e), tableId);
+		index->add(table->params().variant(s), table->params().variant(e), tableId);
 	}
 	else {
 		for (int i = s; i <= e; ++i) {
-			m_index->add(table->params().variant(i), tableId);
+			index->add(table->params().variant(i), tableId);
+		}
+	}
+}
+
+void SQLSchemaVertex::removeTableFromIndex(const MyVariants &params, uint32_t tableId)
+{
+	int s = m_indexCondition->startParamID();
+	int e = m_indexCondition->endParamID();
+	bool isBetween = m_indexCondition->op() == OP_BETWEEN;
+	if (m_compositeIndex) {
+		MyVariants key;
+		FOR_EACH(i, m_keyConditions) {
+			key.add(params.variant((*i)->startParamID()));
+		}
+
+		if (isBetween) {
+			m_compositeIndex->remove(key, params.variant(s), params.variant(e), tableId);
+		}
+		else {
+			for (int i = s; i <= e; ++i) {
+				m_compositeIndex->remove(key, params.variant(i), tableId);
+			}
+		}
+	}
+	else if (isBetween) {
+		m_index->remove(params.variant(s), params.variant(e), tableId);
+	}
+	else {
+		for (int i = s; i <= e; ++i) {
+			m_index->remove(params.variant(i), tableId);
 		}
 	}
 }
@@ -776,6 +1080,8 @@ AggregateConstCondition::AggregateConstCondition(FieldSchema *leftField, Aggrega
 	ConstCondition(leftField, paramId, paramId, op),
 	m_leftFunc(func)
 {
+	// HAVING is matched with aggregate value of group, not the db field
+	m_leftAccessor = FieldAccessor(aggregateName());
 }
 
 AggregateConstCondition::~AggregateConstCondition()
@@ -787,17 +1093,32 @@ ConditionKind AggregateConstCondition::kind()
 	return ConditionKind::ckAggregateConst;
 }
 
+bool AggregateConstCondition::match(SQLRecord *rec, const MyVariants &params)
+{
+	return m_comparator->compare(m_leftAccessor.value(rec), params.variant(m_startParamId));
+}
+
 AggregateFunction AggregateConstCondition::leftFunction() const
 {
 	return m_leftFunc;
 }
 
+std::string AggregateConstCondition::aggregateName() const
+{
+	return StrUtils::join(HAVING_AGGREGATE_SUFFIX, functionStr(m_leftFunc),
+		SUFFIX_SEPARATOR, m_leftField->name());
+}
+
 AggregateFieldCondition::AggregateFieldCondition(FieldSchema *leftField, FieldSchema *rightField, 
 	const std::string &op, AggregateFunction leftFunc, AggregateFunction rightFunc) :
 	FieldCondition(leftField, rightField, op),
 	m_leftFunc(leftFunc),
 	m_rightFunc(rightFunc)
 {
+	m_leftAccessor = FieldAccessor(aggregateName(true));
+	if (m_rightFunc != AggregateFunction::gfUnknown) {
+		m_rightAccessor = FieldAccessor(aggregateName(false));
+	}
 }
 
 AggregateFieldCondition::~AggregateFieldCondition()
@@ -820,6 +1141,11 @@ AggregateFunction AggregateFieldCondition::rightFunction() const
 }
 
 std::string AggregateFieldCondition::sqlFieldName(bool left)
+{
+	return aggregateName(left);
+}
+
+std::string AggregateFieldCondition::aggregateName(bool left) const
 {
 	if (left) {
 		return StrUtils::join(HAVING_AGGREGATE_SUFFIX, functionStr(m_leftFunc),
@@ -2,12 +2,16 @@
 
 #include "SQLTableSchema.h"
 #include "SQLTableIndex.h"
+#include "SQLPredicate.h"
 #include <memory>
+#include <list>
+#include <unordered_set>
 
 class SimpleCondition;
 class Condition;
 class ConstCondition;
 class SQLTable;
+class SQLNormalTable;
 class SQLEdge;
 class SQLRecord;
 
@@ -55,6 +59,13 @@ private:
 	FieldSchema *m_fieldSchema;
 };
 
+// records of a batch matched by one cache table, indexes of batch in order
+struct TableMatch
+{
+	uint32_t tableId;
+	std::vector<uint32_t> records;
+};
+
 class SQLSchemaVertex : public SQLVertex
 {
 public:
@@ -68,26 +79,56 @@ public:
 
 	std::shared_ptr<Condition> condition() const;
 	void setCondition(std::shared_ptr<Condition> c);
+	// WHERE compiled for matching records, null if there is no WHERE
+	SQLPredicate *predicate() const;
 
 	void addTable(SQLTable *table, uint32_t tableId, int thIndex);
 	void clearTable(int thIndex);
+	// table is dropped from container, called by its remove event
+	void removeTable(uint32_t tableId);
 
 	int tableCount() const;
 	std::vector<SQLTable *> findTable(SQLRecord *rec, int thIndex);
+	// tables of count records at once, fields of WHERE are decoded once for the batch
+	std::vector<TableMatch> findTable(uint32_t count, const BatchRecordGetter &record, int thIndex);
 	SQLTable *findTable(const MyVariants &key, int thIndex);
+	// cached table whose range of WHERE contains the one of params, null if containment isn't provable
+	SQLTable *findSupersetTable(const MyVariants &params, int thIndex);
+
+	// looked up keys of point lookup which aren't in db, they aren't read again until inserted
+	bool isMissingKey(int64_t key) const;
+	void addMissingKey(int64_t key);
+	void removeMissingKey(int64_t key);
+	// row of key is read into point lookup table, the oldest rows are evicted when table is full
+	void addPointKey(SQLNormalTable *table, int64_t key);
 
 private:
 	void buildIndexCondition();
-	void innerBuildIndexCondition(Condition *cond);
+	// collect conditions joined by AND which can be indexed
+	void innerBuildIndexCondition(Condition *cond, std::vector<ConstCondition *> &equals, ConstCondition *&range);
+	// records matching index condition with tableParams include all ones matching it with params
+	bool containsRange(const MyVariants &tableParams, const MyVariants &params) const;
 	std::vector<uint32_t> findTableByIndex(SQLRecord *rec);
 	void addTableToIndex(SQLTable *table, uint32_t tableId, int thIndex);
+	void removeTableFromIndex(const MyVariants &params, uint32_t tableId);
 
 private:
 	SQLTableSchema *m_schema;
 	std::shared_ptr<Condition> m_where;
+	SQLPredicate *m_predicate;
+	// the range or the first equal condition of WHERE
 	ConstCondition *m_indexCondition;
 	SQLTableIndex *m_index;
+	// other equal conditions on fields of the same table, key of composite index
+	std::vector<ConstCondition *> m_keyConditions;
+	SQLTableCompositeIndex *m_compositeIndex;
 	std::unordered_map<MyVariants, uint32_t> m_tables;
+	// table id -> its params, the key of m_tables
+	std::unordered_map<uint32_t, const MyVariants *> m_tableParams;
+	// keys of rows read into point lookup table, the oldest first, a key read again is moved to the end
+	std::list<int64_t> m_pointKeys;
+	std::unordered_map<int64_t, std::list<int64_t>::iterator> m_pointKeyPos;
+	std::unordered_set<int64_t> m_missingKeys;
 };
 
 class RelationUtils
@@ -235,16 +276,19 @@ class Condition
 {
 public:
 	Condition(const std::string &op);
-	~Condition();
+	virtual ~Condition();
 
 	virtual ConditionKind kind() = 0;
 
 	const std::string &op() const;
 	void setOp(const std::string &op);
 
-	virtual bool match(SQLRecord *rec, MyVariants &params) = 0;
+	virtual bool match(SQLRecord *rec, const MyVariants &params) = 0;
+	// fields of joinTableRec's table are replaced by its values, nothing is replaced if it's null
 	virtual void toString(std::string &result, SQLRecord *joinTableRec, 
 		std::vector<int16_t> &paramIndex) = 0;
+	// whether condition is simple conditions joined by AND
+	virtual bool isConjunction();
 private:
 	std::string m_op;
 	std::string m_expr;
@@ -257,9 +301,10 @@ public:
 	virtual ~BinaryCondition();
 
 	ConditionKind kind() override;
-	bool match(SQLRecord *rec, MyVariants &params) override;
+	bool match(SQLRecord *rec, const MyVariants &params) override;
 	void toString(std::string &result, SQLRecord *joinTableRec, 
 		std::vector<int16_t>& paramIndex) override;
+	bool isConjunction() override;
 
 	Condition *left();
 	void setLeft(Condition *condition);
@@ -290,17 +335,19 @@ public:
 	int32_t endParamID() const;
 
 	ConditionKind kind() override;
-	bool match(SQLRecord *rec, MyVariants &params) override;
+	bool match(SQLRecord *rec, const MyVariants &params) override;
 	void toString(std::string &result, SQLRecord *joinTableRec, 
 		std::vector<int16_t>& paramIndex) override;
 
 	FieldSchema *leftField() const;
+	const MyVariant leftValue(SQLRecord *rec);
 
 protected:
 	FieldSchema *m_leftField;
 	int16_t m_startParamId;
 	int16_t m_endParamId;
 	BinaryCompareOperator *m_comparator;
+	FieldAccessor m_leftAccessor;
 };
 
 class AggregateConstCondition : public ConstCondition
@@ -311,8 +358,12 @@ public:
 	virtual ~AggregateConstCondition();
 
 	ConditionKind kind() override;
+	// rec is record of GROUP BY result
+	bool match(SQLRecord *rec, const MyVariants &params) override;
 
 	AggregateFunction leftFunction() const;
+	// field of GROUP BY result keeping the aggregate
+	std::string aggregateName() const;
 
 private:
 	AggregateFunction m_leftFunc;
@@ -325,7 +376,7 @@ public:
 	virtual ~FieldCondition();
 
 	ConditionKind kind() override;
-	bool match(SQLRecord *rec, MyVariants &params) override;
+	bool match(SQLRecord *rec, const MyVariants &params) override;
 	void toString(std::string &result, SQLRecord *joinTableRec, 
 		std::vector<int16_t>& paramIndex) override;
 
@@ -339,6 +390,8 @@ protected:
 	FieldSchema *m_leftField;
 	FieldSchema *m_rightField;
 	BinaryCompareOperator *m_comparator;
+	FieldAccessor m_leftAccessor;
+	FieldAccessor m_rightAccessor;
 };
 
 class AggregateFieldCondition : public FieldCondition
@@ -352,6 +405,8 @@ public:
 
 	AggregateFunction leftFunction() const;
 	AggregateFunction rightFunction() const;
+	// field of GROUP BY result keeping the aggregate
+	std::string aggregateName(bool left = true) const;
 
 protected:
 	std::string sqlFieldName(bool left = true) override;
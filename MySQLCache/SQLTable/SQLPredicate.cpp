@@ -0,0 +1,525 @@
+#include "SQLPredicate.h"
+#include "SQLGraph.h"
+#include "SQLTable.h"
+#include "MathUtils.h"
+#include "Common.h"
+
+using namespace std;
+
+namespace {
+
+int32_t threeWay(int64_t v1, int64_t v2)
+{
+	return v1 < v2 ? -1 : (v1 == v2 ? 0 : 1);
+}
+
+int32_t threeWay(double v1, double v2)
+{
+	if (MathUtils::sameFloat(v1, v2)) {
+		return 0;
+	}
+	return v1 < v2 ? -1 : 1;
+}
+
+// compare a numeric column with params of the same type on selected rows, one tight loop per op
+template <typename T>
+void compareDense(PredicateOp op, const std::vector<T> &values, const std::vector<T> &params,
+	const std::vector<uint32_t> &rows, std::vector<uint8_t> &mask)
+{
+	T first = params[0];
+	switch (op)
+	{
+		case PredicateOp::poEqual:
+			FOR_EACH(r, rows) {
+				uint32_t i = *r;
+				mask[i] = threeWay(values[i], first) == 0;
+			}
+			break;
+		case PredicateOp::poUnEqual:
+			FOR_EACH(r, rows) {
+				uint32_t i = *r;
+				mask[i] = threeWay(values[i], first) != 0;
+			}
+			break;
+		case PredicateOp::poLess:
+			FOR_EACH(r, rows) {
+				uint32_t i = *r;
+				mask[i] = threeWay(values[i], first) < 0;
+			}
+			break;
+		case PredicateOp::poLessEqual:
+			FOR_EACH(r, rows) {
+				uint32_t i = *r;
+				mask[i] = threeWay(values[i], first) <= 0;
+			}
+			break;
+		case PredicateOp::poGreater:
+			FOR_EACH(r, rows) {
+				uint32_t i = *r;
+				mask[i] = threeWay(values[i], first) > 0;
+			}
+			break;
+		case PredicateOp::poGreaterEqual:
+			FOR_EACH(r, rows) {
+				uint32_t i = *r;
+				mask[i] = threeWay(values[i], first) >= 0;
+			}
+			break;
+		case PredicateOp::poBetween:
+		{
+			T last = params[1];
+			FOR_EACH(r, rows) {
+				uint32_t i = *r;
+				mask[i] = threeWay(values[i], first) >= 0 && threeWay(values[i], last) <= 0;
+			}
+			break;
+		}
+		case PredicateOp::poIn:
+			FOR_EACH(r, rows) {
+				uint32_t i = *r;
+				uint8_t m = 0;
+				for (size_t j = 0; j < params.size(); ++j) {
+					m |= threeWay(values[i], params[j]) == 0;
+				}
+				mask[i] = m;
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+}
+
+SQLPredicate::SQLPredicate(Condition *condition)
+{
+	if (condition) {
+		compile(condition);
+	}
+}
+
+bool SQLPredicate::match(SQLRecord *rec, const MyVariants &params)
+{
+	if (m_steps.empty()) {
+		return true;
+	}
+
+	return matchStep(0, rec, params);
+}
+
+void SQLPredicate::compile(Condition *condition)
+{
+	// steps may be reallocated while operands are compiled, keep index only
+	int index = m_steps.size();
+	m_steps.emplace_back();
+
+	if (condition->kind() == ConditionKind::ckBinary) {
+		BinaryCondition *binary = static_cast<BinaryCondition *>(condition);
+		if (condition->op() == "AND" || condition->op() == "OR") {
+			m_steps[index].op = condition->op() == "AND" ? PredicateOp::poAnd : PredicateOp::poOr;
+			compile(binary->left());
+			m_steps[index].right = m_steps.size();
+			compile(binary->right());
+			return;
+		}
+	}
+	else if (condition->kind() == ConditionKind::ckConst) {
+		ConstCondition *constCond = static_cast<ConstCondition *>(condition);
+		PredicateOp op = opOf(constCond->op());
+		if (op != PredicateOp::poCondition) {
+			PredicateStep &step = m_steps[index];
+			step.op = op;
+			step.startParamId = constCond->startParamID();
+			step.endParamId = constCond->endParamID();
+			step.accessor = FieldAccessor(constCond->leftField()->name(), constCond->leftField()->tableName());
+			return;
+		}
+	}
+
+	m_steps[index].op = PredicateOp::poCondition;
+	m_steps[index].condition = condition;
+}
+
+bool SQLPredicate::matchStep(int index, SQLRecord *rec, const MyVariants &params)
+{
+	PredicateStep &step = m_steps[index];
+	switch (step.op)
+	{
+		case PredicateOp::poAnd:
+			return matchStep(index + 1, rec, params) && matchStep(step.right, rec, params);
+		case PredicateOp::poOr:
+			return matchStep(index + 1, rec, params) || matchStep(step.right, rec, params);
+		case PredicateOp::poCondition:
+			return step.condition->match(rec, params);
+		default:
+			return matchField(step, rec, params);
+	}
+}
+
+bool SQLPredicate::matchField(PredicateStep &step, SQLRecord *rec, const MyVariants &params)
+{
+	// conditions of other tables are matched by their own records
+	if (!step.accessor.inTable(rec)) {
+		return true;
+	}
+
+	PredicateValue field;
+	readField(step, rec, field);
+	return compareValue(step, field, params);
+}
+
+bool SQLPredicate::compareValue(const PredicateStep &step, const PredicateValue &field, 
+	const MyVariants &params) const
+{
+	const MyVariant &first = param(params, step.startParamId);
+	switch (step.op)
+	{
+		case PredicateOp::poEqual:
+			return equal(field, first);
+		case PredicateOp::poUnEqual:
+			return !equal(field, first);
+		case PredicateOp::poLess:
+			return compare(field, first) < 0;
+		case PredicateOp::poLessEqual:
+			return compare(field, first) <= 0;
+		case PredicateOp::poGreater:
+			return compare(field, first) > 0;
+		case PredicateOp::poGreaterEqual:
+			return compare(field, first) >= 0;
+		case PredicateOp::poBetween:
+			return compare(field, first) >= 0 && compare(field, param(params, step.endParamId)) <= 0;
+		case PredicateOp::poIn:
+			for (int i = step.startParamId; i <= step.endParamId; ++i) {
+				if (equal(field, param(params, i))) {
+					return true;
+				}
+			}
+			return false;
+		default:
+			return false;
+	}
+}
+
+void SQLPredicate::readField(PredicateStep &step, SQLRecord *rec, PredicateValue &value)
+{
+	const FieldHandle &handle = step.accessor.handle(rec);
+	if (handle.field) {
+		switch (handle.dataType)
+		{
+			case DataType::dtSmallInt:
+			case DataType::dtInt:
+			case DataType::dtBigInt:
+				value.kind = rec->intValue(handle, value.intValue) ?
+					PredicateValueKind::pvkInteger : PredicateValueKind::pvkNull;
+				return;
+			case DataType::dtFloat:
+			case DataType::dtDouble:
+				value.kind = rec->doubleValue(handle, value.doubleValue) ?
+					PredicateValueKind::pvkDouble : PredicateValueKind::pvkNull;
+				return;
+			default:
+				break;
+		}
+	}
+
+	value = decode(step.accessor.value(rec));
+}
+
+PredicateBatch SQLPredicate::decode(uint32_t count, const BatchRecordGetter &record)
+{
+	PredicateBatch batch;
+	batch.count = count;
+	batch.record = record;
+	batch.mask.resize(count);
+	batch.columns.resize(m_steps.size());
+	for (size_t i = 0; i < m_steps.size(); ++i) {
+		PredicateStep &step = m_steps[i];
+		if (step.op != PredicateOp::poAnd && step.op != PredicateOp::poOr && 
+			step.op != PredicateOp::poCondition) {
+			decodeColumn(step, batch, batch.columns[i]);
+		}
+	}
+	return batch;
+}
+
+void SQLPredicate::match(PredicateBatch &batch, const MyVariants &params, const std::vector<uint32_t> &rows,
+	std::vector<uint32_t> &matched)
+{
+	matched.clear();
+	if (m_steps.empty()) {
+		matched = rows;
+		return;
+	}
+
+	matchStep(0, batch, params, rows);
+	FOR_EACH(r, rows) {
+		if (batch.mask[*r]) {
+			matched.push_back(*r);
+		}
+	}
+}
+
+void SQLPredicate::decodeColumn(PredicateStep &step, const PredicateBatch &batch, PredicateColumn &column)
+{
+	if (batch.count == 0) {
+		return;
+	}
+
+	// records of a batch are from one table, the first one decides kind of column
+	const FieldHandle &first = step.accessor.handle(batch.record(0));
+	if (first.field) {
+		if (first.dataType == DataType::dtSmallInt || first.dataType == DataType::dtInt ||
+			first.dataType == DataType::dtBigInt) {
+			column.kind = PredicateValueKind::pvkInteger;
+			column.ints.resize(batch.count);
+		}
+		else if (first.dataType == DataType::dtFloat || first.dataType == DataType::dtDouble) {
+			column.kind = PredicateValueKind::pvkDouble;
+			column.doubles.resize(batch.count);
+		}
+	}
+
+	column.states.resize(batch.count, PredicateRowState::prsValue);
+	for (uint32_t i = 0; i < batch.count; ++i) {
+		SQLRecord *rec = batch.record(i);
+		if (!step.accessor.inTable(rec)) {
+			column.states[i] = PredicateRowState::prsOutside;
+			++column.irregularCount;
+			continue;
+		}
+
+		const FieldHandle &handle = step.accessor.handle(rec);
+		if (handle.field && handle.dataType == first.dataType) {
+			if (column.kind == PredicateValueKind::pvkInteger && rec->intValue(handle, column.ints[i])) {
+				continue;
+			}
+			else if (column.kind == PredicateValueKind::pvkDouble && rec->doubleValue(handle, column.doubles[i])) {
+				continue;
+			}
+		}
+
+		if (column.others.empty()) {
+			column.others.resize(batch.count);
+		}
+		readField(step, rec, column.others[i]);
+		column.states[i] = PredicateRowState::prsOther;
+		++column.irregularCount;
+	}
+}
+
+void SQLPredicate::matchStep(int index, PredicateBatch &batch, const MyVariants &params, 
+	const std::vector<uint32_t> &rows)
+{
+	PredicateStep &step = m_steps[index];
+	switch (step.op)
+	{
+		case PredicateOp::poAnd:
+		case PredicateOp::poOr:
+		{
+			matchStep(index + 1, batch, params, rows);
+			// right operand only decides rows left one doesn't, its result is theirs
+			uint8_t undecided = step.op == PredicateOp::poAnd ? 1 : 0;
+			vector<uint32_t> rightRows;
+			FOR_EACH(r, rows) {
+				if (batch.mask[*r] == undecided) {
+					rightRows.push_back(*r);
+				}
+			}
+			if (!rightRows.empty()) {
+				matchStep(step.right, batch, params, rightRows);
+			}
+			break;
+		}
+		case PredicateOp::poCondition:
+			FOR_EACH(r, rows) {
+				batch.mask[*r] = step.condition->match(batch.record(*r), params);
+			}
+			break;
+		default:
+			matchColumn(step, batch.columns[index], params, rows, batch.mask);
+			break;
+	}
+}
+
+void SQLPredicate::matchColumn(const PredicateStep &step, const PredicateColumn &column, 
+	const MyVariants &params, const std::vector<uint32_t> &rows, std::vector<uint8_t> &mask) const
+{
+	// numeric column is compared in one loop if all params of step have its kind
+	bool dense = column.kind != PredicateValueKind::pvkVariant;
+	for (int i = step.startParamId; i <= step.endParamId && dense; ++i) {
+		dense = kindOf(param(params, i)) == column.kind;
+	}
+
+	if (dense && column.kind == PredicateValueKind::pvkInteger) {
+		vector<int64_t> values;
+		for (int i = step.startParamId; i <= step.endParamId; ++i) {
+			values.push_back(param(params, i).toInt64());
+		}
+		compareDense(step.op, column.ints, values, rows, mask);
+	}
+	else if (dense && column.kind == PredicateValueKind::pvkDouble) {
+		vector<double> values;
+		for (int i = step.startParamId; i <= step.endParamId; ++i) {
+			values.push_back(param(params, i).toDouble());
+		}
+		compareDense(step.op, column.doubles, values, rows, mask);
+	}
+	else if (column.kind != PredicateValueKind::pvkVariant) {
+		PredicateValue field;
+		field.kind = column.kind;
+		FOR_EACH(r, rows) {
+			if (column.kind == PredicateValueKind::pvkInteger) {
+				field.intValue = column.ints[*r];
+			}
+			else {
+				field.doubleValue = column.doubles[*r];
+			}
+			mask[*r] = compareValue(step, field, params);
+		}
+	}
+
+	if (column.irregularCount == 0) {
+		return;
+	}
+
+	FOR_EACH(r, rows) {
+		PredicateRowState state = column.states[*r];
+		if (state == PredicateRowState::prsOther) {
+			mask[*r] = compareValue(step, column.others[*r], params);
+		}
+		else if (state == PredicateRowState::prsOutside) {
+			mask[*r] = 1;
+		}
+	}
+}
+
+PredicateOp SQLPredicate::opOf(const std::string &op)
+{
+	if (op == "=") {
+		return PredicateOp::poEqual;
+	}
+	else if (op == "<>") {
+		return PredicateOp::poUnEqual;
+	}
+	else if (op == "<") {
+		return PredicateOp::poLess;
+	}
+	else if (op == "<=") {
+		return PredicateOp::poLessEqual;
+	}
+	else if (op == ">") {
+		return PredicateOp::poGreater;
+	}
+	else if (op == ">=") {
+		return PredicateOp::poGreaterEqual;
+	}
+	else if (op == "BETWEEN") {
+		return PredicateOp::poBetween;
+	}
+	else if (op == "IN") {
+		return PredicateOp::poIn;
+	}
+
+	return PredicateOp::poCondition;
+}
+
+PredicateValue SQLPredicate::decode(const MyVariant &v)
+{
+	PredicateValue result;
+	result.kind = kindOf(v);
+	if (result.kind == PredicateValueKind::pvkInteger) {
+		result.intValue = v.toInt64();
+	}
+	else if (result.kind == PredicateValueKind::pvkDouble) {
+		result.doubleValue = v.toDouble();
+	}
+	result.variant = v;
+	return result;
+}
+
+PredicateValueKind SQLPredicate::kindOf(const MyVariant &v)
+{
+	if (v.isNull()) {
+		return PredicateValueKind::pvkNull;
+	}
+	else if (v.isInteger()) {
+		return PredicateValueKind::pvkInteger;
+	}
+	else if (v.isNumber()) {
+		return PredicateValueKind::pvkDouble;
+	}
+	return PredicateValueKind::pvkVariant;
+}
+
+const MyVariant &SQLPredicate::param(const MyVariants &params, int id)
+{
+	static const MyVariant nullParam;
+	return id < params.count() ? params.variant(id) : nullParam;
+}
+
+MyVariant SQLPredicate::toVariant(const PredicateValue &v)
+{
+	// fields read by handle don't keep variant
+	if (!v.variant.isNull()) {
+		return v.variant;
+	}
+
+	switch (v.kind)
+	{
+		case PredicateValueKind::pvkInteger:
+			return v.intValue;
+		case PredicateValueKind::pvkDouble:
+			return v.doubleValue;
+		default:
+			return MyVariant();
+	}
+}
+
+bool SQLPredicate::equal(const PredicateValue &field, const MyVariant &param)
+{
+	PredicateValueKind kind = kindOf(param);
+	if (field.kind == kind) {
+		switch (kind)
+		{
+			case PredicateValueKind::pvkNull:
+				return true;
+			case PredicateValueKind::pvkInteger:
+				return field.intValue == param.toInt64();
+			case PredicateValueKind::pvkDouble:
+				return MathUtils::sameFloat(field.doubleValue, param.toDouble());
+			default:
+				break;
+		}
+	}
+
+	return toVariant(field) == param;
+}
+
+int32_t SQLPredicate::compare(const PredicateValue &field, const MyVariant &param)
+{
+	PredicateValueKind kind = kindOf(param);
+	if (field.kind == kind) {
+		switch (kind)
+		{
+			case PredicateValueKind::pvkNull:
+				return 0;
+			case PredicateValueKind::pvkInteger:
+				return threeWay(field.intValue, param.toInt64());
+			case PredicateValueKind::pvkDouble:
+				return threeWay(field.doubleValue, param.toDouble());
+			default:
+				break;
+		}
+	}
+
+	// null is less than any value
+	if (field.kind == PredicateValueKind::pvkNull) {
+		return -1;
+	}
+	else if (kind == PredicateValueKind::pvkNull) {
+		return 1;
+	}
+
+	MyVariant value = toVariant(field);
+	return value < param ? -1 : (value > param ? 1 : 0);
+}
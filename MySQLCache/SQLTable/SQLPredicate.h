@@ -0,0 +1,136 @@
+#pragma once
+#include "SQLTableSchema.h"
+#include "MyVariant.h"
+#include <cstdint>
+#include <vector>
+#include <functional>
+
+class Condition;
+class SQLRecord;
+
+enum class PredicateOp : uint8_t
+{
+	poEqual = 0,
+	poUnEqual = 1,
+	poLess = 2,
+	poLessEqual = 3,
+	poGreater = 4,
+	poGreaterEqual = 5,
+	poBetween = 6,
+	poIn = 7,
+	poAnd = 8,
+	poOr = 9,
+	// not compiled, matched by condition tree
+	poCondition = 10
+};
+
+enum class PredicateValueKind : uint8_t
+{
+	pvkNull = 0,
+	pvkInteger = 1,
+	pvkDouble = 2,
+	pvkVariant = 3
+};
+
+// field value decoded for typed compare
+struct PredicateValue
+{
+	PredicateValueKind kind = PredicateValueKind::pvkNull;
+	int64_t intValue = 0;
+	double doubleValue = 0;
+	// kept for strings, blobs and compares between different kinds
+	MyVariant variant;
+};
+
+// how a record of batch is kept by column
+enum class PredicateRowState : uint8_t
+{
+	// in ints or doubles
+	prsValue = 0,
+	// value isn't of kind of column(null, or field isn't numeric), in others, compared one by one
+	prsOther = 1,
+	// record isn't in table of field, step is true for it
+	prsOutside = 2
+};
+
+// field of a step decoded for a batch of records, everything is indexed by record
+struct PredicateColumn
+{
+	// kind of field type, ints or doubles has a value for every record if it's numeric
+	PredicateValueKind kind = PredicateValueKind::pvkVariant;
+	std::vector<int64_t> ints;
+	std::vector<double> doubles;
+	// allocated with the first record of other state
+	std::vector<PredicateValue> others;
+	std::vector<PredicateRowState> states;
+	// count of records not of value state
+	uint32_t irregularCount = 0;
+};
+
+// i -> the i-th record of a batch
+typedef std::function<SQLRecord *(uint32_t)> BatchRecordGetter;
+
+struct PredicateBatch
+{
+	uint32_t count = 0;
+	// by step index, empty for AND/OR and conditions not compiled
+	std::vector<PredicateColumn> columns;
+	// records for conditions not compiled
+	BatchRecordGetter record;
+	// by record, only entries of rows being matched are written
+	std::vector<uint8_t> mask;
+};
+
+struct PredicateStep
+{
+	PredicateOp op = PredicateOp::poCondition;
+	// AND/OR: step of right operand, left one is the next step
+	int16_t right = 0;
+	int16_t startParamId = 0;
+	int16_t endParamId = 0;
+	Condition *condition = nullptr;
+	FieldAccessor accessor;
+};
+
+// WHERE compiled once per schema into steps in prefix order. matching reads fields
+// from record data by handle and compares them with params of table in place,
+// no virtual compare, op string compare or temporary variants for numbers
+class SQLPredicate
+{
+public:
+	// condition must live longer than predicate
+	SQLPredicate(Condition *condition);
+
+	bool match(SQLRecord *rec, const MyVariants &params);
+
+	// decode fields of count records column by column, done once for a batch
+	PredicateBatch decode(uint32_t count, const BatchRecordGetter &record);
+	// records of rows(ascending indexes in batch) which match, other records of batch aren't read,
+	// so a table costs the records selected for it instead of the whole batch
+	void match(PredicateBatch &batch, const MyVariants &params, const std::vector<uint32_t> &rows,
+		std::vector<uint32_t> &matched);
+
+private:
+	void compile(Condition *condition);
+	bool matchStep(int index, SQLRecord *rec, const MyVariants &params);
+	bool matchField(PredicateStep &step, SQLRecord *rec, const MyVariants &params);
+	void readField(PredicateStep &step, SQLRecord *rec, PredicateValue &value);
+	bool compareValue(const PredicateStep &step, const PredicateValue &field, const MyVariants &params) const;
+
+	void decodeColumn(PredicateStep &step, const PredicateBatch &batch, PredicateColumn &column);
+	void matchStep(int index, PredicateBatch &batch, const MyVariants &params, const std::vector<uint32_t> &rows);
+	void matchColumn(const PredicateStep &step, const PredicateColumn &column, const MyVariants &params,
+		const std::vector<uint32_t> &rows, std::vector<uint8_t> &mask) const;
+
+	static PredicateOp opOf(const std::string &op);
+	static PredicateValue decode(const MyVariant &v);
+	static PredicateValueKind kindOf(const MyVariant &v);
+	// missing params are null
+	static const MyVariant &param(const MyVariants &params, int id);
+	static MyVariant toVariant(const PredicateValue &v);
+	static bool equal(const PredicateValue &field, const MyVariant &param);
+	static int32_t compare(const PredicateValue &field, const MyVariant &param);
+
+private:
+	std::vector<PredicateStep> m_steps;
+};
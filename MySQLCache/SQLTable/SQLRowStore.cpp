@@ -0,0 +1,73 @@
+#include "SQLRowStore.h"
+#include "SQLTable.h"
+#include "Common.h"
+
+using namespace std;
+
+SQLRowStore::SQLRowStore(SQLTableSchema *schema, int8_t threadIndex) :
+	m_view(new SQLNormalTable(schema))
+{
+	m_view->setThreadIndex(threadIndex);
+}
+
+SQLRowStore::~SQLRowStore()
+{
+	delete m_view;
+}
+
+uint32_t SQLRowStore::find(int64_t pk) const
+{
+	return m_rows.find(pk);
+}
+
+uint32_t SQLRowStore::acquire(int64_t pk, uint32_t dataId)
+{
+	uint32_t rowId = m_rows.find(pk);
+	if (rowId == PKHashMap::NULL_DATA_ID) {
+		m_rows.insert(pk, dataId);
+		return dataId;
+	}
+
+	++m_extraRefs[rowId];
+	return rowId;
+}
+
+void SQLRowStore::release(int64_t pk)
+{
+	uint32_t rowId = m_rows.find(pk);
+	if (rowId == PKHashMap::NULL_DATA_ID) {
+		return;
+	}
+
+	auto i = m_extraRefs.find(rowId);
+	if (i != m_extraRefs.end()) {
+		if (--i->second == 0) {
+			m_extraRefs.erase(i);
+		}
+		return;
+	}
+
+	m_rows.remove(pk);
+	SQLNormalRecord(m_view, rowId).recycle();
+}
+
+void SQLRowStore::update(SQLRecord *rec, const vector<string> &updateFieldNames)
+{
+	uint32_t rowId = m_rows.find(m_view->intPK(rec));
+	if (rowId == PKHashMap::NULL_DATA_ID) {
+		return;
+	}
+
+	SQLNormalRecord row(m_view, rowId);
+	FOR_EACH(i, updateFieldNames) {
+		FieldHandle handle = m_view->normalSchema()->fieldHandle(*i);
+		if (handle.field) {
+			row.setValue(handle, rec->value(*i));
+		}
+	}
+}
+
+uint32_t SQLRowStore::size() const
+{
+	return m_rows.size();
+}
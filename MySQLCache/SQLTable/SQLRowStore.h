@@ -0,0 +1,38 @@
+#pragma once
+#include "PKHashMap.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+class SQLTableSchema;
+class SQLNormalTable;
+class SQLRecord;
+
+// rows of all tables of one cache schema, a db row cached by many tables is kept once.
+// tables reference rows by pk, row is recycled when the last table releases it
+class SQLRowStore
+{
+public:
+	SQLRowStore(SQLTableSchema *schema, int8_t threadIndex);
+	~SQLRowStore();
+
+	// NULL_DATA_ID if no table has row of pk
+	uint32_t find(int64_t pk) const;
+	// reference row of pk, dataId becomes the row if pk is new. return data id of the row
+	uint32_t acquire(int64_t pk, uint32_t dataId);
+	// drop a reference of row, row is recycled with the last one
+	void release(int64_t pk);
+
+	// write updated fields of rec to its row, seen by all tables having the row
+	void update(SQLRecord *rec, const std::vector<std::string> &updateFieldNames);
+
+	uint32_t size() const;
+
+private:
+	PKHashMap m_rows;
+	// extra reference count of rows had by more than one table
+	std::unordered_map<uint32_t, uint32_t> m_extraRefs;
+	// accessor of rows, has no record itself
+	SQLNormalTable *m_view;
+};
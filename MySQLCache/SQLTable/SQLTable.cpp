@@ -4,23 +4,31 @@
 #include "Common.h"
 #include "SQLTableContainer.h"
 #include "MemoryManager.h"
+#include "SQLRowStore.h"
+#include "PKDictionary.h"
 #include <algorithm>
 #include <unordered_set>
 
 using namespace std;
 
 SQLNormalTable::SQLNormalTable(SQLTableSchema *schema) :
-	SQLTable(schema)
+	SQLTable(schema),
+	m_cursor(nullptr),
+	m_newRecord(nullptr),
+	m_orderIndex(nullptr),
+	m_ownSchema(true),
+	m_truncated(false)
 {
 }
 
 SQLNormalTable::~SQLNormalTable()
 {
-	FOR_EACH(i, m_pkHash) {
-		delete i->second;
-	}
+	releaseRecords();
+	delete m_cursor;
+	delete m_newRecord;
+	delete m_orderIndex;
 
-	if (m_schema->kind() == TableKind::tkExtend) {
+	if (m_ownSchema && m_schema->kind() == TableKind::tkExtend) {
 		delete m_schema;
 	}
 }
@@ -28,19 +36,42 @@ SQLNormalTable::~SQLNormalTable()
 // ¼
 SQLRecord *SQLNormalTable::newRecord()
 {
-	SQLRecord *rec = new SQLNormalRecord(this);
-	return rec;
+	// the view is reused by next newRecord, data is owned by table after append
+	if (!m_newRecord) {
+		m_newRecord = new SQLNormalRecord(this);
+	}
+	m_newRecord->allocate();
+	return m_newRecord;
 }
 
 SQLRecord *SQLNormalTable::append(SQLRecord *rec)
 {
 	int64_t pk = intPK(rec);
-	auto i = m_pkHash.find(pk);
-	if (i != m_pkHash.end()) {
-		return i->second;
+	uint32_t dataId = m_pkHash.find(pk);
+	if (dataId != PKHashMap::NULL_DATA_ID) {
+		return record(dataId);
+	}
+
+	if (!m_integerPK) {
+		// surrogate of pk is referenced by table until the record is removed
+		pk = pkValue(rec, true);
 	}
 
-	m_pkHash[pk] = rec;
+	dataId = static_cast<SQLNormalRecord *>(rec)->dataId();
+	SQLRowStore *rowStore = m_schema->rowStore();
+	if (rowStore) {
+		// row of pk cached by other tables of schema is shared, rec is recycled by caller then
+		uint32_t rowId = rowStore->acquire(pk, dataId);
+		if (rowId != dataId) {
+			rec = record(rowId);
+			dataId = rowId;
+		}
+	}
+
+	m_pkHash.insert(pk, dataId);
+	if (m_orderIndex) {
+		m_orderIndex->emplace(orderKey(rec), dataId);
+	}
 	return rec;
 }
 
@@ -51,9 +82,41 @@ int SQLNormalTable::recordCount() const
 
 void SQLNormalTable::forEach(const ForEachRecordEvent &e)
 {
-	FOR_EACH(i, m_pkHash) {
-		e(i->second);
+	SQLNormalRecord rec(this);
+	m_pkHash.forEach([&](int64_t, uint32_t dataId) {
+		rec.setDataId(dataId);
+		e(&rec);
+	});
+}
+
+SQLRecord *SQLNormalTable::readRecord(SQLResultReader &reader, const SQLResultBinding &binding)
+{
+	// record with the same pk has been read, skip decoding the row
+	if (binding.pkColumn >= 0 && !reader.isNull(binding.pkColumn)) {
+		int64_t pk = reader.getInt64(binding.pkColumn);
+		SQLRecord *rec = selectByPK(pk);
+		if (rec) {
+			return rec;
+		}
+
+		// row is cached by other tables of schema, refreshed by values from db as insert does
+		SQLRowStore *rowStore = m_schema->rowStore();
+		uint32_t rowId = rowStore ? rowStore->find(pk) : PKHashMap::NULL_DATA_ID;
+		if (rowId != PKHashMap::NULL_DATA_ID) {
+			SQLNormalRecord *row = record(rowId);
+			row->read(reader, binding);
+			return append(row);
+		}
+	}
+
+	SQLNormalRecord *newRec = static_cast<SQLNormalRecord *>(newRecord());
+	newRec->read(reader, binding);
+	SQLRecord *realNewRec = append(newRec);
+	if (realNewRec != newRec) {
+		newRec->recycle();
 	}
+
+	return realNewRec;
 }
 
 FieldSchema *SQLNormalTable::primaryKey() const
@@ -73,28 +136,86 @@ std::string SQLNormalTable::name() const
 
 void SQLNormalTable::update(SQLRecord *rec, std::vector<std::string> &updateFieldNames)
 {
-	auto n = m_pkHash.find(intPK(rec));
-	if (n != m_pkHash.end()) {
-		SQLRecord *dstRec = n->second;
+	int64_t pk = intPK(rec);
+	uint32_t dataId = m_pkHash.find(pk);
+	if (dataId != PKHashMap::NULL_DATA_ID) {
+		if (isLimited() && !m_orderIndex) {
+			buildOrderIndex();
+		}
+
+		SQLNormalRecord dstRec(this, dataId);
+		// record is moved in ordered index only when order fields are changed
+		bool reorder = m_orderIndex && hasOrderField(updateFieldNames);
+		if (reorder) {
+			m_orderIndex->erase(orderKey(&dstRec));
+		}
+
 		FOR_EACH(i, updateFieldNames) {
-			FieldSchema *field = normalSchema()->findField(*i);
-			if (field) {
-				dstRec->setValue(*i, rec->value(*i));
+			FieldHandle handle = normalSchema()->fieldHandle(*i);
+			if (handle.field) {
+				dstRec.setValue(handle, rec->value(*i));
+			}
+		}
+
+		if (reorder) {
+			m_orderIndex->emplace(orderKey(&dstRec), dataId);
+			// record moved to the end of truncated window may be behind records not cached
+			if (isLimited() && m_truncated && m_orderIndex->rbegin()->second == dataId) {
+				removeByPK(pk);
 			}
 		}
 	}
+	else if (isLimited() && m_truncated && hasOrderField(updateFieldNames)) {
+		// record behind truncated window isn't cached, it may be moved into window.
+		// rec has all fields of updated row
+		insert(rec);
+	}
 }
 
 SQLRecord *SQLNormalTable::insert(SQLRecord *rec)
 {
-	SQLRecord *dstRec = newRecord();
-	for (int i = 0; i < normalSchema()->fieldCount(); ++i) {
-		auto &fieldName = normalSchema()->field(i)->name();
-		dstRec->setValue(fieldName, rec->value(fieldName));
+	if (isLimited()) {
+		if (!m_orderIndex) {
+			buildOrderIndex();
+		}
+
+		// record behind the last one of truncated window isn't known to be in window
+		if (m_truncated && !m_orderIndex->empty() &&
+			!m_orderIndex->key_comp()(orderKey(rec), m_orderIndex->rbegin()->first)) {
+			return nullptr;
+		}
+	}
+
+	SQLNormalTableSchema *tableSchema = normalSchema();
+	if (m_fieldAccessors.size() != tableSchema->fieldCount()) {
+		m_fieldAccessors.clear();
+		for (size_t i = 0; i < tableSchema->fieldCount(); ++i) {
+			m_fieldAccessors.emplace_back(tableSchema->field(i)->name());
+		}
+	}
+
+	int64_t pk = intPK(rec);
+	SQLRecord *existedRec = selectByPK(pk);
+	if (existedRec) {
+		return existedRec;
+	}
+
+	// shared row of pk is refreshed by values of rec instead of allocating a new one
+	SQLRowStore *rowStore = m_schema->rowStore();
+	uint32_t rowId = rowStore ? rowStore->find(pk) : PKHashMap::NULL_DATA_ID;
+	SQLNormalRecord *dstRec = rowId != PKHashMap::NULL_DATA_ID ?
+		record(rowId) : static_cast<SQLNormalRecord *>(newRecord());
+	for (size_t i = 0; i < tableSchema->fieldCount(); ++i) {
+		dstRec->setValue(tableSchema->fieldHandle(i), m_fieldAccessors[i].value(rec));
 	}
-	append(dstRec);
 
-	return dstRec;
+	SQLRecord *realRec = append(dstRec);
+	if (isLimited() && (int32_t)m_pkHash.size() > m_schema->windowCapacity()) {
+		trimWindow();
+		return selectByPK(pk);
+	}
+
+	return realRec;
 }
 
 bool SQLNormalTable::remove(SQLRecord *rec)
@@ -104,10 +225,20 @@ bool SQLNormalTable::remove(SQLRecord *rec)
 
 bool SQLNormalTable::removeByPK(int64_t pk)
 {
-	auto i = m_pkHash.find(pk);
-	if (i != m_pkHash.end()) {
-		delete i->second;
-		m_pkHash.erase(pk);
+	uint32_t dataId = m_pkHash.remove(pk);
+	if (dataId != PKHashMap::NULL_DATA_ID) {
+		SQLNormalRecord *rec = record(dataId);
+		if (m_orderIndex) {
+			m_orderIndex->erase(orderKey(rec));
+		}
+
+		if (m_schema->rowStore()) {
+			m_schema->rowStore()->release(pk);
+		}
+		else {
+			rec->recycle();
+		}
+		releasePK(pk);
 		return true;
 	}
 
@@ -121,70 +252,190 @@ bool SQLNormalTable::exist(SQLRecord *rec)
 
 bool SQLNormalTable::existPK(int64_t pk)
 {
-	return m_pkHash.find(pk) != m_pkHash.end();
+	return m_pkHash.find(pk) != PKHashMap::NULL_DATA_ID;
 }
 
 int64_t SQLNormalTable::intPK(const SQLRecord *rec) const
 {
-	FieldSchema *pkField = primaryKey();
-	if (!pkField) {
-		return 0;
-	}
-
-	return rec->value(pkField->name()).toInt64();
+	return pkValue(rec);
 }
 
 SQLRecord *SQLNormalTable::selectByPK(int64_t pk)
 {
-	auto i = m_pkHash.find(pk);
-	if (i != m_pkHash.end()) {
-		return i->second;
+	uint32_t dataId = m_pkHash.find(pk);
+	if (dataId != PKHashMap::NULL_DATA_ID) {
+		return record(dataId);
 	}
 	return nullptr;
 }
 
+SQLNormalRecord *SQLNormalTable::record(uint32_t dataId)
+{
+	// views are created on demand, most tables are only saved and synchronized
+	if (!m_cursor) {
+		m_cursor = new SQLNormalRecord(this);
+	}
+	m_cursor->setDataId(dataId);
+	return m_cursor;
+}
+
+void SQLNormalTable::resetAccessors()
+{
+	SQLTable::resetAccessors();
+	m_fieldAccessors.clear();
+	delete m_orderIndex;
+	m_orderIndex = nullptr;
+}
+
+void SQLNormalTable::buildOrderIndex()
+{
+	m_orderIndex = new OrderIndex(OrderKeyLess{ m_schema });
+	forEach([&](SQLRecord *rec) {
+		m_orderIndex->emplace(orderKey(rec), static_cast<SQLNormalRecord *>(rec)->dataId());
+	});
+}
+
+bool SQLNormalTable::hasOrderField(const std::vector<std::string> &fieldNames)
+{
+	for (int i = 0; i < m_schema->orderFieldCount(); ++i) {
+		const std::string &name = m_schema->orderField(i).field->name();
+		if (std::find(fieldNames.begin(), fieldNames.end(), name) != fieldNames.end()) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool SQLNormalTable::isLimited() const
+{
+	return m_schema->limitCount() >= 0;
+}
+
+void SQLNormalTable::trimWindow()
+{
+	while ((int32_t)m_pkHash.size() > m_schema->windowCapacity()) {
+		removeByPK(m_orderIndex->rbegin()->first.pk);
+		m_truncated = true;
+	}
+}
+
+void SQLNormalTable::setOwnSchema(bool value)
+{
+	m_ownSchema = value;
+}
+
+void SQLNormalTable::clear()
+{
+	releaseRecords();
+	m_pkHash.clear();
+	delete m_orderIndex;
+	m_orderIndex = nullptr;
+	m_truncated = false;
+}
+
+void SQLNormalTable::releaseRecords()
+{
+	SQLRowStore *rowStore = m_schema ? m_schema->rowStore() : nullptr;
+	m_pkHash.forEach([&](int64_t pk, uint32_t dataId) {
+		if (rowStore) {
+			rowStore->release(pk);
+		}
+		else {
+			record(dataId)->recycle();
+		}
+		releasePK(pk);
+	});
+}
+
+void SQLNormalTable::releasePK(int64_t pk)
+{
+	if (m_schema && normalSchema()->primaryKey() && !normalSchema()->isIntegerPK()) {
+		PKDictionary::instance(m_threadIndex)->release(pk);
+	}
+}
+
+void SQLNormalTable::setTruncated(bool value)
+{
+	m_truncated = value;
+}
+
+bool SQLNormalTable::windowDrained() const
+{
+	return isLimited() && m_truncated &&
+		(int32_t)m_pkHash.size() < m_schema->limitOffset() + m_schema->limitCount();
+}
+
+uint32_t SQLNormalTable::savedMemory(WriteBuffer *buffer) const
+{
+	// point lookup saves one of its rows, it is counted by all rows and their pk slots
+	if (m_schema->isPointLookup()) {
+		return m_pkHash.size() * (m_schema->recordLength() + sizeof(int64_t) + sizeof(uint32_t));
+	}
+	return SQLTable::savedMemory(buffer);
+}
+
 void SQLNormalTable::doSave(WriteBuffer *buffer)
 {
 	SQLTable::doSave(buffer);
-	buffer->writeInt(m_pkHash.size());
-	if (m_schema->orderFieldCount() > 0) {
-		std::vector<SQLRecord *> orderRecs;
-		FOR_EACH(i, m_pkHash) {
-			orderRecs.push_back(i->second);
+	if (m_schema->isPointLookup()) {
+		// only the row of looked up key is returned
+		SQLRecord *rec = m_params.count() > 0 ? selectByPK(m_params.variant(0).toInt64()) : nullptr;
+		buffer->writeInt(rec ? 1 : 0);
+		if (rec) {
+			rec->save(buffer);
+		}
+	}
+	else if (m_schema->orderFieldCount() > 0) {
+		if (!m_orderIndex) {
+			buildOrderIndex();
 		}
 
-		std::sort(orderRecs.begin(), orderRecs.end(), [&](SQLRecord *rec1, SQLRecord *rec2) {
-			return compareRecordByOrderFields(rec1, rec2);
-			});
-		for (int i = 0; i < orderRecs.size(); ++i) {
-			orderRecs.at(i)->save(buffer);
+		// only records in LIMIT window are returned, records before offset and slack are skipped
+		int32_t skipCount = std::min<int32_t>(m_schema->limitOffset(), m_pkHash.size());
+		int32_t count = m_pkHash.size() - skipCount;
+		if (isLimited()) {
+			count = std::min(count, m_schema->limitCount());
+		}
+		buffer->writeInt(count);
+
+		SQLNormalRecord rec(this);
+		auto i = m_orderIndex->begin();
+		std::advance(i, skipCount);
+		for (; count > 0; ++i, --count) {
+			rec.setDataId(i->second);
+			rec.save(buffer);
 		}
 	}
 	else {
-		FOR_EACH(i, m_pkHash) {
-			i->second->save(buffer);
-		}
+		buffer->writeInt(m_pkHash.size());
+		forEach([&](SQLRecord *rec) {
+			rec->save(buffer);
+		});
 	}
 }
 
 void SQLNormalTable::doUnload(OutputStream &out)
 {
 	SQLTable::doUnload(out);
+	out.writeBoolean(m_truncated);
 	out.writeInt(m_pkHash.size());
-	FOR_EACH(i, m_pkHash) {
-		out.writeLong(i->first);
-		out.writeUInt(static_cast<SQLNormalRecord *>(i->second)->dataId());
-	}
+	m_pkHash.forEach([&](int64_t pk, uint32_t dataId) {
+		out.writeLong(pk);
+		out.writeUInt(dataId);
+	});
 }
 
 void SQLNormalTable::doLoad(InputStream &in)
 {
 	SQLTable::doLoad(in);
+	m_truncated = in.readBoolean();
 	int32_t count = in.readInt();
+	m_pkHash.reserve(count);
 	for (int i = 0; i < count; ++i) {
 		int64_t pk = in.readLong();
 		uint32_t dataId = in.readUInt();
-		m_pkHash[pk] = new SQLNormalRecord(this, dataId);
+		m_pkHash.insert(pk, dataId);
 	}
 }
 
@@ -198,19 +449,57 @@ SQLTable *SQLRecord::table() const
 	return m_table;
 }
 
+const MyVariant SQLRecord::value(const FieldHandle &handle) const
+{
+	return value(handle.field->name());
+}
+
+void SQLRecord::setValue(const FieldHandle &handle, const MyVariant &value)
+{
+	setValue(handle.field->name(), value);
+}
+
+bool SQLRecord::intValue(const FieldHandle &handle, int64_t &result) const
+{
+	MyVariant v = value(handle);
+	if (v.isNull()) {
+		return false;
+	}
+
+	result = v.toInt64();
+	return true;
+}
+
+bool SQLRecord::doubleValue(const FieldHandle &handle, double &result) const
+{
+	MyVariant v = value(handle);
+	if (v.isNull()) {
+		return false;
+	}
+
+	result = v.toDouble();
+	return true;
+}
+
 SQLJoinTable::SQLJoinTable(SQLTableSchema *tableSchema) :
 	SQLTable(tableSchema)
 {
-	m_leftTable.setSchema(joinSchema()->left());
-	m_rightTable.setSchema(joinSchema()->right());
+	if (tableSchema) {
+		createTables();
+		for (size_t i = 0; i < m_tables.size(); ++i) {
+			m_tables[i]->setSchema(joinSchema()->table(i));
+		}
+	}
 }
 
 SQLJoinTable::~SQLJoinTable()
 {
-	FOR_EACH(i, m_leftJoinHash) {
-		FOR_EACH(j, (i->second)) {
-			delete *j;
-		}
+	forEach([](SQLRecord *rec) {
+		delete rec;
+	});
+
+	FOR_EACH(i, m_tables) {
+		delete *i;
 	}
 }
 
@@ -228,36 +517,64 @@ SQLRecord *SQLJoinTable::append(SQLRecord *rec)
 int SQLJoinTable::recordCount() const
 {
 	int count = 0;
-	FOR_EACH(i, m_leftJoinHash) {
-		count += i->second.size();
+	if (!m_joinHashes.empty()) {
+		FOR_EACH(i, m_joinHashes[0]) {
+			count += i->second.size();
+		}
 	}
 	return count;
 }
 
 void SQLJoinTable::forEach(const ForEachRecordEvent &e)
 {
-	FOR_EACH(i, m_leftJoinHash) {	
+	if (m_joinHashes.empty()) {
+		return;
+	}
+
+	// every join record has a record of the first table
+	FOR_EACH(i, m_joinHashes[0]) {
 		FOR_EACH(j, (i->second)) {
 			e(*j);
 		}
 	}
 }
 
+void SQLJoinTable::bindColumns(SQLResultReader &reader, SQLResultBinding &binding,
+	bool /*directColumnName*/)
+{
+	binding.children.resize(m_tables.size());
+	for (size_t i = 0; i < m_tables.size(); ++i) {
+		m_tables[i]->bindColumns(reader, binding.children[i]);
+	}
+}
+
+SQLRecord *SQLJoinTable::readRecord(SQLResultReader &reader, const SQLResultBinding &binding)
+{
+	SQLJoinRecord *rec = new SQLJoinRecord(this);
+	for (size_t i = 0; i < m_tables.size(); ++i) {
+		rec->setRecord(i, m_tables[i]->readRecord(reader, binding.children[i]));
+	}
+
+	addJoin(rec);
+	return rec;
+}
+
 void SQLJoinTable::setThreadIndex(int8_t index)
 {
 	SQLTable::setThreadIndex(index);
-	m_leftTable.setThreadIndex(index);
-	m_rightTable.setThreadIndex(index);
+	FOR_EACH(i, m_tables) {
+		(*i)->setThreadIndex(index);
+	}
 }
 
-SQLNormalTable &SQLJoinTable::left()
+int SQLJoinTable::tableCount() const
 {
-	return m_leftTable;
+	return m_tables.size();
 }
 
-SQLNormalTable &SQLJoinTable::right()
+SQLNormalTable &SQLJoinTable::table(int index)
 {
-	return m_rightTable;
+	return *m_tables[index];
 }
 
 SQLJoinTableSchema *SQLJoinTable::joinSchema() const
@@ -267,51 +584,55 @@ SQLJoinTableSchema *SQLJoinTable::joinSchema() const
 
 SQLNormalTable *SQLJoinTable::getTable(const std::string &tableName)
 {
-	if (m_leftTable.schema()->name() == tableName) {
-		return &m_leftTable;
-	}
-	else if (m_rightTable.schema()->name() == tableName) {
-		return &m_rightTable;
-	}
-	
-	return nullptr;
+	int index = tableIndex(tableName);
+	return index >= 0 ? m_tables[index] : nullptr;
 }
 
-void SQLJoinTable::addJoin(SQLJoinRecord *rec)
+int SQLJoinTable::tableIndex(const std::string &tableName) const
 {
-	int64_t left = rec->left()->pk();
-	int64_t right = rec->right()->pk();
-
-	auto i = m_leftJoinHash.find(left);
-	if (i == m_leftJoinHash.end()) {
-		m_leftJoinHash[left] = JOINPKSet();
+	for (size_t i = 0; i < m_tables.size(); ++i) {
+		if (m_tables[i]->schema()->name() == tableName) {
+			return i;
+		}
 	}
 
-	m_leftJoinHash[left].insert(rec);
+	return -1;
+}
 
-	i = m_rightJoinHash.find(right);
-	if (i == m_rightJoinHash.end()) {
-		m_rightJoinHash[right] = JOINPKSet();
+void SQLJoinTable::addJoin(SQLJoinRecord *rec)
+{
+	for (size_t i = 0; i < m_joinHashes.size(); ++i) {
+		m_joinHashes[i][rec->record(i)->pk()].insert(rec);
 	}
-
-	m_rightJoinHash[right].insert(rec);
 }
 
-void SQLJoinTable::removeJoin(int64_t pk, bool isLeft)
+void SQLJoinTable::removeJoin(int64_t pk, int index)
 {
-	JOINPKHash *src = isLeft ? &m_leftJoinHash : &m_rightJoinHash;
-	JOINPKHash *dst = isLeft ? &m_rightJoinHash : &m_leftJoinHash;
-	JOINPKSet &dstPKs = (*src)[pk];
-	FOR_EACH(i, dstPKs) {
+	auto src = m_joinHashes[index].find(pk);
+	if (src == m_joinHashes[index].end()) {
+		return;
+	}
+
+	FOR_EACH(i, src->second) {
 		SQLJoinRecord *joinRec = *i;
-		JOINPKSet &srcPKs = (*dst)[isLeft? joinRec->right()->pk() : joinRec->left()->pk()];
-		srcPKs.erase(joinRec);
+		for (size_t j = 0; j < m_joinHashes.size(); ++j) {
+			if ((int)j == index) {
+				continue;
+			}
+
+			auto dst = m_joinHashes[j].find(joinRec->record(j)->pk());
+			dst->second.erase(joinRec);
+			if (dst->second.empty()) {
+				m_joinHashes[j].erase(dst);
+			}
+		}
 		delete joinRec;
 	}
 
-	src->erase(pk);
+	m_joinHashes[index].erase(src);
 }
 
+
 bool SQLJoinTable::update(const std::string &tableName, SQLRecord *rec, std::vector<std::string> &updateFields)
 {
 	SQLNormalTable *table = getTable(tableName);
@@ -325,13 +646,13 @@ bool SQLJoinTable::update(const std::string &tableName, SQLRecord *rec, std::vec
 
 bool SQLJoinTable::remove(const std::string &tableName, SQLRecord *rec)
 {
-	SQLNormalTable *table = getTable(tableName);
-	if (!table) {
+	int index = tableIndex(tableName);
+	if (index < 0) {
 		return false;
 	}
 
-	removeJoin(table->intPK(rec), table == &m_leftTable);
-	return table->remove(rec);
+	removeJoin(m_tables[index]->intPK(rec), index);
+	return m_tables[index]->remove(rec);
 }
 
 void SQLJoinTable::doSave(WriteBuffer* buffer)
@@ -352,7 +673,6 @@ void SQLJoinTable::doSave(WriteBuffer* buffer)
 
 		for (int i = 0; i < orderRecs.size(); ++i) {
 			orderRecs[i]->save(buffer);
-			delete orderRecs[i];
 		}
 	}
 	else {
@@ -366,133 +686,85 @@ void SQLJoinTable::doUnload(OutputStream &out)
 {
 	SQLTable::doUnload(out);
 
-	m_leftTable.doUnload(out);
-	m_rightTable.doUnload(out);
+	FOR_EACH(i, m_tables) {
+		(*i)->doUnload(out);
+	}
 	
-	out.writeInt(m_leftJoinHash.size());
-	FOR_EACH(i, m_leftJoinHash) {
-		out.writeLong(i->first);
-		out.writeInt(i->second.size());
-		FOR_EACH(j, (i->second)) {
-			out.writeLong((*j)->right()->pk());
+	// join record is kept as pks of its records
+	out.writeInt(recordCount());
+	forEach([&](SQLRecord *rec) {
+		SQLJoinRecord *joinRec = static_cast<SQLJoinRecord *>(rec);
+		for (int i = 0; i < joinRec->recordCount(); ++i) {
+			out.writeLong(joinRec->record(i)->pk());
 		}
-	}
+	});
 }
 
 void SQLJoinTable::doLoad(InputStream &in)
 {
 	SQLTable::doLoad(in);
 
-	m_leftTable.doLoad(in);
-	m_rightTable.doLoad(in);
+	createTables();
+	FOR_EACH(i, m_tables) {
+		(*i)->doLoad(in);
+	}
 
 	int cnt = in.readInt();
 	while (cnt-- > 0) {
-		int64_t leftPk = in.readLong();
-		SQLRecord *leftRec = m_leftTable.selectByPK(leftPk);
-		m_leftJoinHash[leftPk] = JOINPKSet();
-		auto &left = m_leftJoinHash[leftPk];
-		int rightSize = in.readInt();
-		while (rightSize-- > 0) {
-			int64_t rightPk = in.readLong();
-			SQLRecord *rightRec = m_rightTable.selectByPK(rightPk);
-			SQLJoinRecord *joinRec = new SQLJoinRecord(this, leftRec, rightRec);
-			left.insert(joinRec);
-
-			auto right = m_rightJoinHash.find(rightPk);
-			if (right == m_rightJoinHash.end()) {
-				m_rightJoinHash[rightPk] = JOINPKSet();
-				right = m_rightJoinHash.find(rightPk);
-			}
-
-			right->second.insert(joinRec);
+		SQLJoinRecord *joinRec = new SQLJoinRecord(this);
+		for (size_t i = 0; i < m_tables.size(); ++i) {
+			joinRec->setRecord(i, m_tables[i]->selectByPK(in.readLong()));
 		}
+		addJoin(joinRec);
 	}
 }
 
-SQLJoinRecord::SQLJoinRecord(SQLTable *table, SQLRecord *left, SQLRecord *right) :
-	SQLRecord(table),
-	m_left(left),
-	m_right(right)
+void SQLJoinTable::createTables()
 {
+	int count = joinSchema()->tableCount();
+	for (int i = 0; i < count; ++i) {
+		m_tables.push_back(new SQLNormalTable());
+	}
+	m_joinHashes.resize(count);
 }
 
-SQLJoinRecord::~SQLJoinRecord()
+SQLJoinRecord::SQLJoinRecord(SQLTable *table) :
+	SQLRecord(table)
 {
+	if (table) {
+		m_records.resize(joinTable()->tableCount(), SQLNormalRecord(nullptr));
+	}
 }
 
-void SQLJoinRecord::read(std::unordered_map<std::string, MyVariant>& sqlResult,
-	bool directColumnName)
+SQLJoinRecord::~SQLJoinRecord()
 {
-	SQLJoinTable *joinTable = static_cast<SQLJoinTable *>(m_table);
-	SQLJoinTableSchema *joinTableSchema = static_cast<SQLJoinTableSchema *>(joinTable->schema());
-
-	SQLNormalTableSchema *tableSchema = joinTableSchema->left();
-	SQLNormalTable *table = joinTable->getTable(tableSchema->name());
-	// ȿtableǷѾ
-	FieldSchema *pk = tableSchema->primaryKey();
-	std::string pkFieldName = tableSchema->getRealColumnName(pk->name());
-	int64_t leftPKValue = sqlResult[pkFieldName].toInt64();
-	m_left = table->selectByPK(leftPKValue);
-	if (!m_left) {
-		m_left = table->newRecord();
-		m_left->read(sqlResult);
-		table->append(m_left);
-	}
-
-	tableSchema = joinTableSchema->right();
-	table = joinTable->getTable(tableSchema->name());
-	// ȿtableǷѾ
-	pk = tableSchema->primaryKey();
-	pkFieldName = tableSchema->getRealColumnName(pk->name());
-	int64_t rightPKValue = sqlResult[pkFieldName].toInt64();
-	m_right = table->selectByPK(rightPKValue);
-	if (!m_right) {
-		m_right = table->newRecord();
-		m_right->read(sqlResult);
-		table->append(m_right);
-	}
 }
 
 const MyVariant SQLJoinRecord::value(const std::string &fieldName) const
 {
-	if (m_left == nullptr || m_right == nullptr) {
+	int index = recordIndex(fieldName);
+	if (index < 0) {
 		return MyVariant();
 	}
 
-	if (static_cast<SQLNormalTableSchema *>(m_left->table()->schema())->findField(fieldName)) {
-		return m_left->value(fieldName);
-	}
-	else {
-		return m_right->value(fieldName);
-	}
+	return m_records[index].value(fieldName);
 }
 
 std::string SQLJoinRecord::strValue(const std::string &fieldName)
 {
-	if (m_left == nullptr || m_right == nullptr) {
+	int index = recordIndex(fieldName);
+	if (index < 0) {
 		return "";
 	}
 
-	if (static_cast<SQLNormalTableSchema *>(m_left->table()->schema())->findField(fieldName)) {
-		return m_left->strValue(fieldName);
-	}
-	else {
-		return m_right->strValue(fieldName);
-	}
+	return m_records[index].strValue(fieldName);
 }
 
 void SQLJoinRecord::setValue(const std::string &fieldName, const MyVariant &value)
 {
-	if (m_left == nullptr || m_right == nullptr) {
-		return;
-	}
-
-	if (static_cast<SQLNormalTableSchema *>(m_left->table()->schema())->findField(fieldName)) {
-		m_left->setValue(fieldName, value);
-	}
-	else {
-		m_right->setValue(fieldName, value);
+	int index = recordIndex(fieldName);
+	if (index >= 0) {
+		m_records[index].setValue(fieldName, value);
 	}
 }
 
@@ -503,18 +775,24 @@ int64_t SQLJoinRecord::pk() const
 
 void SQLJoinRecord::save(WriteBuffer* buffer)
 {
-	m_left->save(buffer);
-	m_right->save(buffer);
+	FOR_EACH(i, m_records) {
+		i->save(buffer);
+	}
+}
+
+int SQLJoinRecord::recordCount() const
+{
+	return m_records.size();
 }
 
-SQLRecord *SQLJoinRecord::left() const
+SQLRecord *SQLJoinRecord::record(int index) const
 {
-	return m_left;
+	return m_records[index].table() ? const_cast<SQLNormalRecord *>(&m_records[index]) : nullptr;
 }
 
-SQLRecord *SQLJoinRecord::right() const
+void SQLJoinRecord::setRecord(int index, SQLRecord *rec)
 {
-	return m_right;
+	m_records[index] = *static_cast<SQLNormalRecord *>(rec);
 }
 
 SQLJoinTable *SQLJoinRecord::joinTable() const
@@ -524,19 +802,35 @@ SQLJoinTable *SQLJoinRecord::joinTable() const
 
 void SQLJoinRecord::add(SQLRecord *rec)
 {
-	const std::string tableName = static_cast<SQLNormalTable *>(rec->table())->name();
-	if (tableName == joinTable()->left().name()) {
-		m_left = rec;
+	int index = joinTable()->tableIndex(static_cast<SQLNormalTable *>(rec->table())->name());
+	if (index >= 0) {
+		setRecord(index, rec);
+	}
+}
+
+int SQLJoinRecord::recordIndex(const std::string &fieldName) const
+{
+	// value isn't known until records of all tables are set
+	for (size_t i = 0; i < m_records.size(); ++i) {
+		if (!m_records[i].table()) {
+			return -1;
+		}
 	}
-	else if (tableName == joinTable()->right().name()) {
-		m_right = rec;
+
+	for (size_t i = 0; i < m_records.size(); ++i) {
+		if (static_cast<SQLNormalTableSchema *>(m_records[i].table()->schema())->findField(fieldName)) {
+			return i;
+		}
 	}
+
+	return m_records.empty() ? -1 : (int)m_records.size() - 1;
 }
 
 SQLTable::SQLTable(SQLTableSchema *tableSchema) :
 	m_schema(tableSchema),
 	m_used(0),
-	m_threadIndex(-1)
+	m_threadIndex(-1),
+	m_integerPK(true)
 {
 }
 
@@ -548,7 +842,7 @@ void SQLTable::save(WriteBuffer* buffer)
 {
 	doSave(buffer);
 	uint32_t oldUsed = m_used;
-	m_used = buffer->byteLength();
+	m_used = savedMemory(buffer);
 	SQLTableContainer::instance(m_threadIndex)->addMemoryUsed(m_used - oldUsed);
 }
 
@@ -564,6 +858,11 @@ void SQLTable::unload(OutputStream &out)
 	doUnload(out);
 }
 
+uint32_t SQLTable::savedMemory(WriteBuffer *buffer) const
+{
+	return buffer->byteLength();
+}
+
 void SQLTable::doSave(WriteBuffer *buffer)
 {
 	m_schema->save(buffer);
@@ -593,12 +892,35 @@ void SQLTable::load(InputStream &in)
 void SQLTable::doLoad(InputStream &in)
 {
 	m_schema = reinterpret_cast<SQLTableSchema *>(in.readULong());
+	resetAccessors();
 	int count = in.readInt();
 	for (int i = 0; i < count; ++i) {
 		m_params.add(in.readVariant());
 	}
 }
 
+void SQLTable::bindColumns(SQLResultReader &reader, SQLResultBinding &binding, 
+	bool directColumnName)
+{
+	SQLNormalTableSchema *tableSchema = static_cast<SQLNormalTableSchema *>(m_schema);
+	FieldSchema *pkField = tableSchema->primaryKey();
+	for (size_t i = 0; i < tableSchema->fieldCount(); ++i) {
+		FieldSchema *field = tableSchema->field(i);
+		FieldBinding fb;
+		fb.column = reader.columnIndex(directColumnName ? field->name() :
+			tableSchema->getRealColumnName(field->name()));
+		fb.fieldIndex = i;
+		fb.offset = tableSchema->dataOffSet(field->name());
+		fb.dataType = field->dataType();
+		binding.fields.push_back(fb);
+
+		// row is found by pk column before decoding only if pk is the key of records itself
+		if (field == pkField && tableSchema->isIntegerPK()) {
+			binding.pkColumn = fb.column;
+		}
+	}
+}
+
 SQLTableSchema *SQLTable::schema() const
 {
 	return m_schema;
@@ -607,6 +929,7 @@ SQLTableSchema *SQLTable::schema() const
 void SQLTable::setSchema(SQLTableSchema *schema)
 {
 	m_schema = schema;
+	resetAccessors();
 }
 
 TableKind SQLTable::kind() const
@@ -616,18 +939,103 @@ TableKind SQLTable::kind() const
 
 bool SQLTable::compareRecordByOrderFields(SQLRecord *rec1, SQLRecord *rec2)
 {
+	buildOrderAccessors();
 	for (int i = 0; i < m_schema->orderFieldCount(); ++i) {
-		const OrderFieldInfo &orderInfo = m_schema->orderField(i);
-		FieldSchema *field = orderInfo.field;
-		OrderType order = orderInfo.order;
-		MyVariant v1 = rec1->value(field->name());
-		MyVariant v2 = rec2->value(field->name());
+		OrderType order = m_schema->orderField(i).order;
+		MyVariant v1 = m_orderAccessors[i].value(rec1);
+		MyVariant v2 = m_orderAccessors[i].value(rec2);
 		COMPARE_RESULT(v1, v2, order);
 	}
 
 	return false;
 }
 
+int64_t SQLTable::pkValue(const SQLRecord *rec, bool acquire) const
+{
+	SQLNormalTableSchema *tableSchema = static_cast<SQLNormalTableSchema *>(m_schema);
+	if (m_pkAccessors.empty()) {
+		buildPKAccessors();
+		if (m_pkAccessors.empty()) {
+			return 0;
+		}
+	}
+
+	if (m_integerPK) {
+		return m_pkAccessors[0].value(rec).toInt64();
+	}
+
+	std::string key;
+	for (size_t i = 0; i < m_pkAccessors.size(); ++i) {
+		PKDictionary::pack(key, tableSchema->primaryKey(i)->dataType(), m_pkAccessors[i].value(rec));
+	}
+	PKDictionary *dictionary = PKDictionary::instance(m_threadIndex);
+	return acquire ? dictionary->acquire(tableSchema->name(), key) : dictionary->find(tableSchema->name(), key);
+}
+
+void SQLTable::buildPKAccessors() const
+{
+	SQLNormalTableSchema *tableSchema = static_cast<SQLNormalTableSchema *>(m_schema);
+	m_pkAccessors.clear();
+	if (!tableSchema->primaryKey()) {
+		return;
+	}
+
+	for (int i = 0; i < tableSchema->primaryKeyCount(); ++i) {
+		m_pkAccessors.emplace_back(tableSchema->primaryKey(i)->name());
+	}
+	m_integerPK = tableSchema->isIntegerPK();
+}
+
+void SQLTable::bindPK()
+{
+	buildPKAccessors();
+	FOR_EACH(i, m_pkAccessors) {
+		i->bind(m_schema);
+	}
+}
+
+void SQLTable::resetAccessors()
+{
+	m_orderAccessors.clear();
+	m_pkAccessors.clear();
+}
+
+void SQLTable::buildOrderAccessors()
+{
+	if ((int)m_orderAccessors.size() != m_schema->orderFieldCount()) {
+		m_orderAccessors.clear();
+		for (int i = 0; i < m_schema->orderFieldCount(); ++i) {
+			m_orderAccessors.emplace_back(m_schema->orderField(i).field->name());
+		}
+	}
+}
+
+OrderKey SQLTable::orderKey(SQLRecord *rec)
+{
+	buildOrderAccessors();
+	OrderKey key;
+	key.values.reserve(m_orderAccessors.size());
+	FOR_EACH(i, m_orderAccessors) {
+		key.values.push_back(i->value(rec));
+	}
+	key.pk = pkValue(rec);
+	return key;
+}
+
+bool OrderKeyLess::operator()(const OrderKey &key1, const OrderKey &key2) const
+{
+	for (size_t i = 0; i < key1.values.size(); ++i) {
+		OrderType order = schema->orderField(i).order;
+		COMPARE_RESULT(key1.values[i], key2.values[i], order);
+	}
+
+	return key1.pk < key2.pk;
+}
+
+void SQLTable::clear()
+{
+}
+
 void SQLTable::setThreadIndex(int8_t index)
 {
 	m_threadIndex = index;
@@ -648,14 +1056,6 @@ uint32_t SQLTable::meomoryUsed() const
 	return m_used;
 }
 
-SQLNormalRecord::SQLNormalRecord(SQLTable *table) :
-	SQLRecord(table)
-{
-	m_dataId = 
-		MemoryManager::instantce(table->threadIndex()).arrayMemory().allocate(
-			m_table->schema()->recordLength());
-}
-
 SQLNormalRecord::SQLNormalRecord(SQLTable *table, uint32_t dataId) :
 	SQLRecord(table),
 	m_dataId(dataId)
@@ -663,15 +1063,26 @@ SQLNormalRecord::SQLNormalRecord(SQLTable *table, uint32_t dataId) :
 }
 
 SQLNormalRecord::~SQLNormalRecord()
+{
+}
+
+void SQLNormalRecord::allocate()
+{
+	m_dataId = 
+		MemoryManager::instantce(m_table->threadIndex()).arrayMemory().allocate(
+			m_table->schema()->recordLength());
+}
+
+void SQLNormalRecord::recycle()
 {
 	MemoryManager &mem = MemoryManager::instantce(m_table->threadIndex());
 	ArrayMemoryManager &arrayMemory = mem.arrayMemory();
 	SQLNormalTableSchema *tableSchema = static_cast<SQLNormalTableSchema *>(m_table->schema());
 	for (int i = 0; i < tableSchema->fieldCount(); ++i) {
-		FieldSchema *fd = tableSchema->field(i);
-		if (fd->dataType() == DataType::dtString ||
-			fd->dataType() == DataType::dtBlob) {
-			uint32_t varId = arrayMemory.memoryOperator(m_dataId).getUint32(tableSchema->dataOffSet(fd->name()));
+		const FieldHandle &handle = tableSchema->fieldHandle(i);
+		if (handle.dataType == DataType::dtString ||
+			handle.dataType == DataType::dtBlob) {
+			uint32_t varId = arrayMemory.memoryOperator(m_dataId).getUint32(handle.offset);
 			mem.varMemory().clear(varId);
 		}
 	}
@@ -682,22 +1093,26 @@ SQLNormalRecord::~SQLNormalRecord()
 void SQLNormalRecord::setValue(const std::string &fieldName, const MyVariant &value)
 {
 	SQLNormalTableSchema *tableSchema = static_cast<SQLNormalTableSchema *>(m_table->schema());
-	int32_t offset = tableSchema->dataOffSet(fieldName);
-	if (offset == -1) {
+	int index = tableSchema->fieldIndex(fieldName);
+	if (index < 0) {
 		return;
 	}
 
-	int index = tableSchema->fieldIndex(fieldName);
+	setValue(tableSchema->fieldHandle(index), value);
+}
+
+void SQLNormalRecord::setValue(const FieldHandle &handle, const MyVariant &value)
+{
+	uint32_t offset = handle.offset;
 	auto &mm = MemoryManager::instantce(m_table->threadIndex());
 	auto &memOpr = mm.arrayMemory().memoryOperator(m_dataId);
 	if (value.isNull()) {
-		setNull(index, true);
+		setNull(handle, true);
 		return;
 	}
 	
-	setNull(index, false);
-	FieldSchema* fd = tableSchema->field(index);
-	switch (fd->dataType())
+	setNull(handle, false);
+	switch (handle.dataType)
 	{
 		case DataType::dtBoolean:
 			memOpr.setInt8(offset, value.toBool() ? 1 : 0);
@@ -752,20 +1167,24 @@ int64_t SQLNormalRecord::pk() const
 const MyVariant SQLNormalRecord::value(const std::string &fieldName) const
 {
 	SQLNormalTableSchema *tableSchema = static_cast<SQLNormalTableSchema *>(m_table->schema());
-	int32_t offset = tableSchema->dataOffSet(fieldName);
 	int fieldIndex = tableSchema->fieldIndex(fieldName);
 	if (fieldIndex < 0) {
 		return MyVariant();
 	}
 
+	return value(tableSchema->fieldHandle(fieldIndex));
+}
+
+const MyVariant SQLNormalRecord::value(const FieldHandle &handle) const
+{
+	uint32_t offset = handle.offset;
 	auto &mm = MemoryManager::instantce(m_table->threadIndex());
 	auto &memOpr = mm.arrayMemory().memoryOperator(m_dataId);
-	if (isNull(fieldIndex)) {
+	if (isNull(handle)) {
 		return MyVariant();
 	}
 
-	FieldSchema* fd = tableSchema->field(fieldIndex);
-	switch (fd->dataType())
+	switch (handle.dataType)
 	{
 		case DataType::dtBoolean:
 			return memOpr.getInt8(offset) == 1 ? true : false;
@@ -805,140 +1224,170 @@ const MyVariant SQLNormalRecord::value(const std::string &fieldName) const
 	return MyVariant();
 }
 
-std::string SQLNormalRecord::strValue(const std::string &fieldName)
+bool SQLNormalRecord::intValue(const FieldHandle &handle, int64_t &result) const
 {
-	SQLNormalTableSchema *tableSchema = static_cast<SQLNormalTableSchema *>(m_table->schema());
-	uint32_t offset = tableSchema->dataOffSet(fieldName);
-	int fieldIndex = tableSchema->fieldIndex(fieldName);
-	auto &mm = MemoryManager::instantce(m_table->threadIndex());
-	auto &memOpr = mm.arrayMemory().memoryOperator(m_dataId);
-	if (isNull(fieldIndex)) {
-		return "NULL";
+	auto &memOpr = MemoryManager::instantce(m_table->threadIndex()).arrayMemory().memoryOperator(m_dataId);
+	if (isNull(handle)) {
+		return false;
 	}
 
-	FieldSchema* fd = tableSchema->field(fieldIndex);
-	switch (fd->dataType())
+	switch (handle.dataType)
 	{
 		case DataType::dtBoolean:
-			return memOpr.getInt8(offset) == 1 ? "true" : "false";
+			result = memOpr.getInt8(handle.offset);
+			break;
 		case DataType::dtSmallInt:
-			return to_string(memOpr.getInt16(offset));
+			result = memOpr.getInt16(handle.offset);
+			break;
 		case DataType::dtInt:
-			return to_string(memOpr.getInt32(offset));
+			result = memOpr.getInt32(handle.offset);
+			break;
 		case DataType::dtBigInt:
-			return to_string(memOpr.getInt64(offset));
-		case DataType::dtFloat:
-		case DataType::dtDouble:
-			return to_string(memOpr.getFloat64(offset));
-		case DataType::dtString:
-		{
-			uint32_t varId = memOpr.getUint32(offset);
-			if (varId == 0) {
-				return string();
-			}
-
-			VarData vData = mm.varMemory().get(varId);
-			return string((char *)vData.data, vData.len);
-		}
-		default:
+			result = memOpr.getInt64(handle.offset);
 			break;
+		default:
+			return SQLRecord::intValue(handle, result);
 	}
 
-	return "";
+	return true;
 }
 
-void SQLNormalRecord::save(WriteBuffer* buffer)
+bool SQLNormalRecord::doubleValue(const FieldHandle &handle, double &result) const
 {
-	auto tableSchema = static_cast<SQLNormalTableSchema *>(m_table->schema());
-	MemoryManager::instantce(m_table->threadIndex()).arrayMemory().memoryOperator(m_dataId);
-	writeNullBit(buffer, tableSchema);
-	for (int i = 0; i < tableSchema->fieldCount(); ++i) {
-		FieldSchema *fd = tableSchema->field(i);
-		writeField(buffer, fd, tableSchema->dataOffSet(fd->name()));
+	auto &memOpr = MemoryManager::instantce(m_table->threadIndex()).arrayMemory().memoryOperator(m_dataId);
+	if (isNull(handle)) {
+		return false;
 	}
-}
 
-void SQLNormalRecord::read(std::unordered_map<std::string, MyVariant>& sqlResult, 
-	bool directColumnName)
-{
-	auto tableSchema = static_cast<SQLNormalTableSchema *>(m_table->schema());
-	MemoryManager::instantce(m_table->threadIndex()).arrayMemory().memoryOperator(m_dataId);
-	for (int i = 0; i < tableSchema->fieldCount(); ++i) {
-		FieldSchema *field = tableSchema->field(i);
-		readField(sqlResult, field, directColumnName ? field->name() :
-			tableSchema->getRealColumnName(field->name()));
+	switch (handle.dataType)
+	{
+		case DataType::dtFloat:
+		case DataType::dtDouble:
+			result = memOpr.getFloat64(handle.offset);
+			break;
+		default:
+			return SQLRecord::doubleValue(handle, result);
 	}
+
+	return true;
 }
 
-void SQLNormalRecord::readField(std::unordered_map<std::string, MyVariant>& sqlResult, 
-	FieldSchema *field, const std::string &sqlFieldName)
+std::string SQLNormalRecord::strValue(const std::string &fieldName)
 {
-	auto& mm = MemoryManager::instantce(m_table->threadIndex());
-	auto& memOpr = mm.arrayMemory().memoryOperator();
+	SQLNormalTableSchema *tableSchema = static_cast<SQLNormalTableSchema *>(m_table->schema());
+	int fieldIndex = tableSchema->fieldIndex(fieldName);
+	if (fieldIndex < 0) {
+		return "NULL";
+	}
 
-	auto tableSchema = static_cast<SQLNormalTableSchema*>(m_table->schema());
-	int fieldIndex = tableSchema->fieldIndex(field->name());
-	if (sqlResult[sqlFieldName].isNull()) {
-		setNull(fieldIndex, true);
-		return;
+	const FieldHandle &handle = tableSchema->fieldHandle(fieldIndex);
+	uint32_t offset = handle.offset;
+	auto &mm = MemoryManager::instantce(m_table->threadIndex());
+	auto &memOpr = mm.arrayMemory().memoryOperator(m_dataId);
+	if (isNull(handle)) {
+		return "NULL";
 	}
-	
-	setNull(fieldIndex, false);
-	uint32_t offset = tableSchema->dataOffSet(field->name());
-	switch (field->dataType())
+
+	switch (handle.dataType)
 	{
 		case DataType::dtBoolean:
-		{
-			memOpr.setInt8(offset, sqlResult[sqlFieldName].toBool() ? 1 : 0);
-			break;
-		}
+			return memOpr.getInt8(offset) == 1 ? "true" : "false";
 		case DataType::dtSmallInt:
-		{
-			memOpr.setInt16(offset, sqlResult[sqlFieldName].toInt());
-			break;
-		}
+			return to_string(memOpr.getInt16(offset));
 		case DataType::dtInt:
-		{
-			memOpr.setInt32(offset, sqlResult[sqlFieldName].toInt());
-			break;
-		}
+			return to_string(memOpr.getInt32(offset));
 		case DataType::dtBigInt:
-		{
-			memOpr.setInt64(offset, sqlResult[sqlFieldName].toInt64());
-			break;
-		}
+			return to_string(memOpr.getInt64(offset));
 		case DataType::dtFloat:
 		case DataType::dtDouble:
-		{
-			memOpr.setFloat64(offset, sqlResult[sqlFieldName].toDouble());
-			break;
-		}
+			return to_string(memOpr.getFloat64(offset));
 		case DataType::dtString:
 		{
-			string strValue = sqlResult[sqlFieldName].toString();
-			if (strValue.empty()) {
-				memOpr.setUint32(offset, 0);
-			}
-			else {
-				uint32_t varId = mm.varMemory().set(VarData((uint8_t *)strValue.c_str(), strValue.size()));
-				memOpr.setUint32(offset, varId);
+			uint32_t varId = memOpr.getUint32(offset);
+			if (varId == 0) {
+				return string();
 			}
+
+			VarData vData = mm.varMemory().get(varId);
+			return string((char *)vData.data, vData.len);
+		}
+		default:
 			break;
+	}
+
+	return "";
+}
+
+void SQLNormalRecord::save(WriteBuffer* buffer)
+{
+	auto tableSchema = static_cast<SQLNormalTableSchema *>(m_table->schema());
+	MemoryManager::instantce(m_table->threadIndex()).arrayMemory().memoryOperator(m_dataId);
+	writeNullBit(buffer, tableSchema);
+	for (int i = 0; i < tableSchema->fieldCount(); ++i) {
+		const FieldHandle &handle = tableSchema->fieldHandle(i);
+		writeField(buffer, handle.field, handle.offset);
+	}
+}
+
+void SQLNormalRecord::read(SQLResultReader &reader, const SQLResultBinding &binding)
+{
+	auto tableSchema = static_cast<SQLNormalTableSchema *>(m_table->schema());
+	auto &mm = MemoryManager::instantce(m_table->threadIndex());
+	auto &memOpr = mm.arrayMemory().memoryOperator(m_dataId);
+	FOR_EACH(i, binding.fields) {
+		const FieldBinding &fb = *i;
+		const FieldHandle &handle = tableSchema->fieldHandle(fb.fieldIndex);
+		if (fb.column < 0 || reader.isNull(fb.column)) {
+			setNull(handle, true);
+			continue;
 		}
-		case DataType::dtBlob:
+
+		setNull(handle, false);
+		switch (fb.dataType)
 		{
-			ByteArray blobValue = sqlResult[sqlFieldName].toBlob();
-			if (blobValue->byteLength() == 0) {
-				memOpr.setUint32(offset, 0);
+			case DataType::dtBoolean:
+				memOpr.setInt8(fb.offset, reader.getBoolean(fb.column) ? 1 : 0);
+				break;
+			case DataType::dtSmallInt:
+				memOpr.setInt16(fb.offset, reader.getInt(fb.column));
+				break;
+			case DataType::dtInt:
+				memOpr.setInt32(fb.offset, reader.getInt(fb.column));
+				break;
+			case DataType::dtBigInt:
+				memOpr.setInt64(fb.offset, reader.getInt64(fb.column));
+				break;
+			case DataType::dtFloat:
+			case DataType::dtDouble:
+				memOpr.setFloat64(fb.offset, reader.getDouble(fb.column));
+				break;
+			case DataType::dtString:
+			{
+				string strValue = reader.getString(fb.column);
+				if (strValue.empty()) {
+					memOpr.setUint32(fb.offset, 0);
+				}
+				else {
+					uint32_t varId = mm.varMemory().set(VarData((uint8_t *)strValue.c_str(), strValue.size()));
+					memOpr.setUint32(fb.offset, varId);
+				}
+				break;
 			}
-			else {
-				uint32_t varId = mm.varMemory().set(VarData(blobValue->data(), blobValue->byteLength()));
-				memOpr.setUint32(offset, varId);
+			case DataType::dtBlob:
+			{
+				ByteArray blobValue = reader.getBlob(fb.column);
+				if (blobValue->byteLength() == 0) {
+					memOpr.setUint32(fb.offset, 0);
+				}
+				else {
+					uint32_t varId = mm.varMemory().set(VarData(blobValue->data(), blobValue->byteLength()));
+					memOpr.setUint32(fb.offset, varId);
+				}
+				break;
 			}
-			break;
+			default:
+				break;
 		}
-		default:
-			break;
 	}
 }
 
@@ -984,49 +1433,16 @@ void SQLNormalRecord::writeNullBit(WriteBuffer* buffer, SQLNormalTableSchema* ta
 	}
 }
 
-void SQLNormalRecord::setNull(int fieldIndex, bool value)
+void SQLNormalRecord::setNull(const FieldHandle &handle, bool value)
 {
 	auto& memOpr = MemoryManager::instantce(m_table->threadIndex()).arrayMemory().memoryOperator();
-	auto tableSchema = static_cast<SQLNormalTableSchema*>(m_table->schema());
-	if (tableSchema->kind() == TableKind::tkExtend) {
-		auto exTableSchema = static_cast<SQLExtendTableSchema*>(tableSchema);
-		if (fieldIndex < tableSchema->fieldCount() - exTableSchema->extendFieldCount()) {
-			int8_t byteIndex = fieldIndex / 8;
-			memOpr.setBit(byteIndex, fieldIndex - byteIndex * 8, value ? 1 : 0);
-		}
-		else {
-			int8_t exFieldIndex = fieldIndex - (tableSchema->fieldCount() - exTableSchema->extendFieldCount());
-			int8_t byteIndex = exFieldIndex / 8;
-			memOpr.setBit(exTableSchema->extendOffSet() + byteIndex, exFieldIndex - byteIndex * 8, value ? 1 : 0);
-		}
-	}
-	else {
-		int8_t byteIndex = fieldIndex / 8;
-		memOpr.setBit(byteIndex, fieldIndex - byteIndex * 8, value ? 1 : 0);
-	}
+	memOpr.setBit(handle.nullByte, handle.nullBit, value ? 1 : 0);
 }
 
-bool SQLNormalRecord::isNull(int fieldIndex) const
+bool SQLNormalRecord::isNull(const FieldHandle &handle) const
 {
 	auto& memOpr = MemoryManager::instantce(m_table->threadIndex()).arrayMemory().memoryOperator();
-	auto tableSchema = static_cast<SQLNormalTableSchema*>(m_table->schema());
-	if (tableSchema->kind() == TableKind::tkExtend) {
-		auto exTableSchema = static_cast<SQLExtendTableSchema*>(tableSchema);
-		int normalFieldCount = tableSchema->fieldCount() - exTableSchema->extendFieldCount();
-		if (fieldIndex < normalFieldCount) {
-			int8_t byteIndex = fieldIndex / 8;
-			return memOpr.getBit(byteIndex, fieldIndex - byteIndex * 8) == 1;
-		}
-		else {
-			int8_t exFieldIndex = fieldIndex - normalFieldCount;
-			int8_t byteIndex = exFieldIndex / 8;
-			return memOpr.getBit(exTableSchema->extendOffSet() + byteIndex, exFieldIndex - byteIndex * 8) == 1;
-		}
-	}
-	else {
-		int8_t byteIndex = fieldIndex / 8;
-		return memOpr.getBit(byteIndex, fieldIndex - byteIndex * 8) == 1;
-	}
+	return memOpr.getBit(handle.nullByte, handle.nullBit) == 1;
 }
 
 void SQLNormalRecord::writeField(WriteBuffer* buffer, FieldSchema *field, uint32_t offset)
@@ -1095,73 +1511,357 @@ uint32_t SQLNormalRecord::dataId() const
 	return m_dataId;
 }
 
-SQLReadOnlyTable::SQLReadOnlyTable(SQLTableSchema *schema) :
-	SQLTable(schema)
+void SQLNormalRecord::setDataId(uint32_t dataId)
 {
+	m_dataId = dataId;
 }
 
-SQLReadOnlyTable::~SQLReadOnlyTable()
+SQLAggregateTable::SQLAggregateTable(SQLTableSchema *schema) :
+	SQLTable(schema),
+	m_newRecord(new SQLNormalRecord(this)),
+	m_cursor(new SQLNormalRecord(this)),
+	m_groupIndex(nullptr)
 {
-	for (int i = 0; i < m_recs.size(); ++i) {
-		delete m_recs[i];
+}
+
+SQLAggregateTable::~SQLAggregateTable()
+{
+	for (size_t i = 0; i < m_dataIds.size(); ++i) {
+		m_newRecord->setDataId(m_dataIds[i]);
+		m_newRecord->recycle();
 	}
+	delete m_newRecord;
+	delete m_cursor;
+	delete m_groupIndex;
 }
 
-TableKind SQLReadOnlyTable::kind() const
+TableKind SQLAggregateTable::kind() const
 {
-	return TableKind::tkReadOnly;
+	return TableKind::tkAggregate;
 }
 
-SQLRecord *SQLReadOnlyTable::newRecord()
+SQLRecord *SQLAggregateTable::newRecord()
 {
-	SQLRecord *rec = new SQLNormalRecord(this);
-	return rec;
+	m_newRecord->allocate();
+	return m_newRecord;
 }
 
-SQLRecord *SQLReadOnlyTable::append(SQLRecord *rec)
+SQLRecord *SQLAggregateTable::append(SQLRecord *rec)
 {
-	m_recs.push_back(static_cast<SQLNormalRecord *>(rec));
+	uint32_t dataId = static_cast<SQLNormalRecord *>(rec)->dataId();
+	m_dataIds.push_back(dataId);
+	if (m_groupIndex) {
+		(*m_groupIndex)[groupKey(rec)] = dataId;
+	}
 	return rec;
 }
 
-int SQLReadOnlyTable::recordCount() const
+int SQLAggregateTable::recordCount() const
 {
-	return m_recs.size();
+	return m_dataIds.size();
 }
 
-void SQLReadOnlyTable::forEach(const ForEachRecordEvent &e)
+void SQLAggregateTable::forEach(const ForEachRecordEvent &e)
 {
-	for (int i = 0; i < m_recs.size(); ++i) {
-		e(m_recs[i]);
+	SQLNormalRecord rec(this);
+	for (size_t i = 0; i < m_dataIds.size(); ++i) {
+		rec.setDataId(m_dataIds[i]);
+		e(&rec);
+	}
+}
+
+SQLRecord *SQLAggregateTable::readRecord(SQLResultReader &reader, const SQLResultBinding &binding)
+{
+	SQLNormalRecord *newRec = static_cast<SQLNormalRecord *>(newRecord());
+	newRec->read(reader, binding);
+	return append(newRec);
+}
+
+void SQLAggregateTable::clear()
+{
+	for (size_t i = 0; i < m_dataIds.size(); ++i) {
+		group(m_dataIds[i])->recycle();
+	}
+	m_dataIds.clear();
+	delete m_groupIndex;
+	m_groupIndex = nullptr;
+}
+
+bool SQLAggregateTable::insert(SQLRecord *rec)
+{
+	buildAccessors();
+	buildGroupIndex();
+	MyVariants key;
+	FOR_EACH(i, m_groupAccessors) {
+		key.add(i->value(rec));
+	}
+
+	auto g = m_groupIndex->find(key);
+	SQLNormalRecord *dstGroup = g != m_groupIndex->end() ? group(g->second) : newGroup(key);
+	dstGroup->setValue(m_countHandle, dstGroup->value(m_countHandle).toInt64() + 1);
+	for (size_t i = 0; i < m_aggregateAccessors.size(); ++i) {
+		applyAggregate(dstGroup, i, m_aggregateAccessors[i].value(rec), 1);
+	}
+
+	return true;
+}
+
+bool SQLAggregateTable::remove(SQLRecord *rec)
+{
+	buildAccessors();
+	buildGroupIndex();
+	MyVariants key;
+	FOR_EACH(i, m_groupAccessors) {
+		key.add(i->value(rec));
+	}
+
+	// all groups are kept, even if they don't match HAVING
+	auto g = m_groupIndex->find(key);
+	if (g == m_groupIndex->end()) {
+		return true;
+	}
+
+	SQLNormalRecord *dstGroup = group(g->second);
+	int64_t count = dstGroup->value(m_countHandle).toInt64() - 1;
+	if (count <= 0) {
+		removeGroup(g->second, key);
+		return true;
+	}
+
+	dstGroup->setValue(m_countHandle, count);
+	bool result = true;
+	for (size_t i = 0; i < m_aggregateAccessors.size(); ++i) {
+		result = applyAggregate(dstGroup, i, m_aggregateAccessors[i].value(rec), -1) && result;
 	}
+
+	return result;
 }
 
-void SQLReadOnlyTable::doSave(WriteBuffer* buffer)
+void SQLAggregateTable::doSave(WriteBuffer* buffer)
 {
 	SQLTable::doSave(buffer);
-	buffer->writeInt(m_recs.size());
-	for (int i = 0; i < m_recs.size(); ++i) {
-		m_recs[i]->save(buffer);
+	GroupByInfo *info = groupByInfo();
+	std::vector<uint32_t> dataIds;
+	if (info && info->having) {
+		// groups not matching HAVING are kept for later updates, but not returned
+		forEach([&](SQLRecord *rec) {
+			if (info->having->match(rec, m_params)) {
+				dataIds.push_back(static_cast<SQLNormalRecord *>(rec)->dataId());
+			}
+		});
+	}
+	else {
+		dataIds = m_dataIds;
+	}
+
+	if (m_schema->orderFieldCount() > 0) {
+		// groups created by updates are appended, order of db result isn't kept
+		SQLNormalRecord rec1(this);
+		SQLNormalRecord rec2(this);
+		std::stable_sort(dataIds.begin(), dataIds.end(), [&](uint32_t dataId1, uint32_t dataId2) {
+			rec1.setDataId(dataId1);
+			rec2.setDataId(dataId2);
+			return compareRecordByOrderFields(&rec1, &rec2);
+		});
+	}
+
+	buffer->writeInt(dataIds.size());
+	SQLNormalRecord rec(this);
+	FOR_EACH(i, dataIds) {
+		rec.setDataId(*i);
+		rec.save(buffer);
 	}
 }
 
-void SQLReadOnlyTable::doUnload(OutputStream &out)
+void SQLAggregateTable::doUnload(OutputStream &out)
 {
 	SQLTable::doUnload(out);
-	out.writeInt(m_recs.size());
-	for (int i = 0; i < m_recs.size(); ++i) {
-		out.writeUInt(m_recs[i]->dataId());
+	out.writeInt(m_dataIds.size());
+	for (size_t i = 0; i < m_dataIds.size(); ++i) {
+		out.writeUInt(m_dataIds[i]);
 	}
 }
 
-void SQLReadOnlyTable::doLoad(InputStream &in)
+void SQLAggregateTable::doLoad(InputStream &in)
 {
 	SQLTable::doLoad(in);
 	int32_t count = in.readInt();
+	m_dataIds.reserve(count);
 	for (int i = 0; i < count; ++i) {
-		uint32_t dataId = in.readUInt();
-		m_recs.push_back(new SQLNormalRecord(this, dataId));
+		m_dataIds.push_back(in.readUInt());
+	}
+}
+
+void SQLAggregateTable::resetAccessors()
+{
+	SQLTable::resetAccessors();
+	m_groupAccessors.clear();
+	m_aggregateAccessors.clear();
+	m_groupHandles.clear();
+	m_aggregateHandles.clear();
+	delete m_groupIndex;
+	m_groupIndex = nullptr;
+}
+
+GroupByInfo *SQLAggregateTable::groupByInfo() const
+{
+	return m_schema->groupByInfo();
+}
+
+void SQLAggregateTable::buildAccessors()
+{
+	GroupByInfo *info = groupByInfo();
+	if (m_groupHandles.size() == info->groupFields.size()) {
+		return;
+	}
+
+	SQLNormalTableSchema *tableSchema = static_cast<SQLNormalTableSchema *>(m_schema);
+	FOR_EACH(i, info->groupFields) {
+		m_groupAccessors.emplace_back(i->field->name());
+		m_groupHandles.push_back(tableSchema->fieldHandle(i->name));
+	}
+
+	FOR_EACH(i, info->aggregateFields) {
+		m_aggregateAccessors.emplace_back(i->field->name());
+		AggregateHandles handles;
+		handles.value = tableSchema->fieldHandle(i->name);
+		handles.count = tableSchema->fieldHandle(i->name + AGGREGATE_COUNT_SUFFIX);
+		handles.sum = tableSchema->fieldHandle(i->name + AGGREGATE_SUM_SUFFIX);
+		m_aggregateHandles.push_back(handles);
+	}
+
+	m_countHandle = tableSchema->fieldHandle(COUNT_COLUMN_NAME);
+}
+
+void SQLAggregateTable::buildGroupIndex()
+{
+	if (m_groupIndex) {
+		return;
+	}
+
+	m_groupIndex = new std::unordered_map<MyVariants, uint32_t>();
+	forEach([&](SQLRecord *rec) {
+		(*m_groupIndex)[groupKey(rec)] = static_cast<SQLNormalRecord *>(rec)->dataId();
+	});
+}
+
+MyVariants SQLAggregateTable::groupKey(SQLRecord *rec)
+{
+	buildAccessors();
+	MyVariants key;
+	FOR_EACH(i, m_groupHandles) {
+		key.add(rec->value(*i));
+	}
+	return key;
+}
+
+SQLNormalRecord *SQLAggregateTable::group(uint32_t dataId)
+{
+	m_cursor->setDataId(dataId);
+	return m_cursor;
+}
+
+SQLNormalRecord *SQLAggregateTable::newGroup(const MyVariants &key)
+{
+	SQLNormalRecord *rec = static_cast<SQLNormalRecord *>(newRecord());
+	SQLNormalTableSchema *tableSchema = static_cast<SQLNormalTableSchema *>(m_schema);
+	for (size_t i = 0; i < tableSchema->fieldCount(); ++i) {
+		rec->setValue(tableSchema->fieldHandle(i), MyVariant());
+	}
+
+	for (size_t i = 0; i < m_groupHandles.size(); ++i) {
+		rec->setValue(m_groupHandles[i], key.variant(i));
+	}
+
+	// COUNT of empty group is 0, other aggregates are null
+	rec->setValue(m_countHandle, (int64_t)0);
+	GroupByInfo *info = groupByInfo();
+	for (size_t i = 0; i < m_aggregateHandles.size(); ++i) {
+		if (info->aggregateFields[i].aggregateFunc == AggregateFunction::gfCount) {
+			rec->setValue(m_aggregateHandles[i].value, (int64_t)0);
+		}
+		else if (m_aggregateHandles[i].count.field) {
+			rec->setValue(m_aggregateHandles[i].count, (int64_t)0);
+		}
+	}
+
+	append(rec);
+	return group(rec->dataId());
+}
+
+void SQLAggregateTable::removeGroup(uint32_t dataId, const MyVariants &key)
+{
+	m_groupIndex->erase(key);
+	m_dataIds.erase(std::find(m_dataIds.begin(), m_dataIds.end(), dataId));
+	group(dataId)->recycle();
+}
+
+bool SQLAggregateTable::applyAggregate(SQLNormalRecord *group, int index, const MyVariant &value,
+	int delta)
+{
+	// null values are ignored by aggregate functions
+	if (value.isNull()) {
+		return true;
+	}
+
+	AggregateFunction func = groupByInfo()->aggregateFields[index].aggregateFunc;
+	const AggregateHandles &handles = m_aggregateHandles[index];
+	switch (func) {
+		case AggregateFunction::gfCount:
+			group->setValue(handles.value, group->value(handles.value).toInt64() + delta);
+			break;
+		case AggregateFunction::gfSum:
+		case AggregateFunction::gfAvg:
+		{
+			int64_t count = group->value(handles.count).toInt64() + delta;
+			group->setValue(handles.count, count);
+
+			const FieldHandle &sumHandle = func == AggregateFunction::gfSum ? handles.value : handles.sum;
+			// integers are summed as int64, so large sums aren't rounded by double
+			MyVariant sum;
+			if (sumHandle.dataType == DataType::dtBigInt) {
+				sum = group->value(sumHandle).toInt64() + value.toInt64() * delta;
+			}
+			else {
+				sum = group->value(sumHandle).toDouble() + value.toDouble() * delta;
+			}
+			if (count <= 0) {
+				// SUM and AVG of no value is null
+				group->setValue(handles.value, MyVariant());
+				if (func == AggregateFunction::gfAvg) {
+					group->setValue(handles.sum, MyVariant());
+				}
+			}
+			else if (func == AggregateFunction::gfSum) {
+				group->setValue(handles.value, sum);
+			}
+			else {
+				group->setValue(handles.sum, sum);
+				group->setValue(handles.value, sum.toDouble() / count);
+			}
+			break;
+		}
+		case AggregateFunction::gfMax:
+		case AggregateFunction::gfMin:
+		{
+			MyVariant extreme = group->value(handles.value);
+			bool isMax = func == AggregateFunction::gfMax;
+			if (delta > 0) {
+				if (extreme.isNull() || (isMax ? value > extreme : value < extreme)) {
+					group->setValue(handles.value, value);
+				}
+			}
+			else if (!extreme.isNull() && (isMax ? value >= extreme : value <= extreme)) {
+				// the next MIN/MAX isn't known without values of group
+				return false;
+			}
+			break;
+		}
+		default:
+			break;
 	}
+
+	return true;
 }
 
 SQLExtendRecord::SQLExtendRecord(SQLRecord *base) :
@@ -1202,6 +1902,33 @@ void SQLExtendRecord::setValue(const std::string &fieldName, const MyVariant &va
 	m_base->setValue(fieldName, value);
 }
 
+const MyVariant SQLExtendRecord::value(const FieldHandle &handle) const
+{
+	if (m_fieldMap.empty()) {
+		return m_base->value(handle);
+	}
+
+	return value(handle.field->name());
+}
+
+bool SQLExtendRecord::intValue(const FieldHandle &handle, int64_t &result) const
+{
+	if (m_fieldMap.empty()) {
+		return m_base->intValue(handle, result);
+	}
+
+	return SQLRecord::intValue(handle, result);
+}
+
+bool SQLExtendRecord::doubleValue(const FieldHandle &handle, double &result) const
+{
+	if (m_fieldMap.empty()) {
+		return m_base->doubleValue(handle, result);
+	}
+
+	return SQLRecord::doubleValue(handle, result);
+}
+
 int64_t SQLExtendRecord::pk() const
 {
 	return m_base->pk();
@@ -1226,14 +1953,19 @@ const MyVariant SQLTempRecord::value(const std::string &fieldName) const
 		return MyVariant();
 	}
 
-	if (isNull(fieldIndex)) {
+	return value(tableSchema->fieldHandle(fieldIndex));
+}
+
+const MyVariant SQLTempRecord::value(const FieldHandle &handle) const
+{
+	// field data isn't at fixed offset in temp record, only index of handle is used
+	if (isNull(handle.index)) {
 		return MyVariant();
 	}
 
-	FieldSchema* fd = tableSchema->field(fieldIndex);
-	int32_t offset = m_offsets[fieldIndex];
+	int32_t offset = m_offsets[handle.index];
 	auto data = static_cast<SQLTempTable*>(m_table)->data();
-	switch (fd->dataType())
+	switch (handle.dataType)
 	{
 		case DataType::dtBoolean:
 			return data->getInt8(offset) == 1 ? true : false;
@@ -1268,6 +2000,54 @@ const MyVariant SQLTempRecord::value(const std::string &fieldName) const
 	return MyVariant();
 }
 
+bool SQLTempRecord::intValue(const FieldHandle &handle, int64_t &result) const
+{
+	if (isNull(handle.index)) {
+		return false;
+	}
+
+	int32_t offset = m_offsets[handle.index];
+	auto data = static_cast<SQLTempTable*>(m_table)->data();
+	switch (handle.dataType)
+	{
+		case DataType::dtBoolean:
+			result = data->getInt8(offset);
+			break;
+		case DataType::dtSmallInt:
+			result = data->getInt16(offset);
+			break;
+		case DataType::dtInt:
+			result = data->getInt32(offset);
+			break;
+		case DataType::dtBigInt:
+			result = data->getInt64(offset);
+			break;
+		default:
+			return SQLRecord::intValue(handle, result);
+	}
+
+	return true;
+}
+
+bool SQLTempRecord::doubleValue(const FieldHandle &handle, double &result) const
+{
+	if (isNull(handle.index)) {
+		return false;
+	}
+
+	switch (handle.dataType)
+	{
+		case DataType::dtFloat:
+		case DataType::dtDouble:
+			result = static_cast<SQLTempTable*>(m_table)->data()->getFloat64(m_offsets[handle.index]);
+			break;
+		default:
+			return SQLRecord::doubleValue(handle, result);
+	}
+
+	return true;
+}
+
 std::string SQLTempRecord::strValue(const std::string& fieldName)
 {
 	SQLNormalTableSchema* tableSchema = static_cast<SQLNormalTableSchema*>(m_table->schema());
@@ -1447,6 +2227,11 @@ int SQLTempTable::recordCount() const
 	return m_recs.size();
 }
 
+SQLRecord *SQLTempTable::record(int index) const
+{
+	return m_recs[index];
+}
+
 void SQLTempTable::forEach(const ForEachRecordEvent& e)
 {
 	for (int i = 0; i < m_recs.size(); ++i) {
@@ -1454,6 +2239,12 @@ void SQLTempTable::forEach(const ForEachRecordEvent& e)
 	}
 }
 
+SQLRecord *SQLTempTable::readRecord(SQLResultReader &/*reader*/, const SQLResultBinding &/*binding*/)
+{
+	// temp table is only loaded from update data
+	return nullptr;
+}
+
 FieldSchema* SQLTempTable::primaryKey() const
 {
 	return normalSchema()->primaryKey();
@@ -1461,12 +2252,12 @@ FieldSchema* SQLTempTable::primaryKey() const
 
 int64_t SQLTempTable::intPK(const SQLRecord *rec) const
 {
-	FieldSchema* pkField = primaryKey();
-	if (!pkField) {
-		return 0;
+	// table is shared by task threads, while surrogates are only known to each thread.
+	// records of other pks are looked up by tables of every thread
+	if (!normalSchema()->isIntegerPK()) {
+		return -1;
 	}
-
-	return rec->value(pkField->name()).toInt64();
+	return pkValue(rec);
 }
 
 SQLNormalTableSchema* SQLTempTable::normalSchema() const
@@ -7,10 +7,13 @@
 #include "InputStream.h"
 #include "WriteBuffer.h"
 #include "MyVariant.h"
+#include "SQLResultReader.h"
+#include "PKHashMap.h"
 #include <string>
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
+#include <map>
 #include <functional>
 
 class SQLRecord;
@@ -18,12 +21,27 @@ class SQLJoinRecord;
 class SQLNormalRecord;
 class SQLTempRecord;
 
-typedef std::unordered_map<int64_t, SQLRecord *> PKHash;
 typedef std::unordered_set<SQLJoinRecord *> JOINPKSet;
 typedef std::unordered_map<int64_t, JOINPKSet> JOINPKHash;
 
 typedef std::function<void(SQLRecord *)> ForEachRecordEvent;
 
+// key of record in ordered index: values of order fields, then pk to make key unique
+struct OrderKey
+{
+	std::vector<MyVariant> values;
+	int64_t pk;
+};
+
+struct OrderKeyLess
+{
+	SQLTableSchema *schema;
+	bool operator()(const OrderKey &key1, const OrderKey &key2) const;
+};
+
+// order key -> data id of record
+typedef std::map<OrderKey, uint32_t, OrderKeyLess> OrderIndex;
+
 class SQLTable
 {
 public:
@@ -43,6 +61,14 @@ public:
 	virtual int recordCount() const = 0;
 
 	virtual void forEach(const ForEachRecordEvent &e) = 0;
+	// remove all records, implemented by tables reloaded from db
+	virtual void clear();
+
+	// resolve sql result columns of every field once, before reading rows
+	virtual void bindColumns(SQLResultReader &reader, SQLResultBinding &binding,
+		bool directColumnName = false);
+	// read current row of reader, return record in table(maybe existed one with the same pk)
+	virtual SQLRecord *readRecord(SQLResultReader &reader, const SQLResultBinding &binding) = 0;
 
 	SQLTableSchema *schema() const;
 	void setSchema(SQLTableSchema *schema);
@@ -62,16 +88,35 @@ public:
 	MyVariants &params();
 	uint32_t meomoryUsed() const;
 
+	// resolve pk accessors against own schema ahead, so pkValue of own records writes nothing.
+	// called before table is shared by threads
+	void bindPK();
+
 protected:
+	// memory counted for table by save, size of saved data by default
+	virtual uint32_t savedMemory(WriteBuffer *buffer) const;
 	virtual void doSave(WriteBuffer *buffer);
 	virtual void doUnload(OutputStream &out);
 	virtual void doLoad(InputStream &in);
 
+	// primary key of rec(maybe from other table) by primary key of this table,
+	// surrogate integer of PKDictionary for non-integer or composite pk, -1 if key isn't known.
+	// acquire references the surrogate for a record kept by table
+	int64_t pkValue(const SQLRecord *rec, bool acquire = false) const;
+	virtual void resetAccessors();
+	void buildPKAccessors() const;
+
+	void buildOrderAccessors();
+	OrderKey orderKey(SQLRecord *rec);
+
 protected:
 	SQLTableSchema *m_schema;
 	MyVariants m_params;
 	int8_t m_threadIndex;
 	uint32_t m_used;
+	std::vector<FieldAccessor> m_orderAccessors;
+	mutable std::vector<FieldAccessor> m_pkAccessors;
+	mutable bool m_integerPK;
 };
 
 class SQLNormalTable : public SQLTable
@@ -85,6 +130,7 @@ public:
 	int recordCount() const override;
 
 	void forEach(const ForEachRecordEvent &e) override;
+	SQLRecord *readRecord(SQLResultReader &reader, const SQLResultBinding &binding) override;
 
 	FieldSchema *primaryKey() const;
 	SQLNormalTableSchema *normalSchema() const;
@@ -105,14 +151,51 @@ public:
 
 	int64_t intPK(const SQLRecord *rec) const;
 
+	// returned record is a view reused by next lookup of this table, copy it to keep
 	SQLRecord *selectByPK(int64_t pk);
 
+	// extend schema is deleted with table by default, set false when schema is shared
+	void setOwnSchema(bool value);
+
+	void clear() override;
+
+	// db has records behind the last one of LIMIT window, which aren't cached
+	void setTruncated(bool value);
+	// deletes have taken all slack records of LIMIT window, window must be reloaded from db
+	bool windowDrained() const;
+
 	void doSave(WriteBuffer* buffer) override;
 	void doUnload(OutputStream &out) override;
 	void doLoad(InputStream &in) override;
 
 protected:
-	PKHash m_pkHash;
+	uint32_t savedMemory(WriteBuffer *buffer) const override;
+	void resetAccessors() override;
+
+	SQLNormalRecord *record(uint32_t dataId);
+	// recycle records, or release them from row store of schema
+	void releaseRecords();
+	// drop reference of surrogate pk
+	void releasePK(int64_t pk);
+
+	void buildOrderIndex();
+	bool hasOrderField(const std::vector<std::string> &fieldNames);
+
+	bool isLimited() const;
+	// remove records behind capacity of LIMIT window
+	void trimWindow();
+
+protected:
+	// records are stored as pk -> data id, record objects are only views on data
+	PKHashMap m_pkHash;
+	SQLNormalRecord *m_cursor;
+	SQLNormalRecord *m_newRecord;
+	// records in order of order fields, built by first save, then kept by append/update/remove
+	OrderIndex *m_orderIndex;
+	bool m_ownSchema;
+	bool m_truncated;
+	// read fields of inserted record, which may be from other table
+	std::vector<FieldAccessor> m_fieldAccessors;
 };
 
 class SQLTempTable : public SQLTable
@@ -124,8 +207,10 @@ public:
 	SQLRecord* newRecord() override;
 	SQLRecord* append(SQLRecord* rec) override;
 	int recordCount() const override;
+	SQLRecord *record(int index) const;
 
 	void forEach(const ForEachRecordEvent& e) override;
+	SQLRecord *readRecord(SQLResultReader &reader, const SQLResultBinding &binding) override;
 
 	FieldSchema* primaryKey() const;
 	int64_t intPK(const SQLRecord* rec) const;
@@ -140,12 +225,13 @@ private:
 	ByteArrayImpl *m_data;
 };
 
-// ֻTable,޸
-class SQLReadOnlyTable : public SQLTable
+// GROUP BY result, every group is a record keeping its aggregates and hidden accumulators,
+// records of db table are applied to groups incrementally
+class SQLAggregateTable : public SQLTable
 {
 public:
-	SQLReadOnlyTable(SQLTableSchema *schema = nullptr);
-	virtual ~SQLReadOnlyTable();
+	SQLAggregateTable(SQLTableSchema *schema = nullptr);
+	virtual ~SQLAggregateTable();
 
 	TableKind kind() const override;
 
@@ -154,13 +240,55 @@ public:
 	int recordCount() const override;
 
 	void forEach(const ForEachRecordEvent &e) override;
+	SQLRecord *readRecord(SQLResultReader &reader, const SQLResultBinding &binding) override;
+
+	void clear() override;
+
+	// rec is record of db table, return false if its group must be recomputed from db,
+	// that is MIN/MAX of group is removed
+	bool insert(SQLRecord *rec);
+	bool remove(SQLRecord *rec);
 
 	void doSave(WriteBuffer* buffer) override;
 	void doUnload(OutputStream &out) override;
 	void doLoad(InputStream &in) override;
 
+protected:
+	void resetAccessors() override;
+
+private:
+	// fields of group record keeping an aggregate
+	struct AggregateHandles
+	{
+		FieldHandle value;
+		// COUNT(field) of SUM and AVG
+		FieldHandle count;
+		// SUM(field) of AVG
+		FieldHandle sum;
+	};
+
+	GroupByInfo *groupByInfo() const;
+	void buildAccessors();
+	void buildGroupIndex();
+	MyVariants groupKey(SQLRecord *rec);
+	SQLNormalRecord *group(uint32_t dataId);
+	SQLNormalRecord *newGroup(const MyVariants &key);
+	void removeGroup(uint32_t dataId, const MyVariants &key);
+	// add value to aggregate of group if delta is 1, remove it if delta is -1
+	bool applyAggregate(SQLNormalRecord *group, int index, const MyVariant &value, int delta);
+
 private:
-	std::vector<SQLNormalRecord *> m_recs;
+	std::vector<uint32_t> m_dataIds;
+	SQLNormalRecord *m_newRecord;
+	SQLNormalRecord *m_cursor;
+	// group key -> data id, built by first insert/remove
+	std::unordered_map<MyVariants, uint32_t> *m_groupIndex;
+	// read group fields and aggregate fields of db record
+	std::vector<FieldAccessor> m_groupAccessors;
+	std::vector<FieldAccessor> m_aggregateAccessors;
+	std::vector<FieldHandle> m_groupHandles;
+	std::vector<AggregateHandles> m_aggregateHandles;
+	FieldHandle m_countHandle;
 };
 
 class SQLJoinTable : public SQLTable
@@ -176,14 +304,21 @@ public:
 	void forEach(const ForEachRecordEvent &e) override;
 	void setThreadIndex(int8_t index) override;
 
-	SQLNormalTable &left();
-	SQLNormalTable &right();
+	void bindColumns(SQLResultReader &reader, SQLResultBinding &binding,
+		bool directColumnName = false) override;
+	SQLRecord *readRecord(SQLResultReader &reader, const SQLResultBinding &binding) override;
+
+	int tableCount() const;
+	SQLNormalTable &table(int index);
 
 	SQLJoinTableSchema *joinSchema() const;
 
 	SQLNormalTable *getTable(const std::string &tableName);
+	// -1 if table isn't joined
+	int tableIndex(const std::string &tableName) const;
 	void addJoin(SQLJoinRecord *rec);
-	void removeJoin(int64_t pk, bool isLeft);
+	// remove join records of record pk of table index
+	void removeJoin(int64_t pk, int index);
 
 	// ͬ
 	bool update(const std::string &tableName, SQLRecord *rec, std::vector<std::string> &updateFields);
@@ -194,11 +329,12 @@ public:
 	void doLoad(InputStream &in) override;
 
 private:
-	SQLNormalTable m_leftTable;
-	SQLNormalTable m_rightTable;
-	// һݽṹʾjoin¼ĶӦϵleft¼(IDʶ)joinrightЩ¼һԶĹϵ
-	JOINPKHash m_leftJoinHash;
-	JOINPKHash m_rightJoinHash;
+	void createTables();
+
+private:
+	std::vector<SQLNormalTable *> m_tables;
+	// ÿһhashʾñ¼(ʶ)Щjoin¼УһԶĹϵ
+	std::vector<JOINPKHash> m_joinHashes;
 };
 
 class SQLRecord
@@ -215,9 +351,14 @@ public:
 	virtual void setValue(const std::string &fieldName, const MyVariant &value) = 0;
 	virtual int64_t pk() const = 0;
 
+	// handle must come from schema of this record's table, default is access by field name
+	virtual const MyVariant value(const FieldHandle &handle) const;
+	virtual void setValue(const FieldHandle &handle, const MyVariant &value);
+	// numeric field read without building a variant, false if it's null
+	virtual bool intValue(const FieldHandle &handle, int64_t &result) const;
+	virtual bool doubleValue(const FieldHandle &handle, double &result) const;
+
 	virtual void save(WriteBuffer *buffer) {};
-	virtual void read(std::unordered_map<std::string, MyVariant> &sqlResult,
-		bool directColumnName = false) {};
 
 	SQLTable *table() const;
 
@@ -225,11 +366,11 @@ protected:
 	SQLTable *m_table;
 };
 
+// view on record data of table, data is freed by table instead of record
 class SQLNormalRecord : public SQLRecord
 {
 public:
-	SQLNormalRecord(SQLTable *table);
-	SQLNormalRecord(SQLTable *table, uint32_t dataId);
+	SQLNormalRecord(SQLTable *table, uint32_t dataId = PKHashMap::NULL_DATA_ID);
 	virtual ~SQLNormalRecord();
 
 	const MyVariant value(const std::string &fieldName) const override;
@@ -237,20 +378,27 @@ public:
 	void setValue(const std::string &fieldName, const MyVariant &value) override;
 	int64_t pk() const override;
 
+	const MyVariant value(const FieldHandle &handle) const override;
+	void setValue(const FieldHandle &handle, const MyVariant &value) override;
+	bool intValue(const FieldHandle &handle, int64_t &result) const override;
+	bool doubleValue(const FieldHandle &handle, double &result) const override;
+
 	void save(WriteBuffer* buffer) override;
-	void read(std::unordered_map<std::string, MyVariant>& sqlResult,
-		bool directColumnName = false) override;
+	void read(SQLResultReader &reader, const SQLResultBinding &binding);
 
 	void writeField(WriteBuffer* buffer, FieldSchema *field, uint32_t offset);
 
 	uint32_t dataId() const;
+	void setDataId(uint32_t dataId);
+
+	// allocate data for a new record, or free data of record
+	void allocate();
+	void recycle();
 
 private:
-	void readField(std::unordered_map<std::string, MyVariant>& sqlResult, FieldSchema *field,
-		const std::string &sqlFieldName);
 	void writeNullBit(WriteBuffer *buffer, SQLNormalTableSchema *tableSchema);
-	void setNull(int fieldIndex, bool value);
-	bool isNull(int fieldIndex) const;
+	void setNull(const FieldHandle &handle, bool value);
+	bool isNull(const FieldHandle &handle) const;
 private:
 	uint32_t m_dataId;
 };
@@ -266,6 +414,10 @@ public:
 	void setValue(const std::string& fieldName, const MyVariant& value) override;
 	int64_t pk() const override;
 
+	const MyVariant value(const FieldHandle &handle) const override;
+	bool intValue(const FieldHandle &handle, int64_t &result) const override;
+	bool doubleValue(const FieldHandle &handle, double &result) const override;
+
 	void load(InputStream &in);
 
 private:
@@ -277,7 +429,7 @@ private:
 class SQLJoinRecord : public SQLRecord
 {
 public:
-	SQLJoinRecord(SQLTable *table, SQLRecord *left = nullptr, SQLRecord *right = nullptr);
+	SQLJoinRecord(SQLTable *table);
 	virtual ~SQLJoinRecord();
 
 	const MyVariant value(const std::string &fieldName) const override;
@@ -286,18 +438,22 @@ public:
 	int64_t pk() const override;
 
 	void save(WriteBuffer* buffer) override;
-	void read(std::unordered_map<std::string, MyVariant>& sqlResult,
-		bool directColumnName = false) override;
 
-	SQLRecord *left() const;
-	SQLRecord *right() const;
+	int recordCount() const;
+	// null if record of table index isn't set
+	SQLRecord *record(int index) const;
+	void setRecord(int index, SQLRecord *rec);
 
 	SQLJoinTable *joinTable() const;
 	void add(SQLRecord *rec);
 
 private:
-	SQLRecord *m_left;
-	SQLRecord *m_right;
+	// index of joined record having field
+	int recordIndex(const std::string &fieldName) const;
+
+private:
+	// views on records of joined tables, table is null if not set
+	std::vector<SQLNormalRecord> m_records;
 };
 
 class SQLExtendRecord : public SQLRecord
@@ -314,6 +470,10 @@ public:
 	void setValue(const std::string &fieldName, const MyVariant &value) override;
 	int64_t pk() const override;
 
+	const MyVariant value(const FieldHandle &handle) const override;
+	bool intValue(const FieldHandle &handle, int64_t &result) const override;
+	bool doubleValue(const FieldHandle &handle, double &result) const override;
+
 private:
 	SQLRecord *m_base;
 	std::unordered_map<std::string, std::string> m_fieldMap;
@@ -58,6 +58,7 @@ void SQLTableContainer::reset()
 		}
 	}
 	m_tables.clear();
+	m_schemas.clear();
 	m_isCompress.clear();
 	m_visitCounts.clear();
 	m_used = 0;
@@ -67,7 +68,7 @@ uint32_t SQLTableContainer::newTable(SQLTableSchema *schema, SQLTable **tablePtr
 {
 	SQLTable *table = nullptr;
 	if (schema->isGroupBy()) {
-		table = new SQLReadOnlyTable(schema);
+		table = new SQLAggregateTable(schema);
 	}
 	else if (schema->kind() == TableKind::tkNormal) {
 		table = new SQLNormalTable(schema);
@@ -81,6 +82,7 @@ uint32_t SQLTableContainer::newTable(SQLTableSchema *schema, SQLTable **tablePtr
 	}
 
 	m_tables.push_back(table);
+	m_schemas.push_back(schema);
 	m_lastId = m_tables.size() - 1;
 	if (m_lastId == (m_lastId >> COMPRESS_RANGE_P) << COMPRESS_RANGE_P) {
 		m_isCompress.push_back(false);
@@ -93,8 +95,7 @@ SQLTable *SQLTableContainer::getTable(uint32_t id)
 {
 	if (id < m_tables.size()) {
 		m_lastId = id;
-		uint32_t rangeIndex = (m_lastId >> COMPRESS_RANGE_P) << COMPRESS_RANGE_P;
-		m_visitCounts[rangeIndex]++;
+		m_visitCounts[m_lastId >> COMPRESS_RANGE_P]++;
 		return assureTable(id);
 	}
 
@@ -110,9 +111,15 @@ void SQLTableContainer::removeTable(uint32_t id)
 			delete tbl;
 		}
 		m_tables[id] = nullptr;
+		notifyRemoved(id);
 	}
 }
 
+void SQLTableContainer::setRemoveEvent(const TableRemoveEvent &e)
+{
+	m_removeEvent = e;
+}
+
 void SQLTableContainer::addMemoryUsed(int32_t mu)
 {
 	m_used += mu;
@@ -196,8 +203,8 @@ void SQLTableContainer::uncompressTables(uint32_t index)
 		else if (tk == TableKind::tkJoin) {
 			tbl = new SQLJoinTable();
 		}
-		else if (tk == TableKind::tkReadOnly) {
-			tbl = new SQLReadOnlyTable();
+		else if (tk == TableKind::tkAggregate) {
+			tbl = new SQLAggregateTable();
 		}
 		else {
 			// is removed
@@ -206,6 +213,8 @@ void SQLTableContainer::uncompressTables(uint32_t index)
 
 		int start = in.pos();
 		tbl->load(in);
+		// thread index isn't unloaded, memory and pk dictionary of the thread are used
+		tbl->setThreadIndex(m_index);
 		int end = in.pos();
 		mms += end - start;
 
@@ -231,33 +240,32 @@ void SQLTableContainer::freeTables()
 	uint32_t oldUsed = m_used;
 	uint32_t lastRangeIndex = m_lastId >> COMPRESS_RANGE_P;
 	for (int i = 0; i < visitInfos.size(); ++i) {
-		uint32_t index = visitInfos[i].first >> COMPRESS_RANGE_P;
-		if (lastRangeIndex == index) {
+		uint32_t rangeIndex = visitInfos[i].first;
+		if (lastRangeIndex == rangeIndex) {
 			continue;
 		}
 
-		if (m_isCompress[index]) {
-			uint8_t *srcData = reinterpret_cast<uint8_t *>(m_tables[index]);
-			uint32_t srcLength = *((uint32_t *)srcData);
-			MemoryManager::instantce(m_index).recycle(srcData);
-			m_tables[index] = nullptr;
-			m_used -= srcLength + 4;
+		uint32_t start = rangeIndex << COMPRESS_RANGE_P;
+		if (m_isCompress[rangeIndex]) {
+			// blob only has pks of tables, tables are loaded so rows are released by their destructors
+			uint64_t used = m_used;
+			uint32_t srcLength = *((uint32_t *)m_tables[start]);
+			uncompressTables(start);
+			m_used = used - srcLength - 4;
 		}
-		else {
-			for (int j = 0; j < COMPRESS_RANGE; ++j) {
-				index += j;
-				if (index >= m_tables.size()) {
-					break;
-				}
-
-				if (m_tables[index]) {
-					m_used -= m_tables[index]->meomoryUsed();
-					delete m_tables[index];
-					m_tables[index] = nullptr;
-				}
+
+		for (uint32_t j = start; j < start + COMPRESS_RANGE && j < m_tables.size(); ++j) {
+			if (m_tables[j]) {
+				m_used -= m_tables[j]->meomoryUsed();
+				delete m_tables[j];
+				m_tables[j] = nullptr;
 			}
 		}
 
+		for (uint32_t j = start; j < start + COMPRESS_RANGE && j < m_tables.size(); ++j) {
+			notifyRemoved(j);
+		}
+
 		if (m_used <= oldUsed >> 1) {
 			break;
 		}
@@ -267,3 +275,12 @@ void SQLTableContainer::freeTables()
 		m_visitCounts[i] = 0;
 	}
 }
+
+void SQLTableContainer::notifyRemoved(uint32_t id)
+{
+	SQLTableSchema *schema = m_schemas[id];
+	m_schemas[id] = nullptr;
+	if (schema && m_removeEvent) {
+		m_removeEvent(schema, id);
+	}
+}
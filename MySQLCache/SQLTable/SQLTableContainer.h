@@ -1,10 +1,14 @@
 #pragma once
 #include <cstdint>
 #include <vector>
+#include <functional>
 
 class SQLTable;
 class SQLTableSchema;
 
+// a table of schema is dropped from container, by removeTable or freed for out of memory
+typedef std::function<void(SQLTableSchema *, uint32_t)> TableRemoveEvent;
+
 class SQLTableContainer
 {
 public:
@@ -21,6 +25,9 @@ public:
 
 	void addMemoryUsed(int32_t mu);
 
+	// not called by reset
+	void setRemoveEvent(const TableRemoveEvent &e);
+
 private:
 	SQLTable *assureTable(uint32_t id);
 
@@ -28,12 +35,16 @@ private:
 	void uncompressTables(uint32_t index);
 
 	void freeTables();
+	void notifyRemoved(uint32_t id);
 
 private:
 	uint8_t m_index;
 	std::vector<SQLTable *> m_tables;
+	// schema of each table, null if table is dropped
+	std::vector<SQLTableSchema *> m_schemas;
 	std::vector<uint32_t> m_visitCounts;
 	std::vector<bool> m_isCompress;
 	uint32_t m_lastId;
 	uint64_t m_used;
+	TableRemoveEvent m_removeEvent;
 };
@@ -1,8 +1,125 @@
 #include "SQLTableIndex.h"
 #include "Common.h"
+#include <algorithm>
+#include <iterator>
 
 using namespace std;
 
+// table id of removed interval in between index
+const uint32_t REMOVED_TABLE_ID = 0xFFFFFFFF;
+// keys of a block in no equal index, the block is split in half when it's bigger
+const size_t MAX_BLOCK_SIZE = 64;
+
+// drop tableId from tables of k, k is erased with its last table
+template <typename Index>
+void removeTableId(Index &index, const MyVariant &k, uint32_t tableId)
+{
+	auto r = index.find(k);
+	if (r == index.end()) {
+		return;
+	}
+
+	vector<uint32_t> &tableIds = r->second;
+	auto i = std::find(tableIds.begin(), tableIds.end(), tableId);
+	if (i != tableIds.end()) {
+		*i = tableIds.back();
+		tableIds.pop_back();
+	}
+
+	if (tableIds.empty()) {
+		index.erase(r);
+	}
+}
+
+TableIdList::TableIdList() :
+	m_size(0),
+	m_capacity(INLINE_COUNT)
+{
+}
+
+TableIdList::TableIdList(TableIdList &&other) noexcept :
+	m_size(other.m_size),
+	m_capacity(other.m_capacity)
+{
+	if (m_capacity > INLINE_COUNT) {
+		m_data = other.m_data;
+	}
+	else {
+		copy(other.m_inline, other.m_inline + m_size, m_inline);
+	}
+	other.m_size = 0;
+	other.m_capacity = INLINE_COUNT;
+}
+
+TableIdList::~TableIdList()
+{
+	if (m_capacity > INLINE_COUNT) {
+		delete[] m_data;
+	}
+}
+
+TableIdList &TableIdList::operator=(TableIdList &&other) noexcept
+{
+	if (this == &other) {
+		return *this;
+	}
+
+	if (m_capacity > INLINE_COUNT) {
+		delete[] m_data;
+	}
+	m_size = other.m_size;
+	m_capacity = other.m_capacity;
+	if (m_capacity > INLINE_COUNT) {
+		m_data = other.m_data;
+	}
+	else {
+		copy(other.m_inline, other.m_inline + m_size, m_inline);
+	}
+	other.m_size = 0;
+	other.m_capacity = INLINE_COUNT;
+	return *this;
+}
+
+void TableIdList::add(uint32_t tableId)
+{
+	if (m_size == m_capacity) {
+		uint32_t *data = new uint32_t[m_capacity * 2];
+		copy(begin(), end(), data);
+		if (m_capacity > INLINE_COUNT) {
+			delete[] m_data;
+		}
+		m_data = data;
+		m_capacity *= 2;
+	}
+
+	uint32_t *data = m_capacity > INLINE_COUNT ? m_data : m_inline;
+	data[m_size++] = tableId;
+}
+
+void TableIdList::remove(uint32_t tableId)
+{
+	uint32_t *data = m_capacity > INLINE_COUNT ? m_data : m_inline;
+	uint32_t *i = std::find(data, data + m_size, tableId);
+	if (i != data + m_size) {
+		*i = data[--m_size];
+	}
+}
+
+bool TableIdList::empty() const
+{
+	return m_size == 0;
+}
+
+const uint32_t *TableIdList::begin() const
+{
+	return m_capacity > INLINE_COUNT ? m_data : m_inline;
+}
+
+const uint32_t *TableIdList::end() const
+{
+	return begin() + m_size;
+}
+
 SQLTableIndex *SQLTableIndexFactory::createIndex(TableIndexKind k)
 {
 	switch (k) {
@@ -42,7 +159,17 @@ void SQLTableEqualIndex::add(const MyVariant &k, uint32_t tableId)
 	m_index[k].push_back(tableId);
 }
 
-void SQLTableEqualIndex::add(const MyVariant &k1, const MyVariant &k2, uint32_t tableId)
+void SQLTableEqualIndex::add(const MyVariant &/*k1*/, const MyVariant &/*k2*/, uint32_t /*tableId*/)
+{
+	// do nothing
+}
+
+void SQLTableEqualIndex::remove(const MyVariant &k, uint32_t tableId)
+{
+	removeTableId(m_index, k, tableId);
+}
+
+void SQLTableEqualIndex::remove(const MyVariant &/*k1*/, const MyVariant &/*k2*/, uint32_t /*tableId*/)
 {
 	// do nothing
 }
@@ -52,6 +179,11 @@ void SQLTableEqualIndex::clear()
 	m_index.clear();
 }
 
+bool SQLTableEqualIndex::empty() const
+{
+	return m_index.empty();
+}
+
 std::vector<uint32_t> SQLTableEqualIndex::find(const MyVariant &k)
 {
 	auto r = m_index.find(k);
@@ -70,83 +202,130 @@ SQLTableNoEqualIndex::SQLTableNoEqualIndex(bool isGreater, bool isEqual) :
 
 SQLTableNoEqualIndex::~SQLTableNoEqualIndex()
 {
-	for (int i = 0; i < m_index.size(); ++i) {
-		delete m_index[i];
-	}
 }
 
 void SQLTableNoEqualIndex::add(const MyVariant &k, uint32_t tableId)
 {
-	bool matched = false;
-	int i = locate(k, matched);
-	if (!matched) {
-		TableIndexNode *node = new TableIndexNode;
-		node->key = k;
-		m_index.insert(m_index.begin() + i, node);
+	if (m_blocks.empty()) {
+		m_blocks.push_back(Block());
+		m_blocks.back().push_back(KeyEntry{ k, TableIdList() });
+		m_blocks.back().back().tableIds.add(tableId);
+		return;
+	}
+
+	size_t b = findBlock(k);
+	Block &block = m_blocks[b];
+	auto i = lower_bound(block.begin(), block.end(), k, [](const KeyEntry &e, const MyVariant &k) {
+		return e.key < k;
+	});
+	if (i == block.end() || k < i->key) {
+		i = block.insert(i, KeyEntry{ k, TableIdList() });
+	}
+	i->tableIds.add(tableId);
+
+	if (block.size() > MAX_BLOCK_SIZE) {
+		Block right(make_move_iterator(block.begin() + block.size() / 2), make_move_iterator(block.end()));
+		block.resize(block.size() / 2);
+		m_blocks.insert(m_blocks.begin() + b + 1, std::move(right));
 	}
-	m_index[i]->tableIds.push_back(tableId);
 }
 
-void SQLTableNoEqualIndex::add(const MyVariant &k1, const MyVariant &k2, uint32_t tableId)
+void SQLTableNoEqualIndex::add(const MyVariant &/*k1*/, const MyVariant &/*k2*/, uint32_t /*tableId*/)
 {
 	// do nothing
 }
 
-void SQLTableNoEqualIndex::clear()
+void SQLTableNoEqualIndex::remove(const MyVariant &k, uint32_t tableId)
 {
-	for (int i = 0; i < m_index.size(); ++i) {
-		delete m_index[i];
+	if (m_blocks.empty()) {
+		return;
 	}
-	m_index.clear();
+
+	size_t b = findBlock(k);
+	Block &block = m_blocks[b];
+	auto i = lower_bound(block.begin(), block.end(), k, [](const KeyEntry &e, const MyVariant &k) {
+		return e.key < k;
+	});
+	if (i == block.end() || k < i->key) {
+		return;
+	}
+
+	i->tableIds.remove(tableId);
+	if (i->tableIds.empty()) {
+		block.erase(i);
+		if (block.empty()) {
+			m_blocks.erase(m_blocks.begin() + b);
+		}
+	}
+}
+
+void SQLTableNoEqualIndex::remove(const MyVariant &/*k1*/, const MyVariant &/*k2*/, uint32_t /*tableId*/)
+{
+	// do nothing
+}
+
+void SQLTableNoEqualIndex::clear()
+{
+	m_blocks.clear();
+}
+
+bool SQLTableNoEqualIndex::empty() const
+{
+	return m_blocks.empty();
 }
 
 std::vector<uint32_t> SQLTableNoEqualIndex::find(const MyVariant &k)
 {
-	vector<uint32_t> result;
-	bool matched = false;
-	int i = locate(k, matched);
-	int s = -1;
-	int e = -1;
+	// record value k matches field > param if param < k, and field < param if param > k
+	pair<size_t, size_t> s(0, 0);
+	pair<size_t, size_t> e(m_blocks.size(), 0);
 	if (m_isGreater) {
-		s = i;
-		e = m_index.size() - 1;
-		if (matched && !m_isEqual) {
-			++s;
-		}
+		e = bound(k, m_isEqual);
 	}
 	else {
-		s = 0;
-		e = i;
-		if (!matched || !m_isEqual) {
-			--e;
-		}
+		s = bound(k, !m_isEqual);
 	}
-	for (i = s; i <= e; ++i) {
-		result.insert(result.end(), m_index[i]->tableIds.begin(), m_index[i]->tableIds.end());
+
+	vector<uint32_t> result;
+	for (size_t b = s.first; b < m_blocks.size() && b <= e.first; ++b) {
+		const Block &block = m_blocks[b];
+		size_t first = b == s.first ? s.second : 0;
+		size_t last = b == e.first ? e.second : block.size();
+		for (size_t i = first; i < last; ++i) {
+			result.insert(result.end(), block[i].tableIds.begin(), block[i].tableIds.end());
+		}
 	}
 	return result;
 }
 
-int SQLTableNoEqualIndex::locate(const MyVariant &v, bool &matched)
+size_t SQLTableNoEqualIndex::findBlock(const MyVariant &k) const
 {
-	int left = 0;
-	int right = m_index.size() - 1;
-	while (left <= right) { 
-		int mid = left + (right - left) / 2;
-		if (m_index[mid]->key == v) {
-			matched = true;
-			return mid;
-		}
-		else if (m_index[mid]->key < v) {
-			left = mid + 1; 
-		}
-		else { 
-			right = mid - 1;
-		}
+	// the last block whose first key <= k, or the first block
+	auto b = upper_bound(m_blocks.begin(), m_blocks.end(), k, [](const MyVariant &k, const Block &block) {
+		return k < block.front().key;
+	});
+	return b == m_blocks.begin() ? 0 : b - m_blocks.begin() - 1;
+}
+
+std::pair<size_t, size_t> SQLTableNoEqualIndex::bound(const MyVariant &k, bool upper) const
+{
+	if (m_blocks.empty()) {
+		return make_pair(0, 0);
 	}
 
-	matched = false;
-	return left;
+	size_t b = findBlock(k);
+	const Block &block = m_blocks[b];
+	auto i = upper ? 
+		upper_bound(block.begin(), block.end(), k, [](const MyVariant &k, const KeyEntry &e) {
+			return k < e.key;
+		}) :
+		lower_bound(block.begin(), block.end(), k, [](const KeyEntry &e, const MyVariant &k) {
+			return e.key < k;
+		});
+	if (i == block.end()) {
+		return make_pair(b + 1, 0);
+	}
+	return make_pair(b, i - block.begin());
 }
 
 SQLTableBetweenIndex::SQLTableBetweenIndex()
@@ -155,109 +334,209 @@ SQLTableBetweenIndex::SQLTableBetweenIndex()
 
 SQLTableBetweenIndex::~SQLTableBetweenIndex()
 {
-	for (int i = 0; i < m_lowIndex.size(); ++i) {
-		delete m_lowIndex[i];
-	}
-	for (int i = 0; i < m_highIndex.size(); ++i) {
-		delete m_highIndex[i];
-	}
 }
 
-void SQLTableBetweenIndex::add(const MyVariant &k, uint32_t tableId)
+void SQLTableBetweenIndex::add(const MyVariant &/*k*/, uint32_t /*tableId*/)
 {
 	// do nothing
 }
 
 void SQLTableBetweenIndex::add(const MyVariant &k1, const MyVariant &k2, uint32_t tableId)
 {
-	add(m_lowIndex, k1, tableId);
-	add(m_highIndex, k2, tableId);
+	m_trees.push_back(IntervalTree());
+	m_trees.back().intervals.push_back(Interval{ k1, k2, tableId });
+	// merge last tree into the previous one until sizes are decreasing
+	while (m_trees.size() > 1) {
+		IntervalTree &last = m_trees.back();
+		IntervalTree &prev = m_trees[m_trees.size() - 2];
+		uint32_t lastSize = last.intervals.size() - last.removedCount;
+		if (prev.intervals.size() - prev.removedCount > lastSize) {
+			break;
+		}
+
+		vector<Interval> intervals;
+		intervals.reserve(prev.intervals.size() + last.intervals.size());
+		merge(prev.intervals.begin(), prev.intervals.end(), last.intervals.begin(), last.intervals.end(),
+			back_inserter(intervals), lowLess);
+		prev.intervals.swap(intervals);
+		prev.removedCount += last.removedCount;
+		m_trees.pop_back();
+	}
+	build(m_trees.back());
 }
 
-void SQLTableBetweenIndex::clear()
+void SQLTableBetweenIndex::remove(const MyVariant &/*k*/, uint32_t /*tableId*/)
 {
-	for (int i = 0; i < m_lowIndex.size(); ++i) {
-		delete m_lowIndex[i];
-	}
-	m_lowIndex.clear();
+	// do nothing
+}
 
-	for (int i = 0; i < m_highIndex.size(); ++i) {
-		delete m_highIndex[i];
+void SQLTableBetweenIndex::remove(const MyVariant &k1, const MyVariant &k2, uint32_t tableId)
+{
+	// intervals of the same low are adjacent in every tree
+	for (auto t = m_trees.begin(); t != m_trees.end(); ++t) {
+		auto range = equal_range(t->intervals.begin(), t->intervals.end(), Interval{ k1, k2, tableId }, lowLess);
+		for (auto i = range.first; i != range.second; ++i) {
+			if (i->tableId != tableId) {
+				continue;
+			}
+
+			i->tableId = REMOVED_TABLE_ID;
+			++t->removedCount;
+			if (t->removedCount == t->intervals.size()) {
+				m_trees.erase(t);
+			}
+			else if (t->removedCount * 2 > t->intervals.size()) {
+				build(*t);
+			}
+			return;
+		}
 	}
-	m_highIndex.clear();
 }
 
-std::vector<uint32_t> SQLTableBetweenIndex::find(const MyVariant &k)
+void SQLTableBetweenIndex::clear()
 {
-	unordered_set<uint32_t> lowTableIds;
-	find(true, k, lowTableIds);
+	m_trees.clear();
+}
 
-	unordered_set<uint32_t> highTableIds;
-	find(false, k, highTableIds);
+bool SQLTableBetweenIndex::empty() const
+{
+	return m_trees.empty();
+}
 
+std::vector<uint32_t> SQLTableBetweenIndex::find(const MyVariant &k)
+{
 	vector<uint32_t> result;
-	FOR_EACH(i, lowTableIds) {
-		if (highTableIds.find(*i) != highTableIds.end()) {
-			result.push_back(*i);
-		}
+	FOR_EACH(i, m_trees) {
+		stab(*i, 0, i->intervals.size() - 1, k, result);
 	}
 	return result;
 }
 
-int SQLTableBetweenIndex::locate(std::vector<TableIndexNode *> &index, 
-	const MyVariant &v, bool &matched)
+void SQLTableBetweenIndex::build(IntervalTree &tree)
 {
-	int left = 0;
-	int right = index.size() - 1;
-	while (left <= right) {
-		int mid = left + (right - left) / 2;
-		if (index[mid]->key == v) {
-			matched = true;
-			return mid;
-		}
-		else if (index[mid]->key < v) {
-			left = mid + 1;
+	if (tree.removedCount > 0) {
+		tree.intervals.erase(remove_if(tree.intervals.begin(), tree.intervals.end(), [](const Interval &i) {
+			return i.tableId == REMOVED_TABLE_ID;
+		}), tree.intervals.end());
+		tree.removedCount = 0;
+	}
+
+	tree.maxHighs.assign(tree.intervals.size(), MyVariant());
+	if (!tree.intervals.empty()) {
+		buildMaxHigh(tree, 0, tree.intervals.size() - 1);
+	}
+}
+
+const MyVariant &SQLTableBetweenIndex::buildMaxHigh(IntervalTree &tree, int left, int right)
+{
+	int mid = left + (right - left) / 2;
+	MyVariant &maxHigh = tree.maxHighs[mid];
+	maxHigh = tree.intervals[mid].high;
+	if (left < mid) {
+		const MyVariant &high = buildMaxHigh(tree, left, mid - 1);
+		if (maxHigh < high) {
+			maxHigh = high;
 		}
-		else {
-			right = mid - 1;
+	}
+
+	if (mid < right) {
+		const MyVariant &high = buildMaxHigh(tree, mid + 1, right);
+		if (maxHigh < high) {
+			maxHigh = high;
 		}
 	}
+	return maxHigh;
+}
 
-	matched = false;
-	return left;
+bool SQLTableBetweenIndex::lowLess(const Interval &i1, const Interval &i2)
+{
+	return i1.low < i2.low;
 }
 
-void SQLTableBetweenIndex::add(std::vector<TableIndexNode *> &index, 
-	const MyVariant &k, uint32_t tableId)
+void SQLTableBetweenIndex::stab(const IntervalTree &tree, int left, int right, const MyVariant &k, 
+	std::vector<uint32_t> &tableIds)
 {
-	bool matched = false;
-	int i = locate(index, k, matched);
-	if (!matched) {
-		TableIndexNode *node = new TableIndexNode;
-		node->key = k;
-		index.insert(index.begin() + i, node);
+	if (left > right) {
+		return;
+	}
+
+	int mid = left + (right - left) / 2;
+	// no interval of subtree reaches k
+	if (tree.maxHighs[mid] < k) {
+		return;
+	}
+
+	stab(tree, left, mid - 1, k, tableIds);
+	// intervals on right start after k
+	if (k < tree.intervals[mid].low) {
+		return;
+	}
+
+	if (!(tree.intervals[mid].high < k) && tree.intervals[mid].tableId != REMOVED_TABLE_ID) {
+		tableIds.push_back(tree.intervals[mid].tableId);
 	}
-	index[i]->tableIds.push_back(tableId);
+	stab(tree, mid + 1, right, k, tableIds);
+}
+
+SQLTableCompositeIndex::SQLTableCompositeIndex(TableIndexKind lastKind) :
+	m_lastKind(lastKind)
+{
+}
+
+SQLTableCompositeIndex::~SQLTableCompositeIndex()
+{
+	clear();
 }
 
-void SQLTableBetweenIndex::find(bool isLow, const MyVariant &k, 
-	std::unordered_set<uint32_t> &tableIds)
+SQLTableIndex *SQLTableCompositeIndex::subIndex(const MyVariants &key)
 {
-	vector<TableIndexNode *> &index = isLow ? m_lowIndex : m_highIndex;
-	bool matched = false;
-	int i = locate(index, k, matched);
-	int s = -1;
-	int e = -1;
-	if (isLow) {
-		s = i;
-		e = index.size() - 1;
+	SQLTableIndex *&index = m_index[key];
+	if (!index) {
+		index = SQLTableIndexFactory::createIndex(m_lastKind);
 	}
-	else {
-		s = 0;
-		e = i;
+
+	return index;
+}
+
+void SQLTableCompositeIndex::remove(const MyVariants &key, const MyVariant &k, uint32_t tableId)
+{
+	auto r = m_index.find(key);
+	if (r != m_index.end()) {
+		r->second->remove(k, tableId);
+		if (r->second->empty()) {
+			delete r->second;
+			m_index.erase(r);
+		}
+	}
+}
+
+void SQLTableCompositeIndex::remove(const MyVariants &key, const MyVariant &k1, const MyVariant &k2, 
+	uint32_t tableId)
+{
+	auto r = m_index.find(key);
+	if (r != m_index.end()) {
+		r->second->remove(k1, k2, tableId);
+		if (r->second->empty()) {
+			delete r->second;
+			m_index.erase(r);
+		}
 	}
+}
+
+void SQLTableCompositeIndex::clear()
+{
+	FOR_EACH(i, m_index) {
+		delete i->second;
+	}
+	m_index.clear();
+}
 
-	for (i = s; i <= e; ++i) {
-		tableIds.insert(index[i]->tableIds.begin(), index[i]->tableIds.end());
+std::vector<uint32_t> SQLTableCompositeIndex::find(const MyVariants &key, const MyVariant &k)
+{
+	auto r = m_index.find(key);
+	if (r != m_index.end()) {
+		return r->second->find(k);
 	}
+
+	return std::vector<uint32_t>();
 }
@@ -3,7 +3,6 @@
 #include <cstdint>
 #include <vector>
 #include <unordered_map>
-#include <unordered_set>
 
 enum class TableIndexKind
 {
@@ -15,13 +14,37 @@ enum class TableIndexKind
 	tikBetween = 5
 };
 
-struct TableIndexNode
+class SQLTableIndex;
+
+// table ids of an index key, a few ids are kept inline without heap allocation
+class TableIdList
 {
-	MyVariant key;
-	std::vector<uint32_t> tableIds;
-};
+public:
+	TableIdList();
+	TableIdList(TableIdList &&other) noexcept;
+	TableIdList(const TableIdList &) = delete;
+	~TableIdList();
 
-class SQLTableIndex;
+	TableIdList &operator=(TableIdList &&other) noexcept;
+	TableIdList &operator=(const TableIdList &) = delete;
+
+	void add(uint32_t tableId);
+	void remove(uint32_t tableId);
+	bool empty() const;
+	const uint32_t *begin() const;
+	const uint32_t *end() const;
+
+private:
+	static const uint32_t INLINE_COUNT = 2;
+
+	uint32_t m_size;
+	uint32_t m_capacity;
+	union
+	{
+		uint32_t m_inline[INLINE_COUNT];
+		uint32_t *m_data;
+	};
+};
 
 class SQLTableIndexFactory
 {
@@ -32,9 +55,15 @@ public:
 class SQLTableIndex
 {
 public:
+	virtual ~SQLTableIndex() {}
+
 	virtual void add(const MyVariant &k, uint32_t tableId) = 0;
 	virtual void add(const MyVariant &k1, const MyVariant &k2, uint32_t tableId) = 0;
+	// keys must be the ones table is added with
+	virtual void remove(const MyVariant &k, uint32_t tableId) = 0;
+	virtual void remove(const MyVariant &k1, const MyVariant &k2, uint32_t tableId) = 0;
 	virtual void clear() = 0;
+	virtual bool empty() const = 0;
 	virtual std::vector<uint32_t> find(const MyVariant &k) = 0;
 };
 
@@ -46,13 +75,19 @@ public:
 
 	void add(const MyVariant &k, uint32_t tableId) override;
 	void add(const MyVariant &k1, const MyVariant &k2, uint32_t tableId) override;
+	void remove(const MyVariant &k, uint32_t tableId) override;
+	void remove(const MyVariant &k1, const MyVariant &k2, uint32_t tableId) override;
 	void clear() override;
+	bool empty() const override;
 	std::vector<uint32_t> find(const MyVariant &k) override;
 
 private:
 	std::unordered_map<MyVariant, std::vector<uint32_t>> m_index;
 };
 
+// tables of >, >=, <, <= ordered by param in sorted blocks of at most MAX_BLOCK_SIZE keys, a two level
+// B+tree without inner nodes. add and remove are O(log n + block size).
+// tables found by k are a prefix(>, >=) or a suffix(<, <=) of the keys
 class SQLTableNoEqualIndex : public SQLTableIndex
 {
 public:
@@ -61,18 +96,36 @@ public:
 
 	void add(const MyVariant &k, uint32_t tableId) override;
 	void add(const MyVariant &k1, const MyVariant &k2, uint32_t tableId) override;
+	void remove(const MyVariant &k, uint32_t tableId) override;
+	void remove(const MyVariant &k1, const MyVariant &k2, uint32_t tableId) override;
 	void clear() override;
+	bool empty() const override;
 	std::vector<uint32_t> find(const MyVariant &k) override;
 
 private:
-	int locate(const MyVariant &v, bool &matched);
+	struct KeyEntry
+	{
+		MyVariant key;
+		TableIdList tableIds;
+	};
+	typedef std::vector<KeyEntry> Block;
+
+	// block which k is in or would be inserted to
+	size_t findBlock(const MyVariant &k) const;
+	// position of the first key > k if upper, otherwise the first key >= k
+	std::pair<size_t, size_t> bound(const MyVariant &k, bool upper) const;
 
 private:
 	bool m_isGreater;
 	bool m_isEqual;
-	std::vector<TableIndexNode *> m_index;
+	// blocks are not empty, keys of a block are less than the ones of the next
+	std::vector<Block> m_blocks;
 };
 
+// interval trees of BETWEEN params, find tables whose [low, high] contains k.
+// intervals sorted by low form an implicit balanced tree: middle of a range is root of its subtree.
+// a new interval is a tree of its own, trees of similar size are merged like a binary counter,
+// so there are O(log n) trees, add is O(log n) amortized and find is O(log^2 n + k)
 class SQLTableBetweenIndex : public SQLTableIndex
 {
 public:
@@ -81,15 +134,59 @@ public:
 
 	void add(const MyVariant &k, uint32_t tableId) override;
 	void add(const MyVariant &k1, const MyVariant &k2, uint32_t tableId) override;
+	void remove(const MyVariant &k, uint32_t tableId) override;
+	void remove(const MyVariant &k1, const MyVariant &k2, uint32_t tableId) override;
 	void clear() override;
+	bool empty() const override;
 	std::vector<uint32_t> find(const MyVariant &k) override;
 
 private:
-	int locate(std::vector<TableIndexNode *> &index, const MyVariant &v, bool &matched);
-	void add(std::vector<TableIndexNode *> &index, const MyVariant &k, uint32_t tableId);
-	void find(bool isLow, const MyVariant &k, std::unordered_set<uint32_t> &tableIds);
+	struct Interval
+	{
+		MyVariant low;
+		MyVariant high;
+		uint32_t tableId;
+	};
+
+	struct IntervalTree
+	{
+		std::vector<Interval> intervals;
+		// max high of subtree rooted at each interval
+		std::vector<MyVariant> maxHighs;
+		// removed intervals are marked and dropped when more than half are removed
+		uint32_t removedCount = 0;
+	};
+
+	static bool lowLess(const Interval &i1, const Interval &i2);
+	// drop removed intervals and build max highs
+	static void build(IntervalTree &tree);
+	// return max high of subtree
+	static const MyVariant &buildMaxHigh(IntervalTree &tree, int left, int right);
+	static void stab(const IntervalTree &tree, int left, int right, const MyVariant &k, 
+		std::vector<uint32_t> &tableIds);
+
+private:
+	// sizes are decreasing
+	std::vector<IntervalTree> m_trees;
+};
+
+// index of WHERE with equal conditions on several fields: values of the equal fields are key of
+// a sub index on the last field, so a record only meets tables having all its key values
+class SQLTableCompositeIndex
+{
+public:
+	SQLTableCompositeIndex(TableIndexKind lastKind);
+	~SQLTableCompositeIndex();
+
+	// sub index of key, created if it doesn't exist
+	SQLTableIndex *subIndex(const MyVariants &key);
+	// sub index is freed when its last table is removed
+	void remove(const MyVariants &key, const MyVariant &k, uint32_t tableId);
+	void remove(const MyVariants &key, const MyVariant &k1, const MyVariant &k2, uint32_t tableId);
+	void clear();
+	std::vector<uint32_t> find(const MyVariants &key, const MyVariant &k);
 
 private:
-	std::vector<TableIndexNode *> m_lowIndex;
-	std::vector<TableIndexNode *> m_highIndex;
+	TableIndexKind m_lastKind;
+	std::unordered_map<MyVariants, SQLTableIndex *> m_index;
 };
@@ -1,10 +1,16 @@
 #include "SQLTableSchema.h"
 #include "SQLContext.h"
+#include "SQLTable.h"
+#include "SQLRowStore.h"
 #include "Common.h"
+#include <atomic>
 #ifndef _WIN32
 #include <cstring>
 #endif
 
+// generations of schemas, 0 stands for no schema
+static std::atomic<uint64_t> g_schemaGeneration(0);
+
 FieldSchema::FieldSchema(const std::string &tableName, const std::string &name, DataType type) :
 	m_tableName(tableName), 
 	m_name(name), 
@@ -117,7 +123,9 @@ FieldSchema *SQLNormalTableSchema::addField(FieldSchema &srcFieldSchema)
 {
 	FieldSchema *field = addField(srcFieldSchema.name(), srcFieldSchema.dataType());
 	if (field && srcFieldSchema.isPrimaryKey()) {
-		m_primaryKey = field;
+		if (!m_primaryKey) {
+			m_primaryKey = field;
+		}
 		field->setPrimaryKey(true);
 	}
 	return field;
@@ -161,6 +169,21 @@ int32_t SQLNormalTableSchema::dataOffSet(const std::string &name)
 	return -1;
 }
 
+FieldHandle SQLNormalTableSchema::fieldHandle(const std::string &name)
+{
+	int index = fieldIndex(name);
+	if (index < 0) {
+		return FieldHandle();
+	}
+
+	return m_handles[index];
+}
+
+const FieldHandle &SQLNormalTableSchema::fieldHandle(int index) const
+{
+	return m_handles[index];
+}
+
 int32_t SQLNormalTableSchema::recordLength()
 {
 	if (m_fields.size() == 0) {
@@ -195,17 +218,30 @@ void SQLNormalTableSchema::compile()
 {
 	// NullBit is at begin, then is field data by dataType
 	uint32_t offset = (m_fields.size() - 1) / 8 + 1;
+	m_handles.clear();
+	m_primaryKeys.clear();
 	for (size_t i = 0; i < m_fields.size(); ++i) {
 		m_offsets.push_back(offset);
 		FieldSchema *field = m_fields.at(i);
+
+		FieldHandle handle;
+		handle.field = field;
+		handle.index = i;
+		handle.offset = offset;
+		handle.nullByte = i / 8;
+		handle.nullBit = i % 8;
+		handle.dataType = field->dataType();
+		m_handles.push_back(handle);
+
 		offset += dataSize(field->dataType());
 
 		m_fieldIndex[field->name()] = i;
 
 		if (field->isPrimaryKey()) {
-			m_primaryKey = field;
+			m_primaryKeys.push_back(field);
 		}
 	}
+	m_primaryKey = m_primaryKeys.empty() ? nullptr : m_primaryKeys.front();
 }
 
 uint32_t SQLNormalTableSchema::dataSize(DataType type)
@@ -279,6 +315,26 @@ FieldSchema *SQLNormalTableSchema::primaryKey() const
 	return m_primaryKey;
 }
 
+int SQLNormalTableSchema::primaryKeyCount() const
+{
+	return m_primaryKeys.size();
+}
+
+FieldSchema *SQLNormalTableSchema::primaryKey(int index) const
+{
+	return m_primaryKeys[index];
+}
+
+bool SQLNormalTableSchema::isIntegerPK() const
+{
+	if (primaryKeyCount() != 1) {
+		return false;
+	}
+
+	DataType dt = primaryKey(0)->dataType();
+	return dt == DataType::dtSmallInt || dt == DataType::dtInt || dt == DataType::dtBigInt;
+}
+
 SQLExtendTableSchema::SQLExtendTableSchema(SQLNormalTableSchema *base) :
 	SQLNormalTableSchema(),
 	m_base(base)
@@ -338,6 +394,16 @@ FieldSchema *SQLExtendTableSchema::primaryKey() const
 	return m_base->primaryKey();
 }
 
+int SQLExtendTableSchema::primaryKeyCount() const
+{
+	return m_base->primaryKeyCount();
+}
+
+FieldSchema *SQLExtendTableSchema::primaryKey(int index) const
+{
+	return m_base->primaryKey(index);
+}
+
 size_t SQLExtendTableSchema::fieldCount() const
 {
 	return m_base->fieldCount() + m_fields.size();
@@ -392,6 +458,22 @@ void SQLExtendTableSchema::compile()
 
 		m_fieldIndex[field->name()] = i;
 	}
+
+	// base fields keep their handles, null bits of extend fields are after base record
+	m_handles.clear();
+	for (size_t i = 0; i < m_base->fieldCount(); ++i) {
+		m_handles.push_back(m_base->fieldHandle(i));
+	}
+	for (size_t i = 0; i < m_fields.size(); ++i) {
+		FieldHandle handle;
+		handle.field = m_fields[i];
+		handle.index = m_base->fieldCount() + i;
+		handle.offset = m_offsets[i];
+		handle.nullByte = extendOffSet() + i / 8;
+		handle.nullBit = i % 8;
+		handle.dataType = m_fields[i]->dataType();
+		m_handles.push_back(handle);
+	}
 }
 
 size_t SQLExtendTableSchema::extendFieldCount() const
@@ -411,12 +493,16 @@ int32_t SQLExtendTableSchema::extendOffSet() const
 
 SQLJoinTableSchema::SQLJoinTableSchema() :
 	SQLTableSchema(),
-	m_join(SQLJoinType::sjtInner)
+	m_join(SQLJoinType::sjtInner),
+	m_probeable(false)
 {
 }
 
 SQLJoinTableSchema::~SQLJoinTableSchema()
 {
+	FOR_EACH(i, m_tables) {
+		delete *i;
+	}
 }
 
 std::string SQLJoinTableSchema::name() const
@@ -430,9 +516,19 @@ void SQLJoinTableSchema::setName(const std::string &name)
 
 void SQLJoinTableSchema::save(WriteBuffer* buffer)
 {
+	saveTables(buffer, 0);
+}
+
+void SQLJoinTableSchema::saveTables(WriteBuffer *buffer, int start)
+{
+	if (start + 1 >= (int)m_tables.size()) {
+		m_tables[start]->save(buffer);
+		return;
+	}
+
 	buffer->writeByte((int8_t)TableKind::tkJoin);
-	m_left.save(buffer);
-	m_right.save(buffer);
+	m_tables[start]->save(buffer);
+	saveTables(buffer, start + 1);
 }
 
 TableKind SQLJoinTableSchema::kind()
@@ -442,13 +538,18 @@ TableKind SQLJoinTableSchema::kind()
 
 void SQLJoinTableSchema::compile()
 {
-	m_left.compile();
-	m_right.compile();
+	FOR_EACH(i, m_tables) {
+		(*i)->compile();
+	}
 }
 
 int32_t SQLJoinTableSchema::recordLength()
 {
-	return m_left.recordLength() + m_right.recordLength();
+	int32_t length = 0;
+	FOR_EACH(i, m_tables) {
+		length += (*i)->recordLength();
+	}
+	return length;
 }
 
 void SQLJoinTableSchema::setJoinType(SQLJoinType t)
@@ -461,31 +562,77 @@ SQLJoinType SQLJoinTableSchema::joinType() const
 	return m_join;
 }
 
-SQLNormalTableSchema *SQLJoinTableSchema::left()
+SQLNormalTableSchema *SQLJoinTableSchema::addTable(const std::string &tableName)
 {
-	return &m_left;
+	SQLNormalTableSchema *table = new SQLNormalTableSchema();
+	table->setName(tableName);
+	m_tables.push_back(table);
+	return table;
 }
 
-SQLNormalTableSchema *SQLJoinTableSchema::right()
+int SQLJoinTableSchema::tableCount() const
 {
-	return &m_right;
+	return m_tables.size();
 }
 
-SQLNormalTableSchema *SQLJoinTableSchema::table(const std::string &tableName)
+SQLNormalTableSchema *SQLJoinTableSchema::table(int index) const
 {
-	if (m_left.name() == tableName) {
-		return &m_left;
-	}
-	else if (m_right.name() == tableName) {
-		return &m_right;
+	return m_tables[index];
+}
+
+SQLNormalTableSchema *SQLJoinTableSchema::table(const std::string &tableName) const
+{
+	int index = tableIndex(tableName);
+	return index >= 0 ? m_tables[index] : nullptr;
+}
+
+int SQLJoinTableSchema::tableIndex(const std::string &tableName) const
+{
+	for (size_t i = 0; i < m_tables.size(); ++i) {
+		if (m_tables[i]->name() == tableName) {
+			return i;
+		}
 	}
 
-	return nullptr;
+	return -1;
+}
+
+void SQLJoinTableSchema::addEdge(const JoinEdge &edge)
+{
+	m_edges.push_back(edge);
+}
+
+int SQLJoinTableSchema::edgeCount() const
+{
+	return m_edges.size();
+}
+
+const JoinEdge &SQLJoinTableSchema::edge(int index) const
+{
+	return m_edges[index];
+}
+
+bool SQLJoinTableSchema::isProbeable() const
+{
+	return m_probeable;
+}
+
+void SQLJoinTableSchema::setProbeable(bool probeable)
+{
+	m_probeable = probeable;
 }
 
 SQLTableSchema::SQLTableSchema() :
+	m_generation(++g_schemaGeneration),
 	m_orderFields(nullptr),
-	m_isGroupBy(false)
+	m_isGroupBy(false),
+	m_groupByInfo(nullptr),
+	m_limitOffset(0),
+	m_limitCount(-1),
+	m_limitSlack(0),
+	m_loadParamCount(-1),
+	m_rowStore(nullptr),
+	m_isPointLookup(false)
 {
 }
 
@@ -494,6 +641,8 @@ SQLTableSchema::~SQLTableSchema()
 	if (m_orderFields) {
 		delete m_orderFields;
 	}
+	delete m_groupByInfo;
+	delete m_rowStore;
 }
 
 int SQLTableSchema::orderFieldCount()
@@ -519,6 +668,11 @@ void SQLTableSchema::addOrderField(const OrderFieldInfo &field)
 	m_orderFields->push_back(field);
 }
 
+FieldHandle SQLTableSchema::fieldHandle(const std::string &/*name*/)
+{
+	return FieldHandle();
+}
+
 bool SQLTableSchema::isGroupBy() const
 {
 	return m_isGroupBy;
@@ -529,6 +683,83 @@ void SQLTableSchema::setGroupBy(bool value)
 	m_isGroupBy = value;
 }
 
+GroupByInfo *SQLTableSchema::groupByInfo() const
+{
+	return m_groupByInfo;
+}
+
+void SQLTableSchema::setGroupByInfo(GroupByInfo *info)
+{
+	m_groupByInfo = info;
+}
+
+int32_t SQLTableSchema::limitOffset() const
+{
+	return m_limitOffset;
+}
+
+int32_t SQLTableSchema::limitCount() const
+{
+	return m_limitCount;
+}
+
+void SQLTableSchema::setLimit(int32_t offset, int32_t count, int32_t slack)
+{
+	m_limitOffset = offset;
+	m_limitCount = count;
+	m_limitSlack = slack;
+}
+
+int32_t SQLTableSchema::windowCapacity() const
+{
+	return m_limitOffset + m_limitCount + m_limitSlack;
+}
+
+const std::string &SQLTableSchema::loadSql() const
+{
+	return m_loadSql;
+}
+
+void SQLTableSchema::setLoadSql(const std::string &sql)
+{
+	m_loadSql = sql;
+}
+
+int32_t SQLTableSchema::loadParamCount() const
+{
+	return m_loadParamCount;
+}
+
+void SQLTableSchema::setLoadParamCount(int32_t count)
+{
+	m_loadParamCount = count;
+}
+
+bool SQLTableSchema::isPointLookup() const
+{
+	return m_isPointLookup;
+}
+
+void SQLTableSchema::setPointLookup(bool value)
+{
+	m_isPointLookup = value;
+}
+
+SQLRowStore *SQLTableSchema::rowStore() const
+{
+	return m_rowStore;
+}
+
+void SQLTableSchema::setRowStore(SQLRowStore *store)
+{
+	m_rowStore = store;
+}
+
+uint64_t SQLTableSchema::generation() const
+{
+	return m_generation;
+}
+
 AggregateFunction functionOf(const std::string &code)
 {
 	if (strcmp(code.c_str(), "sum") == 0) {
@@ -570,3 +801,56 @@ std::string functionStr(AggregateFunction f)
 
 	return "";
 }
+
+FieldAccessor::FieldAccessor(const std::string &name, const std::string &tableName) :
+	m_name(name),
+	m_tableName(tableName),
+	m_generation(0),
+	m_inTable(false)
+{
+}
+
+const std::string &FieldAccessor::name() const
+{
+	return m_name;
+}
+
+const MyVariant FieldAccessor::value(const SQLRecord *rec)
+{
+	SQLTableSchema *schema = rec->table() ? rec->table()->schema() : nullptr;
+	if ((schema ? schema->generation() : 0) != m_generation) {
+		bind(schema);
+	}
+
+	if (m_handle.field) {
+		return rec->value(m_handle);
+	}
+	return rec->value(m_name);
+}
+
+const FieldHandle &FieldAccessor::handle(const SQLRecord *rec)
+{
+	SQLTableSchema *schema = rec->table() ? rec->table()->schema() : nullptr;
+	if ((schema ? schema->generation() : 0) != m_generation) {
+		bind(schema);
+	}
+
+	return m_handle;
+}
+
+bool FieldAccessor::inTable(const SQLRecord *rec)
+{
+	SQLTableSchema *schema = rec->table() ? rec->table()->schema() : nullptr;
+	if ((schema ? schema->generation() : 0) != m_generation) {
+		bind(schema);
+	}
+
+	return m_inTable;
+}
+
+void FieldAccessor::bind(SQLTableSchema *schema)
+{
+	m_generation = schema ? schema->generation() : 0;
+	m_handle = schema ? schema->fieldHandle(m_name) : FieldHandle();
+	m_inTable = schema && schema->name() == m_tableName;
+}
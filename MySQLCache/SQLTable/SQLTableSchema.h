@@ -3,9 +3,11 @@
 #include "DataType.h"
 #include "InputStream.h"
 #include "WriteBuffer.h"
+#include "MyVariant.h"
 #include "Common.h"
 #include <string>
 #include <vector>
+#include <memory>
 #include <unordered_map>
 
 enum class SQLJoinType
@@ -21,7 +23,7 @@ enum class TableKind
 	tkNormal = 0,
 	tkJoin = 1,
 	tkExtend = 2,
-	tkReadOnly = 3
+	tkAggregate = 3
 };
 
 enum class OrderType
@@ -44,6 +46,20 @@ AggregateFunction functionOf(const std::string &code);
 std::string functionStr(AggregateFunction f);
 
 class FieldSchema;
+class SQLRecord;
+class Condition;
+class SQLRowStore;
+
+// position of a field in record memory, resolved when schema is compiled
+struct FieldHandle
+{
+	FieldSchema *field = nullptr;
+	int32_t index = -1;
+	uint32_t offset = 0;
+	uint32_t nullByte = 0;
+	uint8_t nullBit = 0;
+	DataType dataType = DataType::dtInt;
+};
 
 struct OrderFieldInfo
 {
@@ -59,6 +75,30 @@ struct AggregateFieldInfo
 	bool isQuery = false;
 };
 
+struct GroupFieldInfo
+{
+	FieldSchema *field; // db field of GROUP BY
+	std::string name; // field of result keeping its value
+};
+
+// how GROUP BY result is computed from records of db table
+struct GroupByInfo
+{
+	std::vector<GroupFieldInfo> groupFields;
+	// includes hidden aggregates of HAVING, SUM and AVG also keep COUNT(field) and SUM(field) hidden
+	std::vector<AggregateFieldInfo> aggregateFields;
+	std::shared_ptr<Condition> having;
+};
+
+// equal condition of WHERE between fields of 2 tables of join
+struct JoinEdge
+{
+	int left; // index of table in join
+	int right;
+	FieldSchema *leftField; // db field
+	FieldSchema *rightField;
+};
+
 class SQLTableSchema
 {
 public:
@@ -75,6 +115,9 @@ public:
 
 	virtual int32_t recordLength() = 0;
 
+	// empty handle(field is null) if table has no flat record memory or field doesn't exist
+	virtual FieldHandle fieldHandle(const std::string &name);
+
 	int orderFieldCount();
 	const OrderFieldInfo &orderField(int index);
 	void addOrderField(const OrderFieldInfo &field);
@@ -82,9 +125,48 @@ public:
 	bool isGroupBy() const;
 	void setGroupBy(bool value);
 
+	// only for GROUP BY schema, info is deleted with schema
+	GroupByInfo *groupByInfo() const;
+	void setGroupByInfo(GroupByInfo *info);
+
+	// LIMIT window of result, count < 0 means sql has no LIMIT
+	int32_t limitOffset() const;
+	int32_t limitCount() const;
+	// slack records are kept behind the window, so deletes needn't reload window at once
+	void setLimit(int32_t offset, int32_t count, int32_t slack);
+	// max record count kept by table, offset + count + slack
+	int32_t windowCapacity() const;
+
+	// sql reading records of table from db
+	const std::string &loadSql() const;
+	void setLoadSql(const std::string &sql);
+	// count of leading params bound to load sql, < 0 means all params
+	int32_t loadParamCount() const;
+	void setLoadParamCount(int32_t count);
+
+	// equal lookup of pk, one table keeps rows of all looked up keys instead of a table per key
+	bool isPointLookup() const;
+	void setPointLookup(bool value);
+
+	// rows shared by tables of schema, null if every table keeps its own rows. deleted with schema
+	SQLRowStore *rowStore() const;
+	void setRowStore(SQLRowStore *store);
+
+	// unique per schema object, never reused even if address of a freed schema is
+	uint64_t generation() const;
+
 private:
+	uint64_t m_generation;
 	std::vector<OrderFieldInfo> *m_orderFields;
 	bool m_isGroupBy;
+	GroupByInfo *m_groupByInfo;
+	int32_t m_limitOffset;
+	int32_t m_limitCount;
+	int32_t m_limitSlack;
+	std::string m_loadSql;
+	int32_t m_loadParamCount;
+	SQLRowStore *m_rowStore;
+	bool m_isPointLookup;
 };
 
 class SQLNormalTableSchema : public SQLTableSchema
@@ -106,12 +188,21 @@ public:
 	virtual FieldSchema *field(int index) const;
 	virtual FieldSchema *findField(const std::string &name);
 
+	// the first field of primary key
 	virtual FieldSchema *primaryKey() const;
+	// fields of primary key, more than one for composite key
+	virtual int primaryKeyCount() const;
+	virtual FieldSchema *primaryKey(int index) const;
+	// single integer pk is the key of records itself, other pks are mapped to surrogate integers
+	bool isIntegerPK() const;
 
 	virtual size_t fieldCount() const;
 	virtual int fieldIndex(const std::string &name);
 	virtual int32_t dataOffSet(const std::string &name);
 
+	FieldHandle fieldHandle(const std::string &name) override;
+	const FieldHandle &fieldHandle(int index) const;
+
 	virtual void copyFieldSchemas(std::vector<FieldSchema *> &dstFields);
 
 	void addColumnMap(const std::string &fieldName, const std::string &colName);
@@ -127,8 +218,11 @@ protected:
 
 protected:
 	FieldSchema *m_primaryKey;
+	std::vector<FieldSchema *> m_primaryKeys;
 	std::vector<FieldSchema *> m_fields;
 	std::vector<uint32_t> m_offsets;
+	// all fields of record, extend schema includes base fields
+	std::vector<FieldHandle> m_handles;
 	std::string m_name;
 	std::unordered_map<std::string, int32_t> m_fieldIndex;
 	std::unordered_map<std::string, std::string> m_sqlColMaps;
@@ -148,6 +242,8 @@ public:
 	FieldSchema *findField(const std::string &name) override;
 
 	FieldSchema *primaryKey() const override;
+	int primaryKeyCount() const override;
+	FieldSchema *primaryKey(int index) const override;
 
 	size_t fieldCount() const override;
 	int fieldIndex(const std::string &name) override;
@@ -186,14 +282,31 @@ public:
 	void setJoinType(SQLJoinType t);
 	SQLJoinType joinType() const;
 
-	SQLNormalTableSchema *left();
-	SQLNormalTableSchema *right();
-	SQLNormalTableSchema *table(const std::string &tableName);
+	SQLNormalTableSchema *addTable(const std::string &tableName);
+	int tableCount() const;
+	SQLNormalTableSchema *table(int index) const;
+	SQLNormalTableSchema *table(const std::string &tableName) const;
+	// -1 if table isn't joined
+	int tableIndex(const std::string &tableName) const;
+
+	void addEdge(const JoinEdge &edge);
+	int edgeCount() const;
+	const JoinEdge &edge(int index) const;
+
+	// whether joined records can be found in cache by edges, 
+	// false if WHERE has OR or other conditions between tables
+	bool isProbeable() const;
+	void setProbeable(bool probeable);
+
+private:
+	// join of n tables is saved as join of the first table and join of the rest
+	void saveTables(WriteBuffer *buffer, int start);
 
 private:
 	SQLJoinType m_join;
-	SQLNormalTableSchema m_left;
-	SQLNormalTableSchema m_right;
+	std::vector<SQLNormalTableSchema *> m_tables;
+	std::vector<JoinEdge> m_edges;
+	bool m_probeable;
 };
 
 class FieldSchema
@@ -226,3 +339,30 @@ private:
 	bool m_isQuery;
 	bool m_isPrimary;
 };
+
+// read a field by name from records of different tables,
+// handle is resolved again only when record schema changes
+class FieldAccessor
+{
+public:
+	FieldAccessor(const std::string &name = std::string(), const std::string &tableName = std::string());
+
+	const std::string &name() const;
+
+	const MyVariant value(const SQLRecord *rec);
+	// field is null if rec's schema has no such field
+	const FieldHandle &handle(const SQLRecord *rec);
+	// whether rec belongs to the table of field
+	bool inTable(const SQLRecord *rec);
+
+	// resolve against schema ahead, so records of schema are read without writing accessor
+	void bind(SQLTableSchema *schema);
+
+private:
+	std::string m_name;
+	std::string m_tableName;
+	// generation of resolved schema, 0 if none
+	uint64_t m_generation;
+	FieldHandle m_handle;
+	bool m_inTable;
+};
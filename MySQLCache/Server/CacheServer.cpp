@@ -26,6 +26,8 @@ CacheServer::~CacheServer()
 void CacheServer::startUp(CacheSetting *setting, bool readMode)
 {
 	initMemoryManagers(setting);
+	initSQLConnectors(setting);
+	initSQLContext(setting);
 	m_context = new SQLContext(readMode, setting->read(WORKER_THREAD_COUNT).toInt(), 
 		setting->read(SQL_SERVER_ADDR).toString());
 	SQLContext::setInstance(m_context);
@@ -55,10 +57,12 @@ void CacheServer::processCommand(ByteArray rawData, struct bufferevent *client,
 	}
 	else {
 		uint32_t extInfoLen = m_context->extInfoLength();
-		// current node is write, the command is sended by main-read-server
-		ByteArray extInfo = ByteArray::directFrom(rawData->data(), extInfoLen);
-		doProcessCommand(ByteArray::directFrom(rawData->data() + extInfoLen, 
-			rawData->byteLength() - extInfoLen), buffer, client, extInfo);
+		// current node is write, the command is sended by main-read-server, commands are queued
+		// after they're read, so they're copied out of frame
+		m_context->readFrames(rawData, [&](ByteArray frame) {
+			ByteArray extInfo = frame->slice(0, extInfoLen);
+			doProcessCommand(frame->slice(extInfoLen), buffer, client, extInfo);
+		});
 	}
 }
 
@@ -84,27 +88,23 @@ void CacheServer::doProcessCommand(ByteArray commandBytes, WriteBuffer *buffer,
 		// reply starts with errorCode:
 	case CommandType::ctSelect:
 	{
-		m_context->select(commandBytes, sql, buffer);
+		m_context->select(commandBytes, sql, buffer, client);
 		bufferevent_write(client, buffer->dataPtr(), buffer->byteLength());
 		break;
 	}
 	case CommandType::ctStartTransaction:
 	{
-		m_context->execUpdate(commandBytes, TaskType::ttTransaction, extInfo, buffer);
-		bufferevent_write(client, buffer->dataPtr(), buffer->byteLength());
+		execUpdate(commandBytes, TaskType::ttTransaction, extInfo, buffer, client);
 		break;
 	}
 	case CommandType::ctInsert:
-		m_context->execUpdate(commandBytes, TaskType::ttInsert, extInfo, buffer);
-		bufferevent_write(client, buffer->dataPtr(), buffer->byteLength());
+		execUpdate(commandBytes, TaskType::ttInsert, extInfo, buffer, client);
 		break;
 	case CommandType::ctDelete:
-		m_context->execUpdate(commandBytes, TaskType::ttDelete, extInfo, buffer);
-		bufferevent_write(client, buffer->dataPtr(), buffer->byteLength());
+		execUpdate(commandBytes, TaskType::ttDelete, extInfo, buffer, client);
 		break;
 	case CommandType::ctUpdate:
-		m_context->execUpdate(commandBytes, TaskType::ttUpdate, extInfo, buffer);
-		bufferevent_write(client, buffer->dataPtr(), buffer->byteLength());
+		execUpdate(commandBytes, TaskType::ttUpdate, extInfo, buffer, client);
 		break;
 	case CommandType::ctMonitor:
 	{
@@ -133,6 +133,19 @@ void CacheServer::doProcessCommand(ByteArray commandBytes, WriteBuffer *buffer,
 	buffer->reset();
 }
 
+void CacheServer::execUpdate(ByteArray commandBytes, TaskType type, ByteArray extInfo,
+	WriteBuffer *buffer, bufferevent *client)
+{
+	if (m_context->readMode()) {
+		m_context->execUpdate(commandBytes, type, extInfo, buffer);
+		bufferevent_write(client, buffer->dataPtr(), buffer->byteLength());
+	}
+	else {
+		// write node replies after write is committed with its group
+		m_context->postUpdate(commandBytes, type, extInfo);
+	}
+}
+
 void CacheServer::outputMonitorInfo(WriteBuffer *buffer)
 {
 	std::string info = CacheMonitor::instance()->outputHitInfo();
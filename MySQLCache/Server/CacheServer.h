@@ -26,6 +26,8 @@ public:
 private:
 	void doProcessCommand(ByteArray commandBytes, WriteBuffer *buffer,
 		struct bufferevent *client = nullptr, ByteArray extInfo = ByteArray());
+	void execUpdate(ByteArray commandBytes, TaskType type, ByteArray extInfo,
+		WriteBuffer *buffer, struct bufferevent *client);
 
 	void outputMonitorInfo(WriteBuffer* buffer);
 
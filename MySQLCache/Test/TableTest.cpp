@@ -0,0 +1,193 @@
+#include "TableTest.h"
+#include "SQLTable.h"
+#include "SQLTableSchema.h"
+#include "SQLContext.h"
+#include "OutputStream.h"
+#include "InputStream.h"
+#include <iostream>
+
+static void check(const char *name, bool passed)
+{
+	std::cout << name << (passed ? ": ok" : ": FAILED") << std::endl;
+}
+
+// t(id BIGINT PRIMARY KEY, score INT)
+static SQLNormalTableSchema *newScoreSchema()
+{
+	SQLNormalTableSchema *schema = new SQLNormalTableSchema();
+	schema->setName("t");
+	schema->addField("id", DataType::dtBigInt)->setPrimaryKey(true);
+	schema->addField("score", DataType::dtInt);
+	schema->compile();
+	return schema;
+}
+
+static SQLRecord *appendScore(SQLNormalTable &table, int64_t id, int32_t score)
+{
+	SQLRecord *rec = table.newRecord();
+	rec->setValue("id", id);
+	rec->setValue("score", score);
+	return table.append(rec);
+}
+
+void TableTest::testLimitWindow()
+{
+	// SELECT * FROM t ORDER BY score DESC LIMIT 3, 2 records of slack
+	SQLNormalTableSchema *rowSchema = newScoreSchema();
+	SQLNormalTableSchema *windowSchema = newScoreSchema();
+	windowSchema->addOrderField({ windowSchema->findField("score"), OrderType::otDesc });
+	windowSchema->setLimit(0, 3, 2);
+
+	{
+		SQLNormalTable rows(rowSchema);
+		rows.setThreadIndex(0);
+		// like a compressed table, it's dropped without releasing records, which are loaded again
+		SQLNormalTable *window = new SQLNormalTable(windowSchema);
+		window->setThreadIndex(0);
+		for (int i = 1; i <= 8; ++i) {
+			window->insert(appendScore(rows, i, i * 10));
+		}
+		check("window keeps capacity", window->recordCount() == 5);
+		check("lowest records are trimmed", !window->existPK(3) && window->existPK(4));
+		check("record behind truncated window isn't cached", window->insert(appendScore(rows, 9, 5)) == nullptr);
+
+		OutputStream out;
+		window->unload(out);
+		InputStream in(out.toByteArray());
+		in.readByte();
+		SQLNormalTable reloaded;
+		reloaded.load(in);
+		reloaded.setThreadIndex(0);
+		check("reloaded window is truncated", reloaded.insert(appendScore(rows, 10, 6)) == nullptr);
+
+		reloaded.removeByPK(8);
+		reloaded.removeByPK(7);
+		check("window isn't drained by slack deletes", !reloaded.windowDrained());
+		reloaded.removeByPK(6);
+		check("window is drained by deletes of slack", reloaded.windowDrained());
+
+		reloaded.clear();
+		check("cleared window isn't drained", !reloaded.windowDrained());
+	}
+
+	delete windowSchema;
+	delete rowSchema;
+}
+
+void TableTest::testJoinTables()
+{
+	// a JOIN b ON a.aId = b.aRef JOIN c ON b.bId = c.bRef
+	SQLJoinTableSchema *schema = new SQLJoinTableSchema();
+	SQLNormalTableSchema *a = schema->addTable("a");
+	a->addField("aId", DataType::dtBigInt)->setPrimaryKey(true);
+	SQLNormalTableSchema *b = schema->addTable("b");
+	b->addField("bId", DataType::dtBigInt)->setPrimaryKey(true);
+	b->addField("aRef", DataType::dtBigInt);
+	b->addField("score", DataType::dtInt);
+	SQLNormalTableSchema *c = schema->addTable("c");
+	c->addField("cId", DataType::dtBigInt)->setPrimaryKey(true);
+	c->addField("bRef", DataType::dtBigInt);
+	schema->addEdge({ 0, 1, a->findField("aId"), b->findField("aRef") });
+	schema->addEdge({ 1, 2, b->findField("bId"), c->findField("bRef") });
+	schema->compile();
+
+	{
+		SQLJoinTable join(schema);
+		join.setThreadIndex(0);
+		SQLRecord *recA = join.table(0).newRecord();
+		recA->setValue("aId", (int64_t)1);
+		recA = join.table(0).append(recA);
+		for (int64_t i = 10; i <= 11; ++i) {
+			SQLRecord *recB = join.table(1).newRecord();
+			recB->setValue("bId", i);
+			recB->setValue("aRef", (int64_t)1);
+			recB->setValue("score", (int32_t)i);
+			recB = join.table(1).append(recB);
+			SQLRecord *recC = join.table(2).newRecord();
+			recC->setValue("cId", i * 10);
+			recC->setValue("bRef", i);
+			recC = join.table(2).append(recC);
+
+			SQLJoinRecord *joinRec = static_cast<SQLJoinRecord *>(join.newRecord());
+			joinRec->setRecord(0, recA);
+			joinRec->setRecord(1, recB);
+			joinRec->setRecord(2, recC);
+			join.append(joinRec);
+		}
+		check("join of 3 tables is cached", join.recordCount() == 2);
+
+		SQLRecord *middle = join.table(1).selectByPK(10);
+		middle->setValue("score", (int32_t)99);
+		std::vector<std::string> fields = { "score" };
+		join.update("b", middle, fields);
+		bool updated = false;
+		join.forEach([&](SQLRecord *rec) {
+			updated |= rec->value("cId").toInt64() == 100 && rec->value("score").toInt() == 99;
+		});
+		check("update of middle table is seen by join", updated);
+
+		check("record of middle table is removed", join.remove("b", join.table(1).selectByPK(10)));
+		int64_t cId = 0;
+		join.forEach([&](SQLRecord *rec) {
+			cId = rec->value("cId").toInt64();
+		});
+		check("join of removed middle record is dropped", join.recordCount() == 1 && cId == 110);
+
+		join.remove("a", join.table(0).selectByPK(1));
+		check("joins of removed first record are dropped", join.recordCount() == 0);
+	}
+
+	delete schema;
+}
+
+void TableTest::testDistinctAggregate(SQLContext *context)
+{
+	check("aggregate is cacheable", context->createCacheTableSchema(
+		"SELECT name, SUM(score) FROM student GROUP BY name", 0) != nullptr);
+	check("DISTINCT aggregate isn't cacheable", context->createCacheTableSchema(
+		"SELECT name, COUNT(DISTINCT score) FROM student GROUP BY name", 0) == nullptr);
+	check("DISTINCT aggregate of HAVING isn't cacheable", context->createCacheTableSchema(
+		"SELECT name, SUM(score) FROM student GROUP BY name HAVING SUM(DISTINCT score) > 0", 0) == nullptr);
+}
+
+void TableTest::testPKBuckets(SQLContext *context)
+{
+	SQLContext::SQLDMLTemplate dml;
+	dml.tableSchema = newScoreSchema();
+	dml.modifySql = "DELETE FROM t WHERE id";
+	MyVariants pks;
+	std::vector<int8_t> pkTypes;
+	for (int64_t i = 1; i <= 5; ++i) {
+		pks.add(i);
+		pkTypes.push_back(context->variantTypeToParamType(pks.variant(pks.count() - 1)));
+	}
+
+	MyVariants params;
+	std::vector<int8_t> paramTypes;
+	check("single pk isn't an IN list", context->bindPKModifySql(&dml, pks, pkTypes, 0, 1, 64,
+		params, paramTypes) == "DELETE FROM t WHERE id = ?" && params.count() == 1);
+
+	params = MyVariants();
+	paramTypes.clear();
+	std::string sql = context->bindPKModifySql(&dml, pks, pkTypes, 0, 5, 64, params, paramTypes);
+	check("IN list is padded to a bucket", sql == "DELETE FROM t WHERE id IN (?,?,?,?,?,?)" &&
+		params.count() == 6 && paramTypes.size() == 6);
+	check("IN list is padded by the last pk", params.variant(4).toInt64() == 5 &&
+		params.variant(5).toInt64() == 5);
+
+	params = MyVariants();
+	paramTypes.clear();
+	sql = context->bindPKModifySql(&dml, pks, pkTypes, 2, 3, 3, params, paramTypes);
+	check("IN list isn't padded over chunk size", sql == "DELETE FROM t WHERE id IN (?,?,?)" &&
+		params.count() == 3 && params.variant(0).toInt64() == 3);
+
+	// lead params of UPDATE SET are kept before pks
+	params = MyVariants();
+	params.add((int32_t)0);
+	paramTypes.assign(1, context->variantTypeToParamType(params.variant(0)));
+	context->bindPKModifySql(&dml, pks, pkTypes, 0, 3, 64, params, paramTypes);
+	check("lead params are kept", params.count() == 4 && params.variant(0).toInt() == 0 &&
+		params.variant(3).toInt64() == 3);
+
+	delete dml.tableSchema;
+}
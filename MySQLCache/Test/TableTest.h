@@ -0,0 +1,14 @@
+#pragma once
+
+class SQLContext;
+
+// cache tables are kept in memory of worker 0, run after memory managers are initialized.
+// tests given a context read tables of test db, e.g. student(id, name, score)
+class TableTest
+{
+public:
+	static void testLimitWindow();
+	static void testJoinTables();
+	static void testDistinctAggregate(SQLContext *context);
+	static void testPKBuckets(SQLContext *context);
+};
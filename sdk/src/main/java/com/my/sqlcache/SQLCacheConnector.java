@@ -100,13 +100,17 @@ public class SQLCacheConnector implements AutoCloseable {
             return null;
         }
 
-        SQLResultInputStream in = new SQLResultInputStream(data);
+        // uncached result is sent by chunks, the rest after first response is read on demand
+        SQLResultInputStream in = new SQLResultInputStream(data, client.getInputStream());
         errorCode = SQLCacheErrorCode.valueOf(in.readUByte());
         if (errorCode != SQLCacheErrorCode.scecNone) {
             return null;
         }
 
-        return new SQLResultSet(in);
+        SQLResultSet resultSet = new SQLResultSet(in);
+        // streamed result may fail after its first chunk
+        errorCode = resultSet.errorCode();
+        return errorCode == SQLCacheErrorCode.scecNone ? resultSet : null;
     }
 
     public void begin() throws Exception {
@@ -1,10 +1,17 @@
 package com.my.sqlcache;
 
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.UncheckedIOException;
+import java.util.Arrays;
+
 public class SQLResultInputStream {
 
     private byte[] data = null;
     private int offset = 0;
     private int len = 0;
+    // rest of a reply longer than data is read from it
+    private InputStream source = null;
 
     public SQLResultInputStream(byte[] data) {
         this.data = data;
@@ -18,6 +25,11 @@ public class SQLResultInputStream {
         this.offset = 0;
     }
 
+    public SQLResultInputStream(byte[] data, InputStream source) {
+        this(data);
+        this.source = source;
+    }
+
     public byte[] data() {
         return data;
     }
@@ -27,11 +39,13 @@ public class SQLResultInputStream {
     }
 
     public byte readByte() {
+        require(1);
         int ch = data[offset++] & 255;
         return (byte)ch;
     }
 
     public short readUByte() {
+        require(1);
         int ch = data[offset++] & 255;
         return (short)ch;
     }
@@ -41,18 +55,21 @@ public class SQLResultInputStream {
     }
 
     public short readShort() {
+        require(2);
         int ch1 = data[offset++] & 255;
         int ch2 = data[offset++] & 255;
         return (short)((ch1 << 8) + (ch2 << 0));
     }
 
     public int readUShort() {
+        require(2);
         int ch1 = data[offset++] & 255;
         int ch2 = data[offset++] & 255;
         return (ch1 << 8) + (ch2 << 0);
     }
 
     public int readInt() {
+        require(4);
         int ch1 = data[offset++] & 255;
         int ch2 = data[offset++] & 255;
         int ch3 = data[offset++] & 255;
@@ -61,6 +78,7 @@ public class SQLResultInputStream {
     }
 
     public long readUInt() {
+        require(4);
         int ch1 = data[offset] & 255;
         int ch2 = data[offset++] & 255;
         int ch3 = data[offset++] & 255;
@@ -69,6 +87,7 @@ public class SQLResultInputStream {
     }
 
     public long readLong() {
+        require(8);
         return ((long)(data[offset++]) << 56) +
                 ((long)(data[offset++] & 255) << 48) +
                 ((long)(data[offset++] & 255) << 40) +
@@ -123,6 +142,30 @@ public class SQLResultInputStream {
     }
 
     public void skip(int size) {
+        require(size);
         offset += size;
     }
+
+    private void require(int size) {
+        if (offset + size <= len || source == null) {
+            return;
+        }
+
+        try {
+            while (offset + size > len) {
+                if (len == data.length) {
+                    data = Arrays.copyOf(data, Math.max(data.length * 2, offset + size));
+                }
+
+                int readLen = source.read(data, len, data.length - len);
+                if (readLen < 0) {
+                    throw new IOException("Connection Is Closed");
+                }
+                len += readLen;
+            }
+        }
+        catch (IOException e) {
+            throw new UncheckedIOException(e);
+        }
+    }
 }
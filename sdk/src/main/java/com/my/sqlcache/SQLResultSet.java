@@ -15,6 +15,10 @@ public class SQLResultSet {
     private int resCount = 0;
 
     private int resIter = -1;
+    // records of streamed result are read at once, as the reply ends only after them
+    private List<HashMap<String, Object>> streamedRecords = null;
+
+    private SQLCacheErrorCode errorCode = SQLCacheErrorCode.scecNone;
 
     private TableKind myTableKind = TableKind.tkUnknown;
     // for join table, every element is field count of one table
@@ -31,10 +35,23 @@ public class SQLResultSet {
             return false;
         }
 
+        if (streamedRecords != null) {
+            fieldValues = streamedRecords.get(resIter);
+            return true;
+        }
+
         readRecord();
         return true;
     }
 
+    /**
+     * 分批发送的结果在中途失败时不为scecNone
+     * @return
+     */
+    public SQLCacheErrorCode errorCode() {
+        return errorCode;
+    }
+
     public int fieldCount() {
         return fieldList.size();
     }
@@ -51,6 +68,22 @@ public class SQLResultSet {
         loadSchema();
         resCount = input.readInt();
         resIter = -1;
+        if (resCount < 0) {
+            loadStreamedRecords();
+        }
+    }
+
+    private void loadStreamedRecords() {
+        // every record follows a true, the last one a false and errorCode
+        streamedRecords = new ArrayList<>();
+        while (input.readBoolean()) {
+            fieldValues = new HashMap<>();
+            readRecord();
+            streamedRecords.add(fieldValues);
+        }
+        errorCode = SQLCacheErrorCode.valueOf(input.readUByte());
+        resCount = streamedRecords.size();
+        fieldValues = new HashMap<>();
     }
 
     private void loadSchema() {